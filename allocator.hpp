@@ -1,14 +1,32 @@
 #ifndef EXTALLOC_ALLOCATOR_HPP
 #define EXTALLOC_ALLOCATOR_HPP
 
+#include <algorithm>
+#include <array>
+#include <cassert>
+#include <cstddef>
 #include <cstdint>
 #include <cstdlib>
+#include <cstring>
 #include <functional>
 #include <istream>
-#include <ostream>
+#include <iterator>
+#include <limits>
 #include <map>
+#include <numeric>
+#include <ostream>
+#include <set>
 #include <stdexcept>
+#include <tuple>
+#include <type_traits>
 #include <utility>
+#include <vector>
+
+#include "encoding.hpp"
+#include "flat_map.hpp"
+#include "heap_offset.hpp"
+#include "node_pool.hpp"
+#include "optional.hpp"
 
 namespace extalloc {
 
@@ -40,23 +58,318 @@ namespace extalloc {
         no_allocation & operator= (no_allocation &&) noexcept = default;
     };
 
+    /// Thrown when saved or mapped allocator metadata is not a valid heap description.
+    class bad_metadata : public std::runtime_error {
+    public:
+        explicit bad_metadata (char const * what)
+                : std::runtime_error{what} {}
+        bad_metadata (bad_metadata const &) = default;
+        bad_metadata (bad_metadata &&) noexcept = default;
+
+        ~bad_metadata () noexcept override;
 
-    class allocator {
+        bad_metadata & operator= (bad_metadata const &) = default;
+        bad_metadata & operator= (bad_metadata &&) noexcept = default;
+    };
+
+
+    /// Describes the segregated free lists ("bins") which sit in front of the free-space map.
+    /// An allocation request no larger than the largest class is rounded up to the size of its
+    /// class. When a block whose size is exactly that of a class is freed, it is held in the
+    /// class's bin and handed straight back to the next request of that class without
+    /// searching or coalescing.
+    class size_classes {
     public:
-        using address = std::uint8_t *;
-        /// The choice of std::map<> is not significant: the code assumes an ordered key/value
-        /// container.
-        using container = std::map<address, std::size_t>;
+        /// Constructs a configuration with no bins.
+        size_classes () noexcept
+                : capacity{0} {}
+        /// \param b  The size of each class in strictly ascending order.
+        /// \param c  The maximum number of blocks that each bin may hold.
+        explicit size_classes (std::vector<std::size_t> b, std::size_t c = 64)
+                : bounds{std::move (b)}
+                , capacity{c} {}
+
+        std::vector<std::size_t> bounds;
+        /// When a bin is full, its contents are coalesced into the free-space map before
+        /// another block is added.
+        std::size_t capacity;
+    };
+
+    namespace details {
+
+        /// Replaces the element of \p c at \p pos with \p v. Containers which can reposition an
+        /// element without erasing it provide a replace() member function.
+        template <typename Container, typename Value>
+        auto replace_element (Container & c, typename Container::iterator pos, Value const & v,
+                              int) -> decltype (c.replace (pos, v)) {
+            return c.replace (pos, v);
+        }
+        template <typename Container, typename Value>
+        typename Container::iterator replace_element (Container & c,
+                                                      typename Container::iterator pos,
+                                                      Value const & v, long) {
+            return c.insert (c.erase (pos), v);
+        }
+        template <typename Container, typename Value>
+        typename Container::iterator
+        replace_element (Container & c, typename Container::iterator pos, Value const & v) {
+            return replace_element (c, pos, v, 0);
+        }
+
+        /// Reserves space for \p n elements in \p c if the container supports it.
+        template <typename Container>
+        auto reserve (Container & c, std::size_t n, int) -> decltype (c.reserve (n)) {
+            return c.reserve (n);
+        }
+        template <typename Container>
+        void reserve (Container &, std::size_t, long) {}
+        template <typename Container>
+        void reserve (Container & c, std::size_t n) {
+            reserve (c, n, 0);
+        }
 
-        using add_storage_fn = std::function<std::pair<address, std::size_t> (std::size_t)>;
+    } // end namespace details
+
+    /// Selects the node-based standard library containers for an allocator's metadata. Each
+    /// entry is a separate allocation from the global heap.
+    struct map_containers {
+        template <typename Key, typename Value>
+        using map = std::map<Key, Value>;
+        template <typename Key>
+        using set = std::set<Key>;
+
+        template <typename Container>
+        static Container make (std::size_t /*hint*/) {
+            return Container{};
+        }
+        /// An estimate of the memory used by a container: each red-black tree node carries a
+        /// color and three pointers in addition to its value.
+        template <typename Container>
+        static std::size_t footprint (Container const & c) noexcept {
+            return c.size () * (sizeof (typename Container::value_type) + 4U * sizeof (void *));
+        }
+    };
+
+    /// Selects sorted-vector containers for an allocator's metadata. Keys are stored contiguously
+    /// so lookups are cache-friendly and there is no per-entry node overhead, at the cost of
+    /// moving entries on insertion and erasure.
+    struct flat_containers {
+        template <typename Key, typename Value>
+        using map = flat_map<Key, Value>;
+        template <typename Key>
+        using set = flat_set<Key>;
+
+        template <typename Container>
+        static Container make (std::size_t hint) {
+            Container result;
+            result.reserve (hint);
+            return result;
+        }
+        template <typename Container>
+        static std::size_t footprint (Container const & c) noexcept {
+            return c.capacity () * sizeof (typename Container::value_type);
+        }
+    };
+
+    /// Selects node-based standard library containers whose nodes are drawn from a per-container
+    /// node_pool. Once the pools have grown to hold the peak number of entries, changes to the
+    /// metadata make no calls to the system heap.
+    struct pooled_containers {
+        template <typename Key, typename Value>
+        using map = std::map<Key, Value, std::less<Key>,
+                             pool_allocator<std::pair<Key const, Value>>>;
+        template <typename Key>
+        using set = std::set<Key, std::less<Key>, pool_allocator<Key>>;
+
+        template <typename Container>
+        static Container make (std::size_t hint) {
+            using allocator_type = typename Container::allocator_type;
+            return Container{typename Container::key_compare{},
+                             allocator_type{std::make_shared<node_pool> (hint)}};
+        }
+        template <typename Container>
+        static std::size_t footprint (Container const & c) noexcept {
+            return c.get_allocator ().pool ()->footprint ();
+        }
+    };
+
+
+    /// Describes the storage passed to a basic_allocator's release-storage function by trim().
+    enum class release_kind {
+        /// A whole storage region, which is entirely free. If the function returns true the
+        /// region is forgotten by the allocator and may be unmapped or otherwise reused. A region
+        /// may be made up of several contiguous grants from the add-storage function.
+        region,
+        /// A page-aligned range within a free block. The allocator continues to use the range, so
+        /// it must remain addressable, but its contents may be discarded (for example, with
+        /// madvise(MADV_DONTNEED)).
+        pages,
+    };
+
+
+    /// Placement policies for basic_allocator. The policy chooses the free block from which a
+    /// request is carved when it can't be served from a bin. It is a template argument, so the
+    /// choice costs nothing at run time.
+
+    /// Chooses the smallest free block which will hold the request, and the lowest such block if
+    /// there are several of that size. The size index finds it in logarithmic time. Large blocks
+    /// are kept intact, which suits heaps of long-lived data.
+    struct best_fit {};
+    /// Chooses the free block with the lowest address which will hold the request. Allocations
+    /// gather at the start of each region, leaving the space at the end free to be trimmed, but
+    /// the search walks the free blocks in address order.
+    struct first_fit {};
+    /// Searches in address order from where the last block carved from the free-space map ended
+    /// (the "rover"), wrapping around to the start of the heap. Consecutive allocations are placed
+    /// together and the search doesn't revisit the small blocks left behind it, which suits
+    /// streams of short-lived allocations.
+    struct next_fit {};
+
+
+    /// The changes reported to a basic_allocator's journal function.
+    enum class journal_op : std::uint8_t {
+        /// A block was allocated.
+        allocate = 1,
+        /// A block was freed.
+        free = 2,
+        /// Storage was added to a region, or became a new one.
+        add_region = 3,
+        /// A whole region was given back to the provider by trim().
+        remove_region = 4,
+    };
+
+    /// The calls reported to a basic_allocator's trace function.
+    enum class trace_op : std::uint8_t {
+        allocate = 0,
+        free = 1,
+        realloc = 2,
+    };
+
+
+    /// The encodings understood by basic_allocator::save().
+    enum class save_format {
+        /// Each entry is written as a raw ptrdiff_t and size_t. This is the format written by
+        /// earlier versions; it has no header or checksum. Only the allocated and free blocks
+        /// are written, as before: the storage regions are rebuilt from them when the data is
+        /// loaded.
+        raw,
+        /// A header, the entries of each map as varints with each address encoded as the
+        /// distance from the end of the previous entry, and a checksum. The encoded data is
+        /// written with a single call to the stream.
+        compact,
+    };
+
+    /// A summary of the fragmentation of a basic_allocator's heap, returned by
+    /// basic_allocator::stats(). Free blocks held in bins are counted as free.
+    struct heap_stats {
+        static constexpr std::size_t histogram_size = std::numeric_limits<std::size_t>::digits;
+
+        /// The occupancy of a storage region.
+        struct region {
+            std::size_t size;
+            std::size_t allocated;
+        };
+
+        std::size_t num_allocs = 0;
+        std::size_t allocated_space = 0;
+        std::size_t num_free_blocks = 0;
+        std::size_t free_space = 0;
+        std::size_t largest_free_block = 0;
+        /// Element n is the number of free blocks whose size is at least 2^n and less than
+        /// 2^(n+1) bytes.
+        std::array<std::size_t, histogram_size> histogram{{}};
+        /// The storage regions in address order.
+        std::vector<region> regions;
+
+        /// Returns the histogram element which counts blocks of \p size bytes.
+        static std::size_t bucket (std::size_t size) noexcept {
+            std::size_t result = 0;
+            while (size >>= 1U) {
+                ++result;
+            }
+            return result;
+        }
+        /// The proportion of free space which lies outside the largest free block: 0 if the free
+        /// space is a single block, approaching 1 as it is split into many small blocks. A request
+        /// larger than the largest free block cannot be satisfied without growing the heap,
+        /// however much space is free.
+        double fragmentation () const noexcept {
+            return free_space == 0U ? 0.0
+                                    : 1.0 - static_cast<double> (largest_free_block) /
+                                                static_cast<double> (free_space);
+        }
+    };
+
+    /// Writes \p s as a few lines of text: the totals and fragmentation ratio, the non-empty
+    /// histogram elements, and the occupancy of each region.
+    std::ostream & operator<< (std::ostream & os, heap_stats const & s);
+
+
+    /// \tparam Containers  A policy which selects the ordered containers used for the allocator's
+    /// metadata. It must provide member alias templates map<Key, Value> and set<Key> naming types
+    /// with the interface of std::map<> and std::set<> respectively. Code must not assume that
+    /// iterators remain valid after the container is modified. The policy's static member
+    /// functions make<Container>(hint) and footprint<Container>(c) create a container with room
+    /// for approximately hint entries and report the number of bytes that it occupies.
+    /// \tparam Address  The type used for the addresses of blocks and storage regions:
+    /// std::uint8_t * or a basic_heap_offset<>. With an offset, the storage functions deal in
+    /// offsets from the base of a single address space, the metadata holds no pointers, and save()
+    /// writes the offsets unchanged. A compact_offset<> is recorded, together with each block's
+    /// size, in 32 bits. Requests are rounded up to a multiple of its granule, and the storage
+    /// functions must grant storage whose start and size are multiples of the granule. Storage
+    /// which is not, or which ends beyond the largest offset, is rejected with
+    /// std::invalid_argument.
+    /// \tparam Fit  The placement policy: best_fit, first_fit, or next_fit.
+    /// \tparam Storage  The type of the add-storage function: a function object which is called
+    /// with the number of bytes needed and returns a std::pair<Address, std::size_t>. The default,
+    /// a std::function, accepts any such callable. A provider class, such as those in
+    /// storage.hpp, is called directly and can be inlined into the allocator's growth path.
+    template <typename Containers = pooled_containers, typename Address = std::uint8_t *,
+              typename Fit = best_fit,
+              typename Storage = std::function<std::pair<Address, std::size_t> (std::size_t)>>
+    class basic_allocator {
+    public:
+        using address = Address;
+        using fit_policy = Fit;
+        /// The type in which the metadata records the size of a block. It converts to and from
+        /// std::size_t.
+        using size_type = typename address_traits<address>::size_type;
+        using container = typename Containers::template map<address, size_type>;
+        /// A secondary index on the free blocks, ordered by size and then by address. Every entry
+        /// in frees_ has exactly one corresponding entry here.
+        using size_index = typename Containers::template set<std::pair<size_type, address>>;
+
+        using add_storage_fn = Storage;
+        /// A function which is called by trim() to return storage to its provider. It should
+        /// return true if the storage was released.
+        using release_storage_fn = std::function<bool (address, std::size_t, release_kind)>;
+        /// A function which is called to grow an existing storage region in place. It is passed
+        /// the region's start address and size and the number of additional bytes needed. It
+        /// should return the number of bytes that were added immediately after the end of the
+        /// region or 0 if the region could not be grown.
+        using extend_storage_fn = std::function<std::size_t (address, std::size_t, std::size_t)>;
+        /// A function which is told of each change to the allocator's metadata. It is passed the
+        /// kind of change and the address and size of the block or region concerned. A block
+        /// which is resized in place is reported as freed and then allocated.
+        using journal_fn = std::function<void (journal_op, address, std::size_t)>;
+        /// A function which is told of each call to allocate(), free(), and realloc(). It is
+        /// passed the operation, the address passed to free() or realloc(), the address returned
+        /// by allocate() or realloc(), and the requested size and alignment. Unused addresses
+        /// are null and the size and alignment of a free are 0 and 1.
+        using trace_fn = std::function<void (trace_op, address, address, std::size_t, std::size_t)>;
+        /// A function which is told of each block moved by compact(). It is passed the block's
+        /// old and new addresses and its size. The contents have already been moved.
+        using relocate_fn = std::function<void (address, address, std::size_t)>;
+
+        using size_classes = extalloc::size_classes;
 
         /// \param as  A function with signature compatible with `std::pair<address,
         /// size_t>(std::size_t)` which will be called if an allocation request cannot be satisfied.
         /// It is passed the amount of storage requested and should respond by attempting to
         /// allocate at least much. On success it should return a pair containing the base pointer
         /// and the actual allocated size.
-        explicit allocator (add_storage_fn const & as)
-                : allocator (as, std::make_pair (nullptr, 0)) {}
+        explicit basic_allocator (add_storage_fn const & as)
+                : basic_allocator (as, std::make_pair (nullptr, 0)) {}
 
         /// \param init  The address and size of an initial storage allocation.
         /// \param as  A function with signature compatible with `std::pair<address,
@@ -64,43 +377,1914 @@ namespace extalloc {
         /// It is passed the amount of storage requested and should respond by attempting to
         /// allocate at least much. On success it should return a pair containing the base pointer
         /// and the actual allocated size.
-        allocator (add_storage_fn const & as, std::pair<address, std::size_t> const & init);
+        /// \param classes  The size classes used for the allocator's bins. By default there are
+        /// none.
+        /// \param expected_blocks  The number of allocated and free blocks that the allocator is
+        /// expected to track. Space for this many entries is reserved in the metadata containers.
+        basic_allocator (add_storage_fn const & as, std::pair<address, std::size_t> const & init,
+                         size_classes const & classes = size_classes{},
+                         std::size_t expected_blocks = 0);
+
+        /// Allocates a block of at least \p size bytes.
+        ///
+        /// \param size  The number of bytes required.
+        /// \param alignment  The required alignment of the block. Must be a power of two.
+        /// \returns  The address of the new block or nullptr if the storage could not be grown to
+        /// satisfy the request.
+        address allocate (std::size_t size, std::size_t alignment = 1) {
+            address const result = this->allocate_block (size, alignment);
+            if (trace_) {
+                trace_ (trace_op::allocate, address{nullptr}, result, size, alignment);
+            }
+            return result;
+        }
+        void free (address ptr) {
+            this->free_block (ptr);
+            if (trace_) {
+                trace_ (trace_op::free, ptr, address{nullptr}, 0U, 1U);
+            }
+        }
+        /// Changes the size of the block at \p ptr. A block which grows takes the free space
+        /// immediately following it; if that is not enough, the free space on both sides is
+        /// used and the contents slide down into the lower address. Otherwise, or if the block
+        /// does not have the requested alignment, it is moved.
+        ///
+        /// \param ptr  The address of an existing allocation.
+        /// \param new_size  The number of bytes required.
+        /// \param alignment  The required alignment of the block. Must be a power of two.
+        /// \returns  The address of the resized block or nullptr if the storage could not be grown
+        /// to satisfy the request, in which case the original block is untouched.
+        address realloc (address ptr, std::size_t new_size, std::size_t alignment = 1) {
+            address const result = this->realloc_block (ptr, new_size, alignment);
+            if (trace_) {
+                trace_ (trace_op::realloc, ptr, result, new_size, alignment);
+            }
+            return result;
+        }
 
-        address allocate (std::size_t size);
-        void free (address offset);
-        address realloc (address ptr, std::size_t new_size);
+        /// Allocates \p n blocks. Where possible the blocks are carved, one after another, from a
+        /// single free block so that the free-space map is updated only once.
+        ///
+        /// \param sizes  The number of bytes required for each of the \p n blocks.
+        /// \param n  The number of blocks to allocate.
+        /// \param result  An array of \p n addresses which receives the new blocks.
+        /// \param alignment  The required alignment of each block. Must be a power of two. Block
+        ///   sizes are rounded up to a multiple of the alignment.
+        /// \returns  True if all of the blocks were allocated. On failure, no blocks are allocated
+        ///   and every element of \p result is nullptr.
+        bool allocate_n (std::size_t const * sizes, std::size_t n, address * result,
+                         std::size_t alignment = 1) {
+            bool const ok = this->allocate_blocks (sizes, n, result, alignment);
+            if (ok && trace_) {
+                for (auto index = std::size_t{0}; index < n; ++index) {
+                    trace_ (trace_op::allocate, address{nullptr}, result[index], sizes[index],
+                            alignment);
+                }
+            }
+            return ok;
+        }
+        /// Frees \p n blocks. The blocks are sorted by address and released in a single pass over
+        /// the metadata. If any address is not allocated, or appears more than once, no_allocation
+        /// is thrown and no block is freed.
+        void free_n (address const * ptrs, std::size_t n) {
+            this->free_blocks (ptrs, n);
+            if (trace_) {
+                for (auto index = std::size_t{0}; index < n; ++index) {
+                    trace_ (trace_op::free, ptrs[index], address{nullptr}, 0U, 1U);
+                }
+            }
+        }
+
+        /// Returns the contents of the bins to the free-space map, coalescing them with their
+        /// neighbours.
+        void flush_bins ();
+
+        /// Sets the function used to grow a region in place. When no free block can satisfy a
+        /// request, the allocator prefers extending the region with the most free space at its
+        /// end to asking the add-storage function for a new, disjoint region. A block at the end
+        /// of a region may also grow in place rather than being moved by realloc().
+        void set_extend_storage (extend_storage_fn const & es) { extend_storage_ = es; }
+        /// Sets the function which is told of each change to the metadata, so that the changes
+        /// can be recorded and later applied to a snapshot with replay().
+        void set_journal (journal_fn const & j) { journal_ = j; }
+        /// Sets the function which is told of each call to allocate(), free(), and realloc(), so
+        /// that the calls can be recorded and replayed against another configuration. The blocks
+        /// of a successful allocate_n() and free_n() are reported one at a time. Calls which the
+        /// allocator makes to itself are not reported.
+        void set_trace (trace_fn const & t) { trace_ = t; }
+        /// Applies a change reported to a journal function. The allocator must be in the state it
+        /// was in before the change was made, less the contents of its bins. The journal
+        /// function is not called.
+        ///
+        /// \throws bad_metadata  If the change is not consistent with the allocator's state.
+        void replay (journal_op op, address addr, std::size_t size);
+        /// Sets the function that trim() uses to give storage back to its provider.
+        void set_release_storage (release_storage_fn const & rs) { release_storage_ = rs; }
+        /// Gives free storage back to the provider, keeping at least \p keep_bytes of free space.
+        /// Regions which are entirely free are released first, largest first. Then the
+        /// page-aligned interiors of the largest free blocks are offered. The bins are flushed
+        /// beforehand.
+        ///
+        /// \param keep_bytes  The amount of free space which should remain available.
+        /// \param page_size  The granularity of the storage provider's pages. Must be a power of
+        ///   two.
+        /// \returns  The number of bytes offered and accepted: the size of the regions which were
+        ///   released plus that of the page ranges which the function accepted. The allocator
+        ///   doesn't record which pages have been offered, so pages which are still free are
+        ///   offered, and counted, again by the next call. This is zero if no release-storage
+        ///   function has been set.
+        std::size_t trim (std::size_t keep_bytes = 0, std::size_t page_size = 4096);
+
+        /// Moves allocated blocks towards the start of their regions so that the free space in
+        /// each region gathers into a single block at its end. Blocks are moved in address order,
+        /// each into the free block immediately below it, so successive calls continue where
+        /// the last one stopped. The bins are flushed beforehand.
+        ///
+        /// A moved block keeps its alignment up to \p alignment: a block whose address is a
+        /// multiple of \p alignment stays one. Where a free block is too small for the next
+        /// allocation to move down while keeping that alignment, the allocation stays put.
+        ///
+        /// \param relocate  Called after each block has been moved so that references to it can
+        ///   be updated.
+        /// \param budget  Once this many bytes have been moved, no further blocks are moved. The
+        ///   last block may take the total past the budget.
+        /// \param alignment  The strictest alignment that a moved block must keep. Must be a power
+        ///   of two.
+        /// \returns  The number of bytes moved. This is zero once no block can be moved.
+        std::size_t compact (relocate_fn const & relocate,
+                             std::size_t budget = std::numeric_limits<std::size_t>::max (),
+                             std::size_t alignment = alignof (std::max_align_t));
 
         bool check () const;
-        void dump (std::ostream & os);
+        /// Writes each block's address, size, and whether it is allocated, one per line in
+        /// address order.
+        /// \param with_stats  If true, the output of stats() follows the blocks.
+        void dump (std::ostream & os, bool with_stats = false);
 
         std::size_t num_allocs () const noexcept { return allocs_.size (); }
+        /// The number of records in the free-space map. This does not include blocks held in bins.
         std::size_t num_frees () const noexcept { return frees_.size (); }
+        /// The number of freed blocks being held in bins.
+        std::size_t num_binned () const noexcept { return binned_; }
+        /// The total size of the allocated blocks. This is a constant-time operation.
         std::size_t allocated_space () const noexcept;
+        /// The total size of the blocks in the free-space map. This does not include blocks held in
+        /// bins. This is a constant-time operation.
         std::size_t free_space () const noexcept;
+        /// The size of the largest block in the free-space map or 0 if the map is empty. This is a
+        /// constant-time operation.
+        std::size_t largest_free_block () const noexcept;
+        /// Returns the size of the allocated block at \p ptr. This may be larger than the size
+        /// requested, which is rounded up to the granule and to its size class.
+        ///
+        /// \throws no_allocation  If \p ptr is not the address of an allocated block.
+        std::size_t block_size (address ptr) const;
+        size_classes const & classes () const noexcept { return classes_; }
+        /// The number of bytes of memory occupied by the allocator's metadata.
+        std::size_t metadata_footprint () const noexcept;
+        /// Summarizes the fragmentation of the heap. The free-block histogram is maintained as
+        /// blocks are freed and allocated, so apart from the per-region occupancy, which needs a
+        /// pass over the free blocks, this is independent of the size of the heap.
+        heap_stats stats () const;
 
-        container::const_iterator allocs_begin () { return allocs_.begin (); }
-        container::const_iterator allocs_end () { return allocs_.end (); }
-        container::const_iterator frees_begin () { return frees_.begin (); }
-        container::const_iterator freed_end () { return frees_.end (); }
+        typename container::const_iterator allocs_begin () const { return allocs_.begin (); }
+        typename container::const_iterator allocs_end () const { return allocs_.end (); }
+        typename container::const_iterator frees_begin () const { return frees_.begin (); }
+        typename container::const_iterator freed_end () const { return frees_.end (); }
 
-        std::ostream & save (std::ostream & os, std::uint8_t const * base = nullptr) const;
+        /// The number of storage regions. Storage which is contiguous with an existing region is
+        /// merged with it, so regions are never adjacent.
+        std::size_t num_regions () const noexcept { return regions_.size (); }
+        /// The storage regions, as start address and size, in address order.
+        typename container::const_iterator regions_begin () const { return regions_.begin (); }
+        typename container::const_iterator regions_end () const { return regions_.end (); }
+
+        /// Writes the allocator's metadata to \p os. Addresses are recorded relative to \p base.
+        /// Offsets are recorded as they are and \p base is ignored.
+        std::ostream & save (std::ostream & os, std::uint8_t const * base = nullptr,
+                             save_format format = save_format::compact) const;
+        /// Replaces the allocator's metadata with that read from \p is. Either format written by
+        /// save() is accepted. If the data is rejected, the allocator is left empty, with no
+        /// blocks or storage regions, rather than holding a mixture of the old and new metadata.
+        ///
+        /// \throws bad_metadata  If the data is truncated or its entries are out of order or
+        ///   overlap, or if compact data fails its checksum or was written by an unknown version.
         void load (std::istream & is, std::uint8_t * base = nullptr);
 
+        /// Sets the address at which the heap is mapped. If addresses are offsets, realloc() uses
+        /// this to move the contents of a block, and to_pointer() to translate an address. It
+        /// isn't used if addresses are pointers.
+        void set_base (std::uint8_t * base) noexcept { base_ = base; }
+        std::uint8_t * base () const noexcept { return base_; }
+        /// Returns the memory for the block at \p addr.
+        std::uint8_t * to_pointer (address addr) const noexcept {
+            return traits::to_pointer (addr, base_);
+        }
+        /// Returns the address of the memory at \p ptr.
+        address from_pointer (std::uint8_t * ptr) const noexcept {
+            return traits::from_pointer (ptr, base_);
+        }
 
     private:
+        using traits = address_traits<address>;
+
         add_storage_fn add_storage_;
+        release_storage_fn release_storage_;
+        extend_storage_fn extend_storage_;
+        journal_fn journal_;
+        trace_fn trace_;
 
-        static address allocation_end (container::value_type const & p) noexcept {
-            return p.first + p.second;
+        /// Reports a change to the journal function, if there is one.
+        void note (journal_op op, address addr, std::size_t size) const {
+            if (journal_) {
+                journal_ (op, addr, size);
+            }
+        }
+
+        static address allocation_end (typename container::value_type const & p) noexcept {
+            return p.first + static_cast<std::size_t> (p.second);
+        }
+        /// Rounds \p size up to a multiple of the address type's granule.
+        static std::size_t granular (std::size_t size) noexcept {
+            constexpr auto granule = std::size_t{traits::granule};
+            return (size + (granule - 1U)) & ~(granule - 1U);
         }
 
         template <typename Container>
         static std::size_t accumulate_values (Container const & c);
 
+        static constexpr bool is_power_of_two (std::size_t n) noexcept {
+            return n > 0U && (n & (n - 1U)) == 0U;
+        }
+        static bool is_aligned (address addr, std::size_t alignment) noexcept {
+            return (traits::to_integer (addr) & (alignment - 1U)) == 0U;
+        }
+        static address align_up (address addr, std::size_t alignment) noexcept {
+            auto const a = traits::to_integer (addr);
+            return addr + (((a + (alignment - 1U)) & ~(std::uintptr_t{alignment} - 1U)) - a);
+        }
+        static address align_down (address addr, std::size_t alignment) noexcept {
+            auto const a = traits::to_integer (addr);
+            return addr - (a & (std::uintptr_t{alignment} - 1U));
+        }
+        /// Returns true if an aligned block of \p size bytes fits within the free block at \p addr.
+        static bool fits (address addr, std::size_t available, std::size_t size,
+                          std::size_t alignment) noexcept {
+            auto const slack = static_cast<std::size_t> (align_up (addr, alignment) - addr);
+            return available >= slack && available - slack >= size;
+        }
+
+        /// The untraced implementations of allocate(), free(), realloc(), allocate_n(), and
+        /// free_n().
+        address allocate_block (std::size_t size, std::size_t alignment);
+        void free_block (address ptr);
+        address realloc_block (address ptr, std::size_t new_size, std::size_t alignment);
+        bool allocate_blocks (std::size_t const * sizes, std::size_t n, address * result,
+                              std::size_t alignment);
+        void free_blocks (address const * ptrs, std::size_t n);
+
+        /// Returns the free block chosen by the placement policy for an aligned request or
+        /// frees_.end() if there is none.
+        typename container::iterator find_fit (std::size_t size, std::size_t alignment) {
+            return this->find_fit (size, alignment, Fit{});
+        }
+        typename container::iterator find_fit (std::size_t size, std::size_t alignment, best_fit);
+        typename container::iterator find_fit (std::size_t size, std::size_t alignment,
+                                               first_fit);
+        typename container::iterator find_fit (std::size_t size, std::size_t alignment, next_fit);
+        /// Returns the first free block in [first, last) which will hold an aligned request or
+        /// frees_.end() if there is none.
+        typename container::iterator first_fitting (typename container::iterator first,
+                                                    typename container::iterator last,
+                                                    std::size_t size, std::size_t alignment);
+        /// Records that a block ending at \p end was carved from the free-space map. Only
+        /// next_fit makes use of it.
+        void placed (address end, next_fit) noexcept { rover_ = end; }
+        template <typename Policy>
+        void placed (address, Policy) noexcept {}
+        /// Moves an allocation to a new block of \p new_size bytes.
+        address relocate (address ptr, std::size_t old_size, std::size_t new_size,
+                          std::size_t alignment);
+
+        /// Returns the size of the block which will be allocated in response to a request for
+        /// \p size bytes.
+        std::size_t request_size (std::size_t size) const noexcept;
+        /// Returns the first element of \p c whose key is not less than \p addr, searching
+        /// forwards from \p from for a few elements before falling back to lower_bound().
+        /// \p from must not be after the result.
+        template <typename Container>
+        static typename Container::iterator seek (Container & c, typename Container::iterator from,
+                                                  address addr);
+
+        /// Records a free block in both frees_ and the size index.
+        typename container::iterator insert_free (address addr, std::size_t size);
+        /// Records a free block which will be inserted immediately before \p hint in frees_.
+        typename container::iterator insert_free (typename container::iterator hint, address addr,
+                                                  std::size_t size);
+        /// Removes a free block from both frees_ and the size index.
+        /// \returns  The element of frees_ which followed the erased block.
+        typename container::iterator erase_free (typename container::iterator pos);
+        /// Changes the start address and/or size of an existing free block, keeping the size index
+        /// in step. The block must not overlap or pass either of its neighbours.
+        /// \returns  The position of the changed block.
+        typename container::iterator replace_free (typename container::iterator pos, address addr,
+                                                   std::size_t size);
+        /// Adds a block to the free-space map, merging it with any free neighbours.
+        /// \returns  The position of the free block which contains the released space.
+        typename container::iterator release (address addr, std::size_t size);
+        /// Adds a block to the free-space map, merging it with any free neighbours. \p lb must
+        /// be frees_.lower_bound (addr).
+        /// \returns  The position of the free block which contains the released space.
+        typename container::iterator release (typename container::iterator lb, address addr,
+                                              std::size_t size);
+
+        /// Returns the index of the bin which serves requests of \p size bytes or bins_.size() if
+        /// there is none.
+        std::size_t bin_index (std::size_t size) const noexcept;
+        void flush_bin (std::size_t bin);
+        /// Returns the free-space map with the contents of the bins coalesced into it.
+        container canonical_frees () const;
+
+        void save_raw (std::ostream & os, std::uint8_t const * base, container const & frees) const;
+        void save_compact (std::ostream & os, std::uint8_t const * base,
+                           container const & frees) const;
+        /// Reads data in the raw format. The number of allocations, which is the first value in
+        /// the stream, has already been read.
+        void load_raw (std::istream & is, std::uint8_t * base, std::size_t num_allocs);
+        /// Reads data in the compact format. The signature has already been read.
+        void load_compact (std::istream & is, std::uint8_t * base);
+        /// Returns the address of a loaded entry: \p delta bytes from \p prev, the end of the
+        /// previous entry. Entries are in address order and don't overlap, so only the first,
+        /// which is measured from the base, may start below \p prev.
+        ///
+        /// \throws bad_metadata  If the entry is out of order, its \p size bytes would wrap
+        ///   around the address space, or it can't be represented by the address type.
+        static address loaded_entry (address prev, std::int64_t delta, std::uint64_t size,
+                                     bool first);
+
+        /// The signature at the start of data in the compact format.
+        static constexpr std::array<char, 8> compact_signature () noexcept {
+            return {{'E', 'X', 'T', 'A', 'L', 'L', 'O', 'C'}};
+        }
+        static constexpr std::uint64_t compact_version = 1;
+
+        /// Records a new storage region, merging it with any adjacent regions.
+        /// \throws std::invalid_argument  If the region can't be represented by the address type.
+        void add_region (address addr, std::size_t size);
+        /// Grows the region which needs the smallest extension to satisfy an aligned request for
+        /// \p size bytes.
+        /// \returns  The position of the free block at the end of the grown region or
+        ///   frees_.end() if no region could be grown.
+        typename container::iterator extend_for (std::size_t size, std::size_t alignment);
+        /// Asks the extend-storage function to grow \p region by \p additional bytes and adds the
+        /// new space to the free-space map.
+        /// \returns  The position of the free block which contains the new space or frees_.end()
+        ///   if the region could not be grown.
+        typename container::iterator extend_region (typename container::iterator region,
+                                                    std::size_t additional);
+        /// Recreates the region list from the allocated and free blocks, which together tile the
+        /// storage.
+        void rebuild_regions ();
+
         container allocs_;
         container frees_;
+        size_index sizes_;
+        /// The storage regions which have been given to the allocator.
+        container regions_;
+
+        size_classes classes_;
+        std::vector<std::vector<address>> bins_;
+        std::size_t binned_ = 0;
+
+        /// Running totals of the values in allocs_ and frees_ respectively.
+        std::size_t allocated_bytes_ = 0;
+        std::size_t free_bytes_ = 0;
+        /// The sizes of the blocks in frees_, counted as for heap_stats::histogram.
+        std::array<std::size_t, heap_stats::histogram_size> free_histogram_{{}};
+
+        /// Where the heap is mapped, if addresses are offsets.
+        std::uint8_t * base_ = nullptr;
+        /// Where the next_fit search resumes.
+        address rover_{};
     };
 
+    using allocator = basic_allocator<>;
+    /// An allocator whose addresses are offsets from the base of the heap.
+    using offset_allocator = basic_allocator<pooled_containers, heap_offset>;
+    /// An allocator whose metadata records each block as a 32-bit offset and a 32-bit size, both
+    /// in units of \p Granule bytes. The heap must be smaller than 4 GiB times the granule.
+    template <std::size_t Granule = 1, typename Containers = pooled_containers>
+    using compact_allocator = basic_allocator<Containers, compact_offset<Granule>>;
+
+    //*       _ _              _            *
+    //*  __ _| | |___  __ __ _| |_ ___ _ _  *
+    //* / _` | | / _ \/ _/ _` |  _/ _ \ '_| *
+    //* \__,_|_|_\___/\__\__,_|\__\___/_|   *
+    //*                                     *
+    // ctor
+    // ~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    basic_allocator<Containers, Address, Fit, Storage>::basic_allocator (
+        add_storage_fn const & as, std::pair<address, std::size_t> const & init,
+        size_classes const & classes, std::size_t expected_blocks)
+            : add_storage_{as}
+            , allocs_{Containers::template make<container> (expected_blocks)}
+            , frees_{Containers::template make<container> (expected_blocks)}
+            , sizes_{Containers::template make<size_index> (expected_blocks)}
+            , regions_{Containers::template make<container> (0)}
+            , classes_{classes} {
+
+        auto const & bounds = classes_.bounds;
+        if (!bounds.empty ()) {
+            if (bounds.front () == 0U ||
+                std::adjacent_find (std::begin (bounds), std::end (bounds),
+                                    std::greater_equal<std::size_t>{}) != std::end (bounds)) {
+                throw std::invalid_argument ("size classes must be non-zero and ascending");
+            }
+            if (std::any_of (std::begin (bounds), std::end (bounds),
+                             [](std::size_t b) { return granular (b) != b; })) {
+                throw std::invalid_argument ("size classes must be multiples of the granule");
+            }
+
+            bins_.resize (bounds.size ());
+            for (auto & b : bins_) {
+                b.reserve (classes_.capacity);
+            }
+        }
+
+        if (init.first != nullptr && init.second > 0) {
+            this->add_region (init.first, init.second);
+            this->insert_free (init.first, init.second);
+        }
+    }
+
+    // allocate block
+    // ~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::allocate_block (std::size_t size,
+                                                                             std::size_t alignment)
+        -> address {
+        if (!is_power_of_two (alignment)) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        size = granular (std::max (size, std::size_t{1}));
+
+        // Small requests are rounded up to the size of their class. A block waiting in that
+        // class's bin can be handed out as it is provided that it is suitably aligned.
+        auto const bin = this->bin_index (size);
+        if (bin < bins_.size ()) {
+            size = classes_.bounds[bin];
+            auto & b = bins_[bin];
+            if (!b.empty () && is_aligned (b.back (), alignment)) {
+                address const result = b.back ();
+                b.pop_back ();
+                --binned_;
+                allocs_.insert ({result, size});
+                allocated_bytes_ += size;
+                this->note (journal_op::allocate, result, size);
+                return result;
+            }
+        }
+
+        auto pos = this->find_fit (size, alignment);
+        if (pos == std::end (frees_) && binned_ > 0U) {
+            // Before asking for more storage, see whether the blocks held in the bins coalesce to
+            // produce something large enough.
+            this->flush_bins ();
+            pos = this->find_fit (size, alignment);
+        }
+        if (pos == std::end (frees_)) {
+            // No free space large enough. Growing an existing region keeps the heap contiguous
+            // so is preferred to asking for new storage.
+            pos = this->extend_for (size, alignment);
+            if (pos == std::end (frees_) || !fits (pos->first, pos->second, size, alignment)) {
+                // Allocate more. Ask for enough that the request can be satisfied wherever the
+                // new storage happens to start.
+                auto const required = size + (alignment - 1U);
+                std::pair<address, std::size_t> const storage = add_storage_ (required);
+                if (std::get<0> (storage) == nullptr || std::get<1> (storage) == 0U) {
+                    return nullptr;
+                }
+                // The new storage may be contiguous with free space at the end of an existing
+                // region, in which case the two are merged.
+                this->add_region (std::get<0> (storage), std::get<1> (storage));
+                this->note (journal_op::add_region, std::get<0> (storage),
+                            std::get<1> (storage));
+                pos = this->release (std::get<0> (storage), std::get<1> (storage));
+                if (!fits (pos->first, pos->second, size, alignment)) {
+                    return nullptr;
+                }
+            }
+        }
+
+        // There's a free block with sufficient space.
+        address const start = pos->first;
+        std::size_t const available = pos->second;
+        address const result = align_up (start, alignment);
+        auto const slack = static_cast<std::size_t> (result - start);
+        assert (available >= slack + size);
+        auto const remaining = available - slack - size;
+
+        if (slack > 0U) {
+            // Any space skipped to reach the required alignment remains free.
+            this->replace_free (pos, start, slack);
+            if (remaining > 0U) {
+                this->insert_free (result + size, remaining);
+            }
+        } else if (remaining > 0U) {
+            // Split this block.
+            this->replace_free (pos, result + size, remaining);
+        } else {
+            this->erase_free (pos);
+        }
+
+        allocs_.insert ({result, size});
+        allocated_bytes_ += size;
+        this->placed (result + size, Fit{});
+        this->note (journal_op::allocate, result, size);
+        return result;
+    }
+
+    // find fit [best fit]
+    // ~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::find_fit (std::size_t size,
+                                                                       std::size_t alignment,
+                                                                       best_fit)
+        -> typename container::iterator {
+        // Find the smallest free block that will satisfy the request. Blocks of the same size are
+        // ordered by address so the lowest one is preferred.
+        auto it = sizes_.lower_bound (std::make_pair (size, address{}));
+        auto const end = std::end (sizes_);
+        if (alignment > 1U) {
+            // A block of at least size + alignment - 1 bytes is large enough wherever it starts, so
+            // only the blocks smaller than that need their alignment to be checked.
+            auto const limit = size + (alignment - 1U);
+            for (; it != end && it->first < limit; ++it) {
+                if (fits (it->second, it->first, size, alignment)) {
+                    break;
+                }
+            }
+        }
+        if (it == end) {
+            return std::end (frees_);
+        }
+        auto const pos = frees_.find (it->second);
+        assert (pos != std::end (frees_) && pos->second == it->first);
+        return pos;
+    }
+
+    // find fit [first fit]
+    // ~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::find_fit (std::size_t size,
+                                                                       std::size_t alignment,
+                                                                       first_fit)
+        -> typename container::iterator {
+        if (this->largest_free_block () < size) {
+            return std::end (frees_);
+        }
+        return this->first_fitting (std::begin (frees_), std::end (frees_), size, alignment);
+    }
+
+    // find fit [next fit]
+    // ~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::find_fit (std::size_t size,
+                                                                       std::size_t alignment,
+                                                                       next_fit)
+        -> typename container::iterator {
+        if (this->largest_free_block () < size) {
+            return std::end (frees_);
+        }
+        // Start with the free block containing the rover, if there is one, otherwise the block
+        // after it. The blocks before that are searched if the rest of the heap has nothing.
+        auto start = frees_.lower_bound (rover_);
+        if (start != std::begin (frees_)) {
+            auto const prev = std::prev (start);
+            if (allocation_end (*prev) > rover_) {
+                start = prev;
+            }
+        }
+        auto const pos = this->first_fitting (start, std::end (frees_), size, alignment);
+        if (pos != std::end (frees_)) {
+            return pos;
+        }
+        return this->first_fitting (std::begin (frees_), start, size, alignment);
+    }
+
+    // first fitting
+    // ~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::first_fitting (
+        typename container::iterator first, typename container::iterator last, std::size_t size,
+        std::size_t alignment) -> typename container::iterator {
+        for (; first != last; ++first) {
+            if (fits (first->first, first->second, size, alignment)) {
+                return first;
+            }
+        }
+        return std::end (frees_);
+    }
+
+    // realloc block
+    // ~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::realloc_block (address ptr,
+                                                                            std::size_t new_size,
+                                                                            std::size_t alignment)
+        -> address {
+        if (!is_power_of_two (alignment)) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        new_size = granular (std::max (new_size, std::size_t{1}));
+        auto const bin = this->bin_index (new_size);
+        if (bin < bins_.size ()) {
+            new_size = classes_.bounds[bin];
+        }
+
+        auto const pos = allocs_.find (ptr);
+        assert (frees_.find (ptr) == std::end (frees_));
+        if (pos == std::end (allocs_)) {
+            throw no_allocation ();
+        }
+
+        if (!is_aligned (ptr, alignment)) {
+            // The existing block doesn't have the requested alignment so it must be moved whatever
+            // its new size.
+            return this->relocate (ptr, pos->second, new_size, alignment);
+        }
+        if (new_size == pos->second) {
+            // No change in size: just return the original pointer.
+            return ptr;
+        }
+
+        auto const end_address = allocation_end (*pos);
+        auto const lb = frees_.lower_bound (end_address);
+
+        if (new_size > pos->second) {
+            // We're being asked to enlarge the allocation. Is there sufficient free space
+            // immediately following?
+            auto const old_size = pos->second;
+            auto const extra = new_size - old_size;
+            bool const has_next = lb != std::end (frees_) && lb->first == end_address;
+            if (has_next && lb->second >= extra) {
+                if (lb->second > extra) {
+                    this->replace_free (lb, end_address + extra, lb->second - extra);
+                } else {
+                    this->erase_free (lb);
+                }
+                allocated_bytes_ += extra;
+                pos->second = new_size;
+                this->note (journal_op::free, ptr, old_size);
+                this->note (journal_op::allocate, ptr, new_size);
+                return ptr;
+            }
+
+            // Is there enough if we also take the free space immediately preceding? If so, the
+            // contents slide down into it. No free block starts within the allocation, so the
+            // one before lb is the only candidate.
+            if (lb != std::begin (frees_)) {
+                auto prev = std::prev (lb);
+                if (allocation_end (*prev) == ptr) {
+                    address const start = prev->first;
+                    auto const following = has_next ? std::size_t{lb->second} : std::size_t{0};
+                    auto const total = prev->second + old_size + following;
+                    if (fits (start, total, new_size, alignment)) {
+                        address const new_ptr = align_up (start, alignment);
+                        auto const slack = static_cast<std::size_t> (new_ptr - start);
+                        auto const tail = total - slack - new_size;
+                        if (has_next) {
+                            // Erasing the later block leaves prev valid.
+                            this->erase_free (lb);
+                        }
+                        if (slack > 0U) {
+                            prev = this->replace_free (prev, start, slack);
+                            ++prev;
+                        } else {
+                            prev = this->erase_free (prev);
+                        }
+                        if (tail > 0U) {
+                            this->insert_free (prev, new_ptr + new_size, tail);
+                        }
+                        details::replace_element (allocs_, pos, std::make_pair (new_ptr, new_size));
+                        allocated_bytes_ += extra;
+                        std::memmove (this->to_pointer (new_ptr), this->to_pointer (ptr),
+                                      old_size);
+                        this->note (journal_op::free, ptr, old_size);
+                        this->note (journal_op::allocate, new_ptr, new_size);
+                        return new_ptr;
+                    }
+                }
+            }
+
+            // If the block, together with any free space following it, runs to the end of its
+            // region, try growing the region so that the block need not move.
+            if (extend_storage_) {
+                auto region = regions_.upper_bound (ptr);
+                assert (region != std::begin (regions_));
+                --region;
+                auto const following = has_next ? std::size_t{lb->second} : std::size_t{0};
+                if (end_address + following == allocation_end (*region)) {
+                    auto const grown = this->extend_region (region, extra - following);
+                    if (grown != std::end (frees_) && grown->second >= extra) {
+                        return this->realloc_block (ptr, new_size, alignment);
+                    }
+                }
+            }
+
+            // We must move the block somewhere else to satisfy the allocation request.
+            return this->relocate (ptr, old_size, new_size, alignment);
+        }
+
+        assert (new_size < pos->second);
+        auto const reduction = pos->second - new_size;
+        if (lb != std::end (frees_) && lb->first == end_address) {
+            // There's a free block immediately following. Move its start to coincide with the space
+            // being released.
+            this->replace_free (lb, lb->first - reduction, lb->second + reduction);
+        } else {
+            // There's no following free space, so just create some.
+            this->insert_free (ptr + new_size, reduction);
+        }
+        // Adjust the allocation size.
+        allocated_bytes_ -= reduction;
+        pos->second = new_size;
+        this->note (journal_op::free, ptr, new_size + reduction);
+        this->note (journal_op::allocate, ptr, new_size);
+        return ptr;
+    }
+
+    // relocate
+    // ~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::relocate (address ptr,
+                                                                       std::size_t old_size,
+                                                                       std::size_t new_size,
+                                                                       std::size_t alignment)
+        -> address {
+        // Note that allocate() may invalidate any iterators into allocs_.
+        auto const new_ptr = this->allocate_block (new_size, alignment);
+        if (new_ptr != nullptr) {
+            std::copy_n (this->to_pointer (ptr), std::min (old_size, new_size),
+                         this->to_pointer (new_ptr));
+            this->free_block (ptr);
+        }
+        return new_ptr;
+    }
+
+    // request size
+    // ~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::request_size (
+        std::size_t size) const noexcept {
+        size = granular (std::max (size, std::size_t{1}));
+        auto const bin = this->bin_index (size);
+        return bin < bins_.size () ? classes_.bounds[bin] : size;
+    }
+
+    // allocate blocks
+    // ~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    bool basic_allocator<Containers, Address, Fit, Storage>::allocate_blocks (
+        std::size_t const * sizes, std::size_t n, address * result, std::size_t alignment) {
+        if (!is_power_of_two (alignment)) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        auto const block_size = [this, alignment](std::size_t size) {
+            return (this->request_size (size) + (alignment - 1U)) & ~(alignment - 1U);
+        };
+        std::fill_n (result, n, address{nullptr});
+
+        // Serve what we can from the bins, and total the size of the remaining blocks.
+        std::size_t total = 0;
+        for (auto index = std::size_t{0}; index < n; ++index) {
+            auto const size = block_size (sizes[index]);
+            auto const bin = this->bin_index (size);
+            if (bin < bins_.size () && size == classes_.bounds[bin]) {
+                auto & b = bins_[bin];
+                if (!b.empty () && is_aligned (b.back (), alignment)) {
+                    result[index] = b.back ();
+                    b.pop_back ();
+                    --binned_;
+                    allocs_.insert ({result[index], size});
+                    allocated_bytes_ += size;
+                    this->note (journal_op::allocate, result[index], size);
+                    continue;
+                }
+            }
+            total += size;
+        }
+        if (total == 0U) {
+            return true;
+        }
+
+        auto pos = this->find_fit (total, alignment);
+        if (pos == std::end (frees_) && binned_ > 0U) {
+            this->flush_bins ();
+            pos = this->find_fit (total, alignment);
+        }
+        if (pos == std::end (frees_)) {
+            // No single free block will hold the whole batch: allocate the remaining blocks one at
+            // a time.
+            for (auto index = std::size_t{0}; index < n; ++index) {
+                if (result[index] == nullptr) {
+                    result[index] = this->allocate_block (block_size (sizes[index]), alignment);
+                    if (result[index] == nullptr) {
+                        auto const last = std::remove (result, result + n, address{nullptr});
+                        this->free_blocks (result, static_cast<std::size_t> (last - result));
+                        std::fill_n (result, n, address{nullptr});
+                        return false;
+                    }
+                }
+            }
+            return true;
+        }
+
+        // Carve the blocks from the free block in one piece.
+        address const start = pos->first;
+        std::size_t const available = pos->second;
+        address const first = align_up (start, alignment);
+        auto const slack = static_cast<std::size_t> (first - start);
+        assert (available >= slack + total);
+        auto const remaining = available - slack - total;
+        if (slack > 0U) {
+            pos = this->replace_free (pos, start, slack);
+            if (remaining > 0U) {
+                this->insert_free (std::next (pos), first + total, remaining);
+            }
+        } else if (remaining > 0U) {
+            this->replace_free (pos, first + total, remaining);
+        } else {
+            this->erase_free (pos);
+        }
+
+        // The new allocations are contiguous so each is inserted immediately after the last.
+        auto hint = allocs_.lower_bound (first);
+        address addr = first;
+        for (auto index = std::size_t{0}; index < n; ++index) {
+            if (result[index] == nullptr) {
+                auto const size = block_size (sizes[index]);
+                hint = std::next (allocs_.emplace_hint (hint, addr, size));
+                this->note (journal_op::allocate, addr, size);
+                result[index] = addr;
+                addr += size;
+            }
+        }
+        assert (addr == first + total);
+        allocated_bytes_ += total;
+        this->placed (addr, Fit{});
+        return true;
+    }
+
+    // free blocks
+    // ~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::free_blocks (address const * ptrs,
+                                                                          std::size_t n) {
+        if (n == 0U) {
+            return;
+        }
+        std::vector<std::pair<address, std::size_t>> blocks;
+        blocks.reserve (n);
+        std::transform (ptrs, ptrs + n, std::back_inserter (blocks),
+                        [](address p) { return std::make_pair (p, std::size_t{0}); });
+        std::sort (std::begin (blocks), std::end (blocks));
+
+        // Check that every block is allocated (and record its size) before anything is changed.
+        // Since pos moves past each match, an address which appears twice is also rejected.
+        auto pos = std::begin (allocs_);
+        for (auto & block : blocks) {
+            pos = seek (allocs_, pos, block.first);
+            if (pos == std::end (allocs_) || pos->first != block.first) {
+                throw no_allocation ();
+            }
+            assert (frees_.find (block.first) == std::end (frees_));
+            block.second = pos->second;
+            ++pos;
+        }
+
+        pos = allocs_.find (blocks.front ().first);
+        for (auto const & block : blocks) {
+            pos = seek (allocs_, pos, block.first);
+            assert (pos != std::end (allocs_) && pos->first == block.first);
+            allocated_bytes_ -= block.second;
+            pos = allocs_.erase (pos);
+            this->note (journal_op::free, block.first, block.second);
+        }
+
+        // Blocks which fit a size class exactly go to the bins just as they would for free().
+        if (!bins_.empty ()) {
+            auto const binned = [this](std::pair<address, std::size_t> const & block) {
+                auto const bin = this->bin_index (block.second);
+                if (bin < bins_.size () && block.second == classes_.bounds[bin]) {
+                    auto & b = bins_[bin];
+                    if (b.size () >= classes_.capacity) {
+                        this->flush_bin (bin);
+                    }
+                    b.push_back (block.first);
+                    ++binned_;
+                    return true;
+                }
+                return false;
+            };
+            blocks.erase (std::remove_if (std::begin (blocks), std::end (blocks), binned),
+                          std::end (blocks));
+            if (blocks.empty ()) {
+                return;
+            }
+        }
+
+        // Merge runs of adjacent blocks so that each run needs only one update.
+        auto out = std::begin (blocks);
+        for (auto it = std::next (out), end = std::end (blocks); it != end; ++it) {
+            if (allocation_end (*out) == it->first) {
+                out->second += it->second;
+            } else {
+                *++out = *it;
+            }
+        }
+        blocks.erase (std::next (out), std::end (blocks));
+
+        // Walk the free-space map once, releasing each run in address order.
+        auto free_pos = frees_.lower_bound (blocks.front ().first);
+        for (auto const & run : blocks) {
+            free_pos = seek (frees_, free_pos, run.first);
+            free_pos = this->release (free_pos, run.first, run.second);
+        }
+    }
+
+    // free block
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::free_block (address ptr) {
+        auto const pos = allocs_.find (ptr);
+        assert (frees_.find (ptr) == std::end (frees_));
+        if (pos == std::end (allocs_)) {
+            throw no_allocation ();
+        }
+
+        // If the block is exactly the size of one of the size classes, hold on to it in that
+        // class's bin so that a subsequent request of the same size can reuse it immediately.
+        auto const bin = this->bin_index (pos->second);
+        if (bin < bins_.size () && pos->second == classes_.bounds[bin]) {
+            auto & b = bins_[bin];
+            if (b.size () >= classes_.capacity) {
+                this->flush_bin (bin);
+            }
+            b.push_back (pos->first);
+            ++binned_;
+        } else {
+            this->release (pos->first, pos->second);
+        }
+        allocated_bytes_ -= pos->second;
+        this->note (journal_op::free, pos->first, pos->second);
+        allocs_.erase (pos);
+    }
+
+    // release
+    // ~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::release (address addr,
+                                                                      std::size_t size)
+        -> typename container::iterator {
+        // lower_bound() returns an iterator pointing to the first element that's not less than
+        // addr.
+        return this->release (frees_.lower_bound (addr), addr, size);
+    }
+
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::release (
+        typename container::iterator lb, address addr, std::size_t size)
+        -> typename container::iterator {
+        assert (lb == frees_.lower_bound (addr));
+        optional<typename container::iterator> prev;
+        optional<typename container::iterator> next;
+
+        if (lb != std::begin (frees_)) {
+            prev = lb;
+            std::advance (*prev, -1);
+            if (addr != allocation_end (**prev)) {
+                prev.reset ();
+            }
+        }
+        if (lb != std::end (frees_)) {
+            assert (lb->first > addr);
+            if (addr + size == lb->first) {
+                next = lb;
+            }
+        }
+
+        if (prev) {
+            if (next) {
+                // We can merge with both the previous and subsequent free. This merges the 3 frees
+                // into a single record. Erasing the later record leaves *prev valid.
+                auto const merged = (*prev)->second + size + (*next)->second;
+                this->erase_free (*next);
+                return this->replace_free (*prev, (*prev)->first, merged);
+            }
+            // We can merge with the previous free. No new record is necessary.
+            return this->replace_free (*prev, (*prev)->first, (*prev)->second + size);
+        }
+        if (next) {
+            // We can merge with the subsequent free. Its record is moved to start at addr.
+            return this->replace_free (*next, addr, size + (*next)->second);
+        }
+        // We can't merge: create a new record.
+        return this->insert_free (lb, addr, size);
+    }
+
+    // bin index
+    // ~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::bin_index (
+        std::size_t size) const noexcept {
+        // The bounds are few and sorted, so a binary search is cheap and, unlike a table indexed
+        // by size, costs no memory however large the largest class.
+        auto const & bounds = classes_.bounds;
+        return static_cast<std::size_t> (
+            std::lower_bound (std::begin (bounds), std::end (bounds), size) - std::begin (bounds));
+    }
+
+    // flush bin
+    // ~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::flush_bin (std::size_t bin) {
+        auto & b = bins_[bin];
+        auto const size = classes_.bounds[bin];
+        for (address const addr : b) {
+            this->release (addr, size);
+        }
+        binned_ -= b.size ();
+        b.clear ();
+    }
+
+    // flush bins
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::flush_bins () {
+        for (auto bin = std::size_t{0}, end = bins_.size (); bin < end; ++bin) {
+            this->flush_bin (bin);
+        }
+        assert (binned_ == 0U);
+    }
+
+    // replay
+    // ~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::replay (journal_op op, address addr,
+                                                                     std::size_t size) {
+        auto const mismatch = []() { return bad_metadata ("journal does not match the heap"); };
+        // The bins must be empty so that every free block is in the free-space map.
+        this->flush_bins ();
+        switch (op) {
+        case journal_op::allocate: {
+            // Find the free block which contains the allocation and carve it out.
+            auto pos = frees_.upper_bound (addr);
+            if (pos == std::begin (frees_) || size == 0U) {
+                throw mismatch ();
+            }
+            --pos;
+            if (addr + size > allocation_end (*pos)) {
+                throw mismatch ();
+            }
+            auto const before = static_cast<std::size_t> (addr - pos->first);
+            auto const after = static_cast<std::size_t> (allocation_end (*pos) - (addr + size));
+            if (before > 0U) {
+                pos = this->replace_free (pos, pos->first, before);
+                if (after > 0U) {
+                    this->insert_free (std::next (pos), addr + size, after);
+                }
+            } else if (after > 0U) {
+                this->replace_free (pos, addr + size, after);
+            } else {
+                this->erase_free (pos);
+            }
+            allocs_.emplace (addr, size);
+            allocated_bytes_ += size;
+        } break;
+        case journal_op::free: {
+            auto const pos = allocs_.find (addr);
+            if (pos == std::end (allocs_) || pos->second != size) {
+                throw mismatch ();
+            }
+            allocated_bytes_ -= size;
+            allocs_.erase (pos);
+            this->release (addr, size);
+        } break;
+        case journal_op::add_region:
+            if (!traits::is_representable (addr, size)) {
+                throw mismatch ();
+            }
+            this->add_region (addr, size);
+            this->release (addr, size);
+            break;
+        case journal_op::remove_region: {
+            auto const region = regions_.find (addr);
+            auto const pos = frees_.find (addr);
+            if (region == std::end (regions_) || region->second != size ||
+                pos == std::end (frees_) || pos->second != size) {
+                throw mismatch ();
+            }
+            this->erase_free (pos);
+            regions_.erase (region);
+        } break;
+        default: throw mismatch ();
+        }
+    }
+
+    // trim
+    // ~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::trim (std::size_t keep_bytes,
+                                                                          std::size_t page_size) {
+        if (!is_power_of_two (page_size)) {
+            throw std::invalid_argument ("page size must be a power of two");
+        }
+        if (!release_storage_) {
+            return 0;
+        }
+        this->flush_bins ();
+        std::size_t released = 0;
+
+        // Regions which are entirely free, largest first.
+        std::vector<std::pair<std::size_t, address>> candidates;
+        for (auto const & region : regions_) {
+            auto const pos = frees_.find (region.first);
+            if (pos != std::end (frees_) && pos->second == region.second) {
+                candidates.emplace_back (region.second, region.first);
+            }
+        }
+        std::sort (std::begin (candidates), std::end (candidates),
+                   std::greater<std::pair<std::size_t, address>>{});
+        for (auto const & c : candidates) {
+            if (free_bytes_ - c.first < keep_bytes) {
+                continue;
+            }
+            if (release_storage_ (c.second, c.first, release_kind::region)) {
+                this->erase_free (frees_.find (c.second));
+                regions_.erase (c.second);
+                this->note (journal_op::remove_region, c.second, c.first);
+                released += c.first;
+            }
+        }
+
+        // The page-aligned interiors of the remaining free blocks, largest first. The blocks
+        // remain free, so the metadata is unchanged and nothing records that the pages were
+        // offered.
+        auto resident = free_bytes_;
+        for (auto it = sizes_.rbegin (), end = sizes_.rend ();
+             it != end && it->first >= page_size && resident > keep_bytes; ++it) {
+            address const first = align_up (it->second, page_size);
+            address const last = align_down (it->second + std::size_t{it->first}, page_size);
+            if (last <= first) {
+                continue;
+            }
+            auto const limit = (resident - keep_bytes) & ~(page_size - 1U);
+            auto const size = std::min (static_cast<std::size_t> (last - first), limit);
+            if (size > 0U && release_storage_ (first, size, release_kind::pages)) {
+                released += size;
+                resident -= size;
+            }
+        }
+        return released;
+    }
+
+    // compact
+    // ~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::compact (
+        relocate_fn const & relocate, std::size_t budget, std::size_t alignment) {
+        if (!is_power_of_two (alignment)) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        this->flush_bins ();
+        std::size_t moved = 0;
+        auto pos = std::begin (frees_);
+        while (pos != std::end (frees_) && moved < budget) {
+            // Free blocks are always merged with their neighbours, so the block following a free
+            // block is allocated unless the free block ends its region.
+            address const hole = pos->first;
+            address const ptr = allocation_end (*pos);
+            auto const alloc = allocs_.find (ptr);
+            if (alloc == std::end (allocs_)) {
+                ++pos;
+                continue;
+            }
+            // Keep the alignment which the block has now, up to the limit.
+            auto const a = traits::to_integer (ptr);
+            auto const keep = std::min (alignment, static_cast<std::size_t> (a & (~a + 1U)));
+            address const new_ptr = align_up (hole, keep);
+            if (new_ptr == ptr) {
+                ++pos;
+                continue;
+            }
+
+            std::size_t const size = alloc->second;
+            auto const slack = static_cast<std::size_t> (new_ptr - hole);
+            if (slack > 0U) {
+                this->replace_free (pos, hole, slack);
+            } else {
+                this->erase_free (pos);
+            }
+            details::replace_element (allocs_, alloc, std::make_pair (new_ptr, size));
+            std::memmove (this->to_pointer (new_ptr), this->to_pointer (ptr), size);
+            // The space vacated at the top of the block merges with any free block above it.
+            pos = this->release (new_ptr + size, static_cast<std::size_t> (ptr - new_ptr));
+            this->note (journal_op::free, ptr, size);
+            this->note (journal_op::allocate, new_ptr, size);
+            if (relocate) {
+                relocate (ptr, new_ptr, size);
+            }
+            moved += size;
+        }
+        return moved;
+    }
+
+    // insert free
+    // ~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::insert_free (address addr,
+                                                                          std::size_t size)
+        -> typename container::iterator {
+        auto const result = frees_.insert ({addr, size});
+        assert (result.second);
+        sizes_.insert ({size, addr});
+        free_bytes_ += size;
+        ++free_histogram_[heap_stats::bucket (size)];
+        return result.first;
+    }
+
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::insert_free (
+        typename container::iterator hint, address addr, std::size_t size)
+        -> typename container::iterator {
+        assert (frees_.find (addr) == std::end (frees_));
+        auto const result = frees_.emplace_hint (hint, addr, size);
+        sizes_.insert ({size, addr});
+        free_bytes_ += size;
+        ++free_histogram_[heap_stats::bucket (size)];
+        return result;
+    }
+
+    // erase free
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::erase_free (
+        typename container::iterator pos) -> typename container::iterator {
+        auto const erased = sizes_.erase ({pos->second, pos->first});
+        assert (erased == 1U);
+        (void) erased;
+        free_bytes_ -= pos->second;
+        --free_histogram_[heap_stats::bucket (pos->second)];
+        return frees_.erase (pos);
+    }
+
+    // replace free
+    // ~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::replace_free (
+        typename container::iterator pos, address addr, std::size_t size)
+        -> typename container::iterator {
+        auto const spos = sizes_.find ({pos->second, pos->first});
+        assert (spos != std::end (sizes_));
+        free_bytes_ = free_bytes_ - pos->second + size;
+        --free_histogram_[heap_stats::bucket (pos->second)];
+        ++free_histogram_[heap_stats::bucket (size)];
+        details::replace_element (sizes_, spos, std::make_pair (size, addr));
+        return details::replace_element (frees_, pos, std::make_pair (addr, size));
+    }
+
+    // seek [static]
+    // ~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    template <typename Container>
+    auto basic_allocator<Containers, Address, Fit, Storage>::seek (
+        Container & c, typename Container::iterator from, address addr)
+        -> typename Container::iterator {
+        // Consecutive addresses in a batch are usually close together, so a short linear search
+        // is cheaper than a fresh search from the root.
+        constexpr auto max_steps = 8U;
+        auto const end = std::end (c);
+        for (auto steps = 0U; from != end && from->first < addr; ++from, ++steps) {
+            if (steps == max_steps) {
+                return c.lower_bound (addr);
+            }
+        }
+        return from;
+    }
+
+    // canonical frees
+    // ~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::canonical_frees () const -> container {
+        container result = frees_;
+        for (auto bin = std::size_t{0}, end = bins_.size (); bin < end; ++bin) {
+            auto const size = classes_.bounds[bin];
+            for (address const addr : bins_[bin]) {
+                auto total = size;
+                auto next = result.lower_bound (addr);
+                if (next != std::end (result) && next->first == addr + size) {
+                    total += next->second;
+                    next = result.erase (next);
+                }
+                if (next != std::begin (result)) {
+                    auto const prev = std::prev (next);
+                    if (allocation_end (*prev) == addr) {
+                        prev->second += total;
+                        continue;
+                    }
+                }
+                result.emplace_hint (next, addr, total);
+            }
+        }
+        return result;
+    }
+
+    // add region
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::add_region (address addr,
+                                                                         std::size_t size) {
+        if (!traits::is_representable (addr, size)) {
+            throw std::invalid_argument ("storage is not representable by the address type");
+        }
+        auto next = regions_.lower_bound (addr);
+        assert (next == std::end (regions_) || next->first >= addr + size);
+        if (next != std::end (regions_) && next->first == addr + size) {
+            size += next->second;
+            next = regions_.erase (next);
+        }
+        if (next != std::begin (regions_)) {
+            auto const prev = std::prev (next);
+            assert (allocation_end (*prev) <= addr);
+            if (allocation_end (*prev) == addr) {
+                prev->second += size;
+                return;
+            }
+        }
+        regions_.emplace_hint (next, addr, size);
+    }
+
+    // extend for
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::extend_for (std::size_t size,
+                                                                         std::size_t alignment)
+        -> typename container::iterator {
+        if (!extend_storage_) {
+            return std::end (frees_);
+        }
+        // Find the region whose trailing free space leaves the smallest shortfall.
+        auto best = std::end (regions_);
+        std::size_t best_shortfall = 0;
+        for (auto region = std::begin (regions_); region != std::end (regions_); ++region) {
+            address const end = allocation_end (*region);
+            address start = end;
+            std::size_t trailing = 0;
+            auto const lb = frees_.lower_bound (end);
+            if (lb != std::begin (frees_)) {
+                auto const prev = std::prev (lb);
+                if (allocation_end (*prev) == end) {
+                    start = prev->first;
+                    trailing = prev->second;
+                }
+            }
+            // The request did not fit in the trailing free block so this cannot underflow.
+            auto const slack = static_cast<std::size_t> (align_up (start, alignment) - start);
+            auto const shortfall = slack + size - trailing;
+            if (best == std::end (regions_) || shortfall < best_shortfall) {
+                best = region;
+                best_shortfall = shortfall;
+            }
+        }
+        return best == std::end (regions_) ? std::end (frees_)
+                                           : this->extend_region (best, best_shortfall);
+    }
+
+    // extend region
+    // ~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::extend_region (
+        typename container::iterator region, std::size_t additional) ->
+        typename container::iterator {
+        address const end = allocation_end (*region);
+        auto const granted = extend_storage_ (region->first, region->second, additional);
+        if (granted == 0U) {
+            return std::end (frees_);
+        }
+        this->add_region (end, granted);
+        this->note (journal_op::add_region, end, granted);
+        return this->release (end, granted);
+    }
+
+    // rebuild regions
+    // ~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::rebuild_regions () {
+        regions_.clear ();
+        auto a = std::begin (allocs_);
+        auto const a_end = std::end (allocs_);
+        auto f = std::begin (frees_);
+        auto const f_end = std::end (frees_);
+        // Merge the two maps in address order, extending the current region for as long as each
+        // block starts where the last one ended.
+        while (a != a_end || f != f_end) {
+            auto & next = (f == f_end || (a != a_end && a->first < f->first)) ? a : f;
+            if (!regions_.empty ()) {
+                auto last = std::prev (std::end (regions_));
+                if (allocation_end (*last) == next->first) {
+                    last->second += next->second;
+                    ++next;
+                    continue;
+                }
+            }
+            regions_.emplace_hint (std::end (regions_), next->first, next->second);
+            ++next;
+        }
+    }
+
+    // dump
+    // ~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::dump (std::ostream & os,
+                                                                   bool with_stats) {
+        using memory_map = std::map<address, std::tuple<std::size_t, bool>>;
+
+        auto merge = [](memory_map && m, container const & c, bool is_used) {
+            memory_map result = std::move (m);
+            for (auto const & kvp : c) {
+                result[kvp.first] = std::make_tuple (kvp.second, is_used);
+            }
+            return result;
+        };
+
+        memory_map const map =
+            merge (merge (memory_map{}, allocs_, true), this->canonical_frees (), false);
+
+        os << std::boolalpha;
+        std::for_each (std::begin (map), std::end (map),
+                       [&os](std::pair<address, std::tuple<std::size_t, bool>> const & v) {
+                           os << traits::to_integer (v.first) << ','
+                              << std::get<0> (v.second) << ',' << std::get<1> (v.second) << '\n';
+                       });
+        os << std::noboolalpha;
+        if (with_stats) {
+            os << this->stats ();
+        }
+    }
+
+    // accumulate_values [static]
+    // ~~~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    template <typename Container>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::accumulate_values (
+        Container const & c) {
+        return std::accumulate (
+            std::begin (c), std::end (c), std::size_t{0},
+            [](std::size_t s, typename Container::value_type const & v) { return s + v.second; });
+    }
+
+    // allocated_space
+    // ~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t
+    basic_allocator<Containers, Address, Fit, Storage>::allocated_space () const noexcept {
+        return allocated_bytes_;
+    }
+
+    // free_space
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::free_space () const noexcept {
+        return free_bytes_;
+    }
+
+    // largest free block
+    // ~~~~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t
+    basic_allocator<Containers, Address, Fit, Storage>::largest_free_block () const noexcept {
+        // The size index is ordered by size so the largest block is its last entry.
+        return sizes_.empty () ? std::size_t{0} : std::size_t{sizes_.rbegin ()->first};
+    }
+
+    // block size
+    // ~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t basic_allocator<Containers, Address, Fit, Storage>::block_size (address ptr) const {
+        auto const pos = allocs_.find (ptr);
+        if (pos == std::end (allocs_)) {
+            throw no_allocation ();
+        }
+        return static_cast<std::size_t> (pos->second);
+    }
+
+    // stats
+    // ~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    heap_stats basic_allocator<Containers, Address, Fit, Storage>::stats () const {
+        heap_stats result;
+        result.num_allocs = allocs_.size ();
+        result.allocated_space = allocated_bytes_;
+        result.num_free_blocks = frees_.size () + binned_;
+        result.free_space = free_bytes_;
+        result.largest_free_block = this->largest_free_block ();
+        result.histogram = free_histogram_;
+        for (auto bin = std::size_t{0}, end = bins_.size (); bin < end; ++bin) {
+            auto const size = classes_.bounds[bin];
+            auto const count = bins_[bin].size ();
+            if (count > 0U) {
+                result.free_space += count * size;
+                result.largest_free_block = std::max (result.largest_free_block, size);
+                result.histogram[heap_stats::bucket (size)] += count;
+            }
+        }
+
+        // The free blocks and the regions are both in address order, so one pass over each
+        // finds the free space within each region. Binned blocks are looked up individually.
+        result.regions.reserve (regions_.size ());
+        auto free = std::begin (frees_);
+        for (auto const & region : regions_) {
+            auto const end = allocation_end (region);
+            std::size_t free_bytes = 0;
+            for (; free != std::end (frees_) && free->first < end; ++free) {
+                free_bytes += free->second;
+            }
+            result.regions.push_back (
+                heap_stats::region{region.second, region.second - free_bytes});
+        }
+        for (auto bin = std::size_t{0}, end = bins_.size (); bin < end; ++bin) {
+            for (address const addr : bins_[bin]) {
+                auto const region = regions_.upper_bound (addr);
+                assert (region != std::begin (regions_));
+                auto const index =
+                    static_cast<std::size_t> (std::distance (std::begin (regions_), region)) - 1U;
+                result.regions[index].allocated -= classes_.bounds[bin];
+            }
+        }
+        return result;
+    }
+
+    // metadata footprint
+    // ~~~~~~~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::size_t
+    basic_allocator<Containers, Address, Fit, Storage>::metadata_footprint () const noexcept {
+        auto result = Containers::footprint (allocs_) + Containers::footprint (frees_) +
+                      Containers::footprint (sizes_);
+        for (auto const & b : bins_) {
+            result += b.capacity () * sizeof (address);
+        }
+        return result;
+    }
+
+    // check
+    // ~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    bool basic_allocator<Containers, Address, Fit, Storage>::check () const {
+        if (allocated_bytes_ != accumulate_values (allocs_) ||
+            free_bytes_ != accumulate_values (frees_)) {
+            return false;
+        }
+        // The size index must describe exactly the same blocks as frees_.
+        if (sizes_.size () != frees_.size ()) {
+            return false;
+        }
+        std::array<std::size_t, heap_stats::histogram_size> histogram{{}};
+        for (auto const & s : sizes_) {
+            auto const pos = frees_.find (s.second);
+            if (pos == frees_.end () || pos->second != s.first) {
+                return false;
+            }
+            ++histogram[heap_stats::bucket (s.first)];
+        }
+        if (histogram != free_histogram_) {
+            return false;
+        }
+
+        // Gather every block -- allocated, free, and binned -- and make sure that none of them
+        // overlap.
+        std::vector<std::pair<address, std::size_t>> blocks;
+        blocks.reserve (allocs_.size () + frees_.size () + binned_);
+        blocks.insert (std::end (blocks), std::begin (allocs_), std::end (allocs_));
+        blocks.insert (std::end (blocks), std::begin (frees_), std::end (frees_));
+        for (auto bin = std::size_t{0}, end = bins_.size (); bin < end; ++bin) {
+            for (address const addr : bins_[bin]) {
+                blocks.emplace_back (addr, classes_.bounds[bin]);
+            }
+        }
+        std::sort (std::begin (blocks), std::end (blocks));
+        for (auto it = std::begin (blocks), end = std::end (blocks); it != end; ++it) {
+            auto const next = std::next (it);
+            if (next != end && next->first < allocation_end (*it)) {
+                return false;
+            }
+        }
+
+        // Every block must lie within a storage region, and no two regions may touch.
+        if (std::adjacent_find (std::begin (regions_), std::end (regions_),
+                                [](typename container::value_type const & r1,
+                                   typename container::value_type const & r2) {
+                                    return allocation_end (r1) >= r2.first;
+                                }) != std::end (regions_)) {
+            return false;
+        }
+        auto region = std::begin (regions_);
+        for (auto const & block : blocks) {
+            while (region != std::end (regions_) && allocation_end (*region) <= block.first) {
+                ++region;
+            }
+            if (region == std::end (regions_) || block.first < region->first ||
+                block.first + block.second > allocation_end (*region)) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    // save
+    // ~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    std::ostream & basic_allocator<Containers, Address, Fit, Storage>::save (
+        std::ostream & os, std::uint8_t const * base, save_format format) const {
+        auto const write_all = [&](container const & frees) {
+            if (format == save_format::raw) {
+                this->save_raw (os, base, frees);
+            } else {
+                this->save_compact (os, base, frees);
+            }
+        };
+        // Blocks held in the bins are written as ordinary free space.
+        if (binned_ == 0U) {
+            write_all (frees_);
+        } else {
+            write_all (this->canonical_frees ());
+        }
+        return os;
+    }
+
+    // save raw
+    // ~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::save_raw (
+        std::ostream & os, std::uint8_t const * base, container const & frees) const {
+        auto const write_map = [&os, base](container const & map) {
+            write (os, map.size ());
+            for (auto const & kvp : map) {
+                write (os, kvp.first - traits::origin (base));
+                write (os, static_cast<std::size_t> (kvp.second));
+            }
+        };
+        write_map (allocs_);
+        write_map (frees);
+    }
+
+    // save compact
+    // ~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::save_compact (
+        std::ostream & os, std::uint8_t const * base, container const & frees) const {
+        // The signature, version, and body size, followed by the body and its checksum. A small
+        // block typically needs two bytes.
+        constexpr auto header_size = std::size_t{24};
+        std::vector<std::uint8_t> out;
+        out.reserve (header_size + (allocs_.size () + frees.size () + regions_.size ()) * 3U +
+                     32U);
+        auto const signature = compact_signature ();
+        out.insert (std::end (out), std::begin (signature), std::end (signature));
+        encoding::put_u64 (out, compact_version);
+        encoding::put_u64 (out, 0U); // The body size is filled in below.
+
+        auto const encode = [&out, base](container const & map) {
+            encoding::put_varint (out, map.size ());
+            // The entries are sorted and don't overlap, so the gap from the end of one to the
+            // start of the next is small and usually zero.
+            auto prev = traits::origin (base);
+            for (auto const & kvp : map) {
+                encoding::put_varint (out, encoding::zigzag (kvp.first - prev));
+                encoding::put_varint (out, kvp.second);
+                prev = allocation_end (kvp);
+            }
+        };
+        encode (allocs_);
+        encode (frees);
+        encode (regions_);
+
+        auto const body_size = out.size () - header_size;
+        std::vector<std::uint8_t> size_bytes;
+        encoding::put_u64 (size_bytes, body_size);
+        std::copy (std::begin (size_bytes), std::end (size_bytes),
+                   std::begin (out) + (header_size - size_bytes.size ()));
+        encoding::put_u64 (out, encoding::fnv1a (out.data () + header_size, body_size));
+        os.write (reinterpret_cast<std::ostream::char_type const *> (out.data ()),
+                  static_cast<std::streamsize> (out.size ()));
+    }
+
+    // load
+    // ~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::load (std::istream & is,
+                                                                   std::uint8_t * base) {
+        // Data in the raw format starts with the number of allocations. Read that much and see
+        // whether it is the beginning of the compact format's signature.
+        auto const signature = compact_signature ();
+        std::array<char, sizeof (std::size_t)> prefix;
+        static_assert (sizeof (prefix) <= sizeof (signature), "size_t is too large");
+        is.read (prefix.data (), static_cast<std::streamsize> (prefix.size ()));
+        bool const compact =
+            std::equal (std::begin (prefix), std::end (prefix), std::begin (signature));
+
+        // The index, bins, and counters are derived from the maps, so they are rebuilt once the
+        // maps have been read. The maps themselves are refilled in place, so if the data is
+        // rejected part way through they are emptied rather than left half replaced.
+        for (auto & b : bins_) {
+            b.clear ();
+        }
+        binned_ = 0;
+        sizes_.clear ();
+        free_histogram_.fill (0U);
+        allocated_bytes_ = 0;
+        free_bytes_ = 0;
+        try {
+            if (compact) {
+                std::array<char, sizeof (signature) - sizeof (prefix)> rest;
+                is.read (rest.data (), static_cast<std::streamsize> (rest.size ()));
+                if (!std::equal (std::begin (rest), std::end (rest),
+                                 std::begin (signature) + prefix.size ())) {
+                    throw bad_metadata ("saved metadata signature is not valid");
+                }
+                this->load_compact (is, base);
+            } else {
+                std::size_t num_allocs;
+                std::memcpy (&num_allocs, prefix.data (), sizeof (num_allocs));
+                this->load_raw (is, base, num_allocs);
+            }
+        } catch (...) {
+            allocs_.clear ();
+            frees_.clear ();
+            regions_.clear ();
+            throw;
+        }
+
+        allocated_bytes_ = accumulate_values (allocs_);
+        free_bytes_ = accumulate_values (frees_);
+
+        // Sorting the free blocks by size and then appending them is much quicker than inserting
+        // them into the index one at a time.
+        std::vector<std::pair<std::size_t, address>> by_size;
+        by_size.reserve (frees_.size ());
+        for (auto const & kvp : frees_) {
+            by_size.emplace_back (kvp.second, kvp.first);
+        }
+        std::sort (std::begin (by_size), std::end (by_size));
+        details::reserve (sizes_, by_size.size ());
+        for (auto const & v : by_size) {
+            sizes_.emplace_hint (std::end (sizes_), v);
+            ++free_histogram_[heap_stats::bucket (v.first)];
+        }
+    }
+
+    // load raw
+    // ~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::load_raw (std::istream & is,
+                                                                       std::uint8_t * base,
+                                                                       std::size_t num_allocs) {
+        // The containers are refilled in place so that they keep their existing storage. Entries
+        // are written in key order so each one is inserted at the end.
+        auto const read_map = [&is, base](container & map, std::size_t size) {
+            map.clear ();
+            address const origin = traits::origin (base);
+            address prev = origin;
+            for (auto n = size; n > 0U; --n) {
+                auto const offset = read<std::ptrdiff_t> (is);
+                auto const v = read<std::size_t> (is);
+                if (!is) {
+                    throw bad_metadata ("saved metadata is truncated");
+                }
+                // The entries hold offsets from the base. Measure each from the end of the one
+                // before so that they are checked in the same way as compact data.
+                auto const delta = static_cast<std::int64_t> (
+                    static_cast<std::uint64_t> (offset) -
+                    static_cast<std::uint64_t> (prev - origin));
+                auto const k = loaded_entry (prev, delta, v, n == size);
+                map.emplace_hint (std::end (map), k, v);
+                prev = k + v;
+            }
+        };
+        read_map (allocs_, num_allocs);
+        read_map (frees_, read<std::size_t> (is));
+        // The blocks tile the storage, so the regions are the runs of contiguous blocks.
+        this->rebuild_regions ();
+    }
+
+    // load compact
+    // ~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    void basic_allocator<Containers, Address, Fit, Storage>::load_compact (std::istream & is,
+                                                                           std::uint8_t * base) {
+        std::array<std::uint8_t, 16> header;
+        is.read (reinterpret_cast<std::istream::char_type *> (header.data ()),
+                 static_cast<std::streamsize> (header.size ()));
+        if (is.gcount () != static_cast<std::streamsize> (header.size ())) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+        if (encoding::get_u64 (header.data ()) != compact_version) {
+            throw bad_metadata ("saved metadata version is not supported");
+        }
+        auto const body_size = encoding::get_u64 (header.data () + 8);
+        if (body_size > std::numeric_limits<std::size_t>::max () - 8U) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+
+        // Read the body and its checksum. The size is not trusted until the checksum matches.
+        std::vector<std::uint8_t> body;
+        if (!encoding::read_bytes (is, body_size + 8U, body)) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+        auto const last = body.data () + body_size;
+        if (encoding::fnv1a (body.data (), static_cast<std::size_t> (body_size)) !=
+            encoding::get_u64 (last)) {
+            throw bad_metadata ("saved metadata checksum does not match");
+        }
+
+        std::uint8_t const * p = body.data ();
+        auto const get = [&p, last]() {
+            std::uint64_t v;
+            if (!encoding::get_varint (p, last, &v)) {
+                throw bad_metadata ("saved metadata is truncated");
+            }
+            return v;
+        };
+        // The containers are refilled in place so that they keep their existing storage. Entries
+        // are written in key order so each one is inserted at the end.
+        auto const decode = [base, &get, &p, last](container & map) {
+            map.clear ();
+            auto const size = get ();
+            // Each entry occupies at least two bytes.
+            if (size > static_cast<std::uint64_t> (last - p) / 2U) {
+                throw bad_metadata ("saved metadata is truncated");
+            }
+            details::reserve (map, static_cast<std::size_t> (size));
+            address prev = traits::origin (base);
+            for (auto n = size; n > 0U; --n) {
+                auto const delta = encoding::unzigzag (get ());
+                auto const v = get ();
+                auto const k = loaded_entry (prev, delta, v, n == size);
+                map.emplace_hint (std::end (map), k, static_cast<std::size_t> (v));
+                prev = k + static_cast<std::size_t> (v);
+            }
+        };
+        decode (allocs_);
+        decode (frees_);
+        decode (regions_);
+    }
+
+    // loaded entry [static]
+    // ~~~~~~~~~~~~
+    template <typename Containers, typename Address, typename Fit, typename Storage>
+    auto basic_allocator<Containers, Address, Fit, Storage>::loaded_entry (address prev,
+                                                                           std::int64_t delta,
+                                                                           std::uint64_t size,
+                                                                           bool first)
+        -> address {
+        if (delta < 0 && !first) {
+            throw bad_metadata ("saved metadata is not in address order");
+        }
+        // Work with the distance from prev as an unsigned value so that nothing can overflow.
+        constexpr auto max = std::uint64_t{std::numeric_limits<std::uintptr_t>::max ()};
+        auto const start = std::uint64_t{traits::to_integer (prev)};
+        auto const distance =
+            delta < 0 ? std::uint64_t{0} - static_cast<std::uint64_t> (delta)
+                      : static_cast<std::uint64_t> (delta);
+        auto const first_byte = delta < 0 ? start - distance : start + distance;
+        if ((delta < 0 ? distance > start : distance > max - start) ||
+            size > max - first_byte || size > std::numeric_limits<std::size_t>::max ()) {
+            throw bad_metadata ("saved metadata entry wraps around the address space");
+        }
+        // The same rule as for storage which is added: data saved by an allocator with wider
+        // addresses or sizes may not fit this one.
+        constexpr auto granule = std::uint64_t{traits::granule};
+        // A forward entry is checked from prev, so its start isn't formed until it is known to
+        // fit. A backward one has already passed the wrap check, which rules out offsets.
+        bool const representable =
+            delta >= 0 ? traits::is_representable (prev, static_cast<std::size_t> (distance + size))
+                       : traits::is_representable (prev + delta, static_cast<std::size_t> (size));
+        if (distance % granule != 0U || size % granule != 0U || !representable) {
+            throw bad_metadata ("saved metadata can't be represented by this allocator");
+        }
+        return prev + delta;
+    }
+
+    extern template class basic_allocator<map_containers>;
+    extern template class basic_allocator<flat_containers>;
+    extern template class basic_allocator<pooled_containers>;
+    extern template class basic_allocator<pooled_containers, heap_offset>;
+    extern template class basic_allocator<pooled_containers, compact_offset<>>;
+    extern template class basic_allocator<pooled_containers, std::uint8_t *, first_fit>;
+    extern template class basic_allocator<pooled_containers, std::uint8_t *, next_fit>;
+
 } // end namespace extalloc
 
 #endif // EXTALLOC_ALLOCATOR_HPP
@@ -0,0 +1,69 @@
+#include <cstdint>
+#include <list>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator.hpp"
+#include "storage.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    /// Builds a heap containing approximately \p num_frees free blocks, each too small to satisfy
+    /// the requests made by the benchmark.
+    void fragment (allocator & alloc, std::size_t num_frees) {
+        std::vector<allocator::address> blocks;
+        blocks.reserve (num_frees * 2U);
+        for (auto ctr = std::size_t{0}; ctr < num_frees * 2U; ++ctr) {
+            blocks.push_back (alloc.allocate (16));
+        }
+        // Free every other block so that none of the holes can merge with their neighbours.
+        for (auto ctr = std::size_t{0}; ctr < blocks.size (); ctr += 2U) {
+            alloc.free (blocks[ctr]);
+        }
+    }
+
+    /// Measures the cost of an allocate/free pair as the number of free blocks grows. None of the
+    /// holes is large enough for the request, so a first-fit search would visit every one of them.
+    void allocate_fragmented (benchmark::State & state) {
+        std::list<std::vector<std::uint8_t>> buffers;
+        allocator alloc{[&buffers](std::size_t size) {
+            buffers.emplace_back (std::max (size, std::size_t{1024 * 1024}));
+            auto & buffer = buffers.back ();
+            return std::pair<std::uint8_t *, std::size_t>{buffer.data (), buffer.size ()};
+        }};
+        fragment (alloc, static_cast<std::size_t> (state.range (0)));
+
+        for (auto _ : state) {
+            auto const ptr = alloc.allocate (32);
+            benchmark::DoNotOptimize (ptr);
+            alloc.free (ptr);
+        }
+        state.SetItemsProcessed (static_cast<std::int64_t> (state.iterations ()) * 2);
+        state.counters["frees"] = static_cast<double> (alloc.num_frees ());
+        state.counters["metadata"] = static_cast<double> (alloc.metadata_footprint ());
+    }
+
+    /// Measures a request which a full heap can't satisfy, so that each one reaches the
+    /// add-storage function. With allocator, the function is held by a std::function; with
+    /// storage_allocator<no_storage> the compiler sees the provider and can inline the call.
+    template <typename Allocator>
+    void allocate_exhausted (benchmark::State & state) {
+        std::vector<std::uint8_t> buffer (4096);
+        Allocator alloc{typename Allocator::add_storage_fn{no_storage{}},
+                        std::make_pair (buffer.data (), buffer.size ())};
+        alloc.allocate (buffer.size ());
+        for (auto _ : state) {
+            auto const ptr = alloc.allocate (16);
+            benchmark::DoNotOptimize (ptr);
+        }
+        state.SetItemsProcessed (static_cast<std::int64_t> (state.iterations ()));
+    }
+
+} // end anonymous namespace
+
+BENCHMARK (allocate_fragmented)->RangeMultiplier (4)->Range (64, 64 * 1024);
+BENCHMARK_TEMPLATE (allocate_exhausted, allocator);
+BENCHMARK_TEMPLATE (allocate_exhausted, storage_allocator<no_storage>);
@@ -0,0 +1,84 @@
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator.hpp"
+#include "buddy_allocator.hpp"
+#include "storage.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    constexpr auto heap_size = std::size_t{16} * 1024U * 1024U;
+
+    /// A basic_allocator managing a single heap.
+    class basic_backend {
+    public:
+        explicit basic_backend (std::vector<std::uint8_t> & buffer)
+                : alloc_{no_storage{}, std::make_pair (buffer.data (), buffer.size ())} {}
+        storage_allocator<no_storage> & alloc () noexcept { return alloc_; }
+
+    private:
+        storage_allocator<no_storage> alloc_;
+    };
+
+    /// A buddy_allocator managing the same heap.
+    class buddy_backend {
+    public:
+        explicit buddy_backend (std::vector<std::uint8_t> & buffer)
+                : alloc_{buffer.data (), buffer.size ()} {}
+        buddy_allocator & alloc () noexcept { return alloc_; }
+
+    private:
+        buddy_allocator alloc_;
+    };
+
+    /// Fills half of a 16 MiB heap with blocks whose sizes are powers of two from 16 to
+    /// state.range(0) bytes, then times the replacement of a randomly chosen block with a new
+    /// one of a random power-of-two size.
+    template <typename Backend>
+    void power_of_two_workload (benchmark::State & state) {
+        std::vector<std::uint8_t> buffer (heap_size);
+        Backend backend{buffer};
+        auto & alloc = backend.alloc ();
+
+        std::mt19937 random;
+        auto max_shift = 4U;
+        while ((std::size_t{1} << max_shift) < static_cast<std::size_t> (state.range (0))) {
+            ++max_shift;
+        }
+        std::uniform_int_distribution<unsigned> shift{4U, max_shift};
+        std::vector<std::uint8_t *> blocks;
+        while (alloc.allocated_space () < heap_size / 2U) {
+            auto const ptr = alloc.allocate (std::size_t{1} << shift (random));
+            if (ptr == nullptr) {
+                break;
+            }
+            blocks.push_back (ptr);
+        }
+
+        for (auto _ : state) {
+            auto & block = blocks[random () % blocks.size ()];
+            alloc.free (block);
+            auto const ptr = alloc.allocate (std::size_t{1} << shift (random));
+            benchmark::DoNotOptimize (ptr);
+            if (ptr != nullptr) {
+                block = ptr;
+            } else {
+                block = blocks.back ();
+                blocks.pop_back ();
+            }
+        }
+        // Each iteration is a free and an allocation.
+        state.SetItemsProcessed (state.iterations () * 2);
+        state.counters["metadata"] = static_cast<double> (alloc.metadata_footprint ());
+        state.counters["frees"] = static_cast<double> (alloc.num_frees ());
+    }
+
+} // end anonymous namespace
+
+BENCHMARK_TEMPLATE (power_of_two_workload, basic_backend)->Arg (256)->Arg (4096)->Arg (65536);
+BENCHMARK_TEMPLATE (power_of_two_workload, buddy_backend)->Arg (256)->Arg (4096)->Arg (65536);
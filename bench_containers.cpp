@@ -0,0 +1,95 @@
+#include <cstdint>
+#include <list>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    constexpr auto max_allocation_size = std::size_t{256};
+    constexpr auto storage_block_size = std::size_t{32768};
+
+    /// A workload modelled on the stress tool: a population of live blocks of random size up to
+    /// 256 bytes is maintained by repeatedly freeing a randomly chosen block and allocating a
+    /// replacement.
+    template <typename Containers>
+    void stress_workload (benchmark::State & state) {
+        using allocator_type = basic_allocator<Containers>;
+
+        std::list<std::vector<std::uint8_t>> buffers;
+        allocator_type alloc{[&buffers](std::size_t size) {
+            buffers.emplace_back (std::max (size, storage_block_size));
+            auto & buffer = buffers.back ();
+            return std::pair<std::uint8_t *, std::size_t>{buffer.data (), buffer.size ()};
+        }};
+
+        std::mt19937 random;
+        auto const num_allocations = static_cast<std::size_t> (state.range (0));
+        std::vector<typename allocator_type::address> blocks;
+        blocks.reserve (num_allocations);
+        while (blocks.size () < num_allocations) {
+            blocks.push_back (alloc.allocate (random () % max_allocation_size));
+        }
+
+        for (auto _ : state) {
+            auto & block = blocks[random () % num_allocations];
+            alloc.free (block);
+            block = alloc.allocate (random () % max_allocation_size);
+            benchmark::DoNotOptimize (block);
+        }
+        state.SetItemsProcessed (static_cast<std::int64_t> (state.iterations ()) * 2);
+        state.counters["allocs"] = static_cast<double> (alloc.num_allocs ());
+        state.counters["frees"] = static_cast<double> (alloc.num_frees ());
+        state.counters["metadata"] = static_cast<double> (alloc.metadata_footprint ());
+    }
+
+    /// The same workload in a single heap, large enough for every block, whose addresses are of
+    /// type Address. Reports the size of the metadata per allocation.
+    template <typename Containers, typename Address>
+    void address_workload (benchmark::State & state) {
+        using allocator_type = basic_allocator<Containers, Address>;
+        using traits = address_traits<Address>;
+
+        auto const num_allocations = static_cast<std::size_t> (state.range (0));
+        std::vector<std::uint8_t> heap (num_allocations * max_allocation_size * 2U);
+        allocator_type alloc{
+            [](std::size_t) { return std::pair<Address, std::size_t>{nullptr, 0}; },
+            std::make_pair (traits::from_pointer (heap.data (), heap.data ()), heap.size ())};
+        alloc.set_base (heap.data ());
+
+        std::mt19937 random;
+        std::vector<Address> blocks;
+        blocks.reserve (num_allocations);
+        while (blocks.size () < num_allocations) {
+            blocks.push_back (alloc.allocate (random () % max_allocation_size));
+        }
+
+        for (auto _ : state) {
+            auto & block = blocks[random () % num_allocations];
+            alloc.free (block);
+            block = alloc.allocate (random () % max_allocation_size);
+            benchmark::DoNotOptimize (block);
+        }
+        state.SetItemsProcessed (static_cast<std::int64_t> (state.iterations ()) * 2);
+        auto const metadata = static_cast<double> (alloc.metadata_footprint ());
+        state.counters["metadata"] = metadata;
+        state.counters["bytes/alloc"] = metadata / static_cast<double> (num_allocations);
+    }
+
+} // end anonymous namespace
+
+BENCHMARK_TEMPLATE (stress_workload, map_containers)->RangeMultiplier (8)->Range (64, 32768);
+BENCHMARK_TEMPLATE (stress_workload, flat_containers)->RangeMultiplier (8)->Range (64, 32768);
+BENCHMARK_TEMPLATE (stress_workload, pooled_containers)->RangeMultiplier (8)->Range (64, 32768);
+
+BENCHMARK_TEMPLATE (address_workload, flat_containers, std::uint8_t *)->Arg (32768);
+BENCHMARK_TEMPLATE (address_workload, flat_containers, compact_offset<>)->Arg (32768);
+BENCHMARK_TEMPLATE (address_workload, flat_containers, compact_offset<16>)->Arg (32768);
+BENCHMARK_TEMPLATE (address_workload, pooled_containers, std::uint8_t *)->Arg (32768);
+BENCHMARK_TEMPLATE (address_workload, pooled_containers, compact_offset<>)->Arg (32768);
+BENCHMARK_TEMPLATE (address_workload, pooled_containers, compact_offset<16>)->Arg (32768);
@@ -0,0 +1,178 @@
+#include <array>
+#include <cstdint>
+#include <random>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    constexpr auto heap_size = std::size_t{16} * 1024U * 1024U;
+    /// The number of operations timed between pauses by allocate_blocks and free_blocks.
+    /// Pausing the timer is expensive so each pause is shared by a batch.
+    constexpr auto batch_size = std::size_t{256};
+
+    /// The request sizes used by the benchmarks.
+    enum class distribution {
+        small,  ///< Uniform over 1-64 bytes.
+        medium, ///< Uniform over 1-1024 bytes.
+        large,  ///< Uniform over 1024-16384 bytes.
+    };
+
+    class request_sizes {
+    public:
+        explicit request_sizes (distribution d) noexcept
+                : dist_{bounds (d).first, bounds (d).second} {}
+        std::size_t operator() (std::mt19937 & random) { return dist_ (random); }
+
+    private:
+        static std::pair<std::size_t, std::size_t> bounds (distribution d) noexcept {
+            switch (d) {
+            case distribution::small: return {1U, 64U};
+            case distribution::medium: return {1U, 1024U};
+            case distribution::large: return {1024U, 16384U};
+            }
+            return {1U, 1U};
+        }
+
+        std::uniform_int_distribution<std::size_t> dist_;
+    };
+
+    /// A single heap of heap_size bytes which is filled with blocks drawn from a size distribution
+    /// until state.range(1) percent of it is allocated. Blocks are then repeatedly replaced so that
+    /// the free space is fragmented as it would be in a long-running program.
+    class heap {
+    public:
+        explicit heap (benchmark::State & state);
+
+        allocator & alloc () noexcept { return alloc_; }
+        std::size_t request_size () { return sizes_ (random_); }
+        /// Returns a randomly chosen live block.
+        allocator::address & pick () { return blocks_[random_ () % blocks_.size ()]; }
+
+        /// Records the throughput of \p ops operations as operations per second, and the size of
+        /// the metadata.
+        void report (benchmark::State & state, std::size_t ops) const;
+
+    private:
+        std::vector<std::uint8_t> buffer_;
+        allocator alloc_;
+        std::mt19937 random_;
+        request_sizes sizes_;
+        std::vector<allocator::address> blocks_;
+    };
+
+    heap::heap (benchmark::State & state)
+            : buffer_ (heap_size)
+            , alloc_{[](std::size_t) {
+                         return std::pair<std::uint8_t *, std::size_t>{nullptr, 0};
+                     },
+                     std::make_pair (buffer_.data (), buffer_.size ())}
+            , sizes_{static_cast<distribution> (state.range (0))} {
+        static std::array<char const *, 3> const names{{"small", "medium", "large"}};
+        state.SetLabel (names[static_cast<std::size_t> (state.range (0))]);
+
+        auto const target = heap_size * static_cast<std::size_t> (state.range (1)) / 100U;
+        while (alloc_.allocated_space () < target) {
+            auto const ptr = alloc_.allocate (this->request_size ());
+            if (ptr == nullptr) {
+                break;
+            }
+            blocks_.push_back (ptr);
+        }
+        for (auto ctr = blocks_.size (); ctr > 0U; --ctr) {
+            auto & block = this->pick ();
+            alloc_.free (block);
+            block = alloc_.allocate (this->request_size ());
+            if (block == nullptr) {
+                block = blocks_.back ();
+                blocks_.pop_back ();
+            }
+        }
+    }
+
+    void heap::report (benchmark::State & state, std::size_t ops) const {
+        state.SetItemsProcessed (static_cast<std::int64_t> (ops));
+        state.counters["allocs"] = static_cast<double> (alloc_.num_allocs ());
+        state.counters["frees"] = static_cast<double> (alloc_.num_frees ());
+        state.counters["metadata"] = static_cast<double> (alloc_.metadata_footprint ());
+    }
+
+
+    /// Times allocate() alone. Each batch of blocks is freed with the timer paused.
+    void allocate_blocks (benchmark::State & state) {
+        heap h{state};
+        std::vector<allocator::address> batch (batch_size);
+        std::size_t ops = 0;
+        for (auto _ : state) {
+            for (auto & ptr : batch) {
+                ptr = h.alloc ().allocate (h.request_size ());
+            }
+            // Only the allocations which succeeded are counted; they are found with the timer
+            // paused.
+            state.PauseTiming ();
+            for (auto const ptr : batch) {
+                if (ptr != nullptr) {
+                    h.alloc ().free (ptr);
+                    ++ops;
+                }
+            }
+            state.ResumeTiming ();
+        }
+        h.report (state, ops);
+    }
+
+    /// Times free() alone. Each batch of blocks is allocated with the timer paused.
+    void free_blocks (benchmark::State & state) {
+        heap h{state};
+        std::vector<allocator::address> batch (batch_size);
+        std::size_t ops = 0;
+        for (auto _ : state) {
+            state.PauseTiming ();
+            for (auto & ptr : batch) {
+                ptr = h.alloc ().allocate (h.request_size ());
+            }
+            state.ResumeTiming ();
+            for (auto const ptr : batch) {
+                if (ptr != nullptr) {
+                    h.alloc ().free (ptr);
+                    ++ops;
+                }
+            }
+        }
+        h.report (state, ops);
+    }
+
+    /// Times realloc() of a randomly chosen block to a new size from the same distribution, so
+    /// the occupancy of the heap stays roughly constant.
+    void realloc_blocks (benchmark::State & state) {
+        heap h{state};
+        for (auto _ : state) {
+            auto & block = h.pick ();
+            auto const ptr = h.alloc ().realloc (block, h.request_size ());
+            if (ptr != nullptr) {
+                block = ptr;
+            }
+            benchmark::DoNotOptimize (ptr);
+        }
+        h.report (state, static_cast<std::size_t> (state.iterations ()));
+    }
+
+    /// Each size distribution at 25%, 50%, and 90% occupancy.
+    void operation_args (benchmark::internal::Benchmark * b) {
+        for (auto const d : {distribution::small, distribution::medium, distribution::large}) {
+            for (auto const occupancy : {25, 50, 90}) {
+                b->Args ({static_cast<int> (d), occupancy});
+            }
+        }
+    }
+
+} // end anonymous namespace
+
+BENCHMARK (allocate_blocks)->Apply (operation_args);
+BENCHMARK (free_blocks)->Apply (operation_args);
+BENCHMARK (realloc_blocks)->Apply (operation_args);
@@ -0,0 +1,96 @@
+#include <cstdint>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <benchmark/benchmark.h>
+
+#include "allocator.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    /// Builds a heap with state.range(0) allocations, a third as many free blocks, and one region.
+    class heap {
+    public:
+        explicit heap (std::size_t num_allocs)
+                : buffer_ (num_allocs * 256U)
+                , alloc_{[](std::size_t) {
+                             return std::pair<std::uint8_t *, std::size_t>{nullptr, 0};
+                         },
+                         std::make_pair (buffer_.data (), buffer_.size ())} {
+            std::mt19937 random;
+            std::vector<allocator::address> blocks;
+            for (auto ctr = std::size_t{0}; ctr < num_allocs * 4U / 3U; ++ctr) {
+                blocks.push_back (alloc_.allocate (random () % 128U + 1U));
+            }
+            for (auto ctr = std::size_t{0}; ctr < blocks.size (); ctr += 4U) {
+                alloc_.free (blocks[ctr]);
+            }
+        }
+
+        std::uint8_t * base () noexcept { return buffer_.data (); }
+        allocator & alloc () noexcept { return alloc_; }
+
+        /// Records the number of blocks saved or loaded per second and the size of the metadata.
+        void report (benchmark::State & state) const {
+            auto const blocks = alloc_.num_allocs () + alloc_.num_frees ();
+            state.SetItemsProcessed (static_cast<std::int64_t> (state.iterations ()) *
+                                     static_cast<std::int64_t> (blocks));
+            state.counters["metadata"] = static_cast<double> (alloc_.metadata_footprint ());
+        }
+
+    private:
+        std::vector<std::uint8_t> buffer_;
+        allocator alloc_;
+    };
+
+    save_format format_arg (benchmark::State & state) {
+        auto const format = static_cast<save_format> (state.range (1));
+        state.SetLabel (format == save_format::raw ? "raw" : "compact");
+        return format;
+    }
+
+    void save (benchmark::State & state) {
+        heap h{static_cast<std::size_t> (state.range (0))};
+        auto const format = format_arg (state);
+        std::size_t bytes = 0;
+        for (auto _ : state) {
+            std::ostringstream os;
+            h.alloc ().save (os, h.base (), format);
+            bytes = os.str ().size ();
+        }
+        h.report (state);
+        state.counters["bytes"] = static_cast<double> (bytes);
+        state.counters["bytes/block"] =
+            static_cast<double> (bytes) /
+            static_cast<double> (h.alloc ().num_allocs () + h.alloc ().num_frees ());
+    }
+
+    void load (benchmark::State & state) {
+        heap h{static_cast<std::size_t> (state.range (0))};
+        auto const format = format_arg (state);
+        std::ostringstream os;
+        h.alloc ().save (os, h.base (), format);
+        auto const saved = os.str ();
+        for (auto _ : state) {
+            std::istringstream is{saved};
+            h.alloc ().load (is, h.base ());
+        }
+        h.report (state);
+        state.counters["bytes"] = static_cast<double> (saved.size ());
+    }
+
+    void persist_args (benchmark::internal::Benchmark * b) {
+        for (auto const format : {save_format::raw, save_format::compact}) {
+            for (auto n = 1024; n <= 256 * 1024; n *= 16) {
+                b->Args ({n, static_cast<int> (format)});
+            }
+        }
+    }
+
+} // end anonymous namespace
+
+BENCHMARK (save)->Apply (persist_args);
+BENCHMARK (load)->Apply (persist_args);
@@ -0,0 +1,609 @@
+#include "buddy_allocator.hpp"
+
+#include <algorithm>
+#include <array>
+#include <cstring>
+#include <iterator>
+#include <limits>
+#include <stdexcept>
+
+#include "encoding.hpp"
+
+namespace extalloc {
+
+    namespace {
+
+        constexpr std::array<char, 8> signature{{'E', 'X', 'T', 'B', 'U', 'D', 'D', 'Y'}};
+        constexpr std::uint64_t version = 1;
+        /// The signature, version, and body size.
+        constexpr std::size_t header_size = 24;
+
+        unsigned log2 (std::size_t n) noexcept {
+            auto result = 0U;
+            while (n >>= 1U) {
+                ++result;
+            }
+            return result;
+        }
+
+        unsigned count_trailing_zeros (std::uint64_t v) noexcept {
+#if defined(__GNUC__) || defined(__clang__)
+            return static_cast<unsigned> (__builtin_ctzll (v));
+#else
+            auto result = 0U;
+            for (; (v & 1U) == 0U; v >>= 1U) {
+                ++result;
+            }
+            return result;
+#endif
+        }
+
+        constexpr std::size_t unit_count (unsigned order) noexcept {
+            return std::size_t{1} << order;
+        }
+
+    } // end anonymous namespace
+
+    namespace details {
+
+        constexpr std::size_t summary_bitmap::npos;
+        constexpr std::size_t summary_bitmap::word_bits;
+
+        // ctor
+        // ~~~~
+        summary_bitmap::summary_bitmap (std::size_t size) {
+            auto words = std::max ((size + word_bits - 1U) / word_bits, std::size_t{1});
+            levels_.emplace_back (words, std::uint64_t{0});
+            while (words > 1U) {
+                words = (words + word_bits - 1U) / word_bits;
+                levels_.emplace_back (words, std::uint64_t{0});
+            }
+        }
+
+        // set
+        // ~~~
+        void summary_bitmap::set (std::size_t pos) noexcept {
+            // A word which was already non-zero is already marked in the level above.
+            for (auto & level : levels_) {
+                auto & word = level[pos / word_bits];
+                auto const was_empty = word == 0U;
+                word |= bit (pos);
+                if (!was_empty) {
+                    break;
+                }
+                pos /= word_bits;
+            }
+        }
+
+        // reset
+        // ~~~~~
+        void summary_bitmap::reset (std::size_t pos) noexcept {
+            for (auto & level : levels_) {
+                auto & word = level[pos / word_bits];
+                word &= ~bit (pos);
+                if (word != 0U) {
+                    break;
+                }
+                pos /= word_bits;
+            }
+        }
+
+        // clear
+        // ~~~~~
+        void summary_bitmap::clear () noexcept {
+            for (auto & level : levels_) {
+                std::fill (std::begin (level), std::end (level), std::uint64_t{0});
+            }
+        }
+
+        // find first
+        // ~~~~~~~~~~
+        std::size_t summary_bitmap::find_first () const noexcept {
+            if (this->none ()) {
+                return npos;
+            }
+            // Descend from the single top word, following the lowest set bit at each level.
+            auto pos = std::size_t{0};
+            for (auto it = levels_.rbegin (), end = levels_.rend (); it != end; ++it) {
+                pos = pos * word_bits + count_trailing_zeros ((*it)[pos]);
+            }
+            return pos;
+        }
+
+        // footprint
+        // ~~~~~~~~~
+        std::size_t summary_bitmap::footprint () const noexcept {
+            auto result = std::size_t{0};
+            for (auto const & level : levels_) {
+                result += level.size () * sizeof (std::uint64_t);
+            }
+            return result;
+        }
+
+    } // end namespace details
+
+    constexpr unsigned buddy_allocator::npos_order;
+
+    // ctor
+    // ~~~~
+    buddy_allocator::buddy_allocator (address base, std::size_t heap_size,
+                                      std::size_t min_block_size)
+            : base_{base}
+            , min_shift_{log2 (min_block_size)}
+            , num_units_{heap_size / std::max (min_block_size, std::size_t{1})} {
+        if (min_block_size == 0U || (min_block_size & (min_block_size - 1U)) != 0U) {
+            throw std::invalid_argument ("min_block_size must be a power of two");
+        }
+        if (num_units_ == 0U) {
+            throw std::invalid_argument ("buddy_allocator heap is smaller than one block");
+        }
+        auto const num_orders = log2 (num_units_) + 1U;
+        frees_.reserve (num_orders);
+        allocs_.reserve (num_orders);
+        for (auto order = 0U; order < num_orders; ++order) {
+            auto const blocks = num_units_ >> order;
+            frees_.emplace_back (blocks);
+            allocs_.emplace_back ((blocks + 63U) / 64U, std::uint64_t{0});
+        }
+        this->rebuild ({});
+    }
+
+    // allocate
+    // ~~~~~~~~
+    auto buddy_allocator::allocate (std::size_t size, std::size_t alignment) -> address {
+        if (alignment == 0U || (alignment & (alignment - 1U)) != 0U) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        auto const order = this->order_for (size, alignment);
+        if (order == npos_order) {
+            return nullptr;
+        }
+        auto const unit = this->take (order);
+        if (unit == details::summary_bitmap::npos) {
+            return nullptr;
+        }
+        this->set_allocated (unit, order, true);
+        ++num_allocs_;
+        allocated_units_ += unit_count (order);
+        return base_ + (unit << min_shift_);
+    }
+
+    // free
+    // ~~~~
+    void buddy_allocator::free (address ptr) {
+        auto const order = this->allocated_order (ptr);
+        if (order == npos_order) {
+            throw no_allocation ();
+        }
+        auto const unit = static_cast<std::size_t> (ptr - base_) >> min_shift_;
+        this->set_allocated (unit, order, false);
+        --num_allocs_;
+        allocated_units_ -= unit_count (order);
+        this->release (unit, order);
+    }
+
+    // realloc
+    // ~~~~~~~
+    auto buddy_allocator::realloc (address ptr, std::size_t new_size, std::size_t alignment)
+        -> address {
+        if (alignment == 0U || (alignment & (alignment - 1U)) != 0U) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        auto const order = this->allocated_order (ptr);
+        if (order == npos_order) {
+            throw no_allocation ();
+        }
+        auto const new_order = this->order_for (new_size, alignment);
+        if (new_order == npos_order) {
+            return nullptr;
+        }
+        auto const unit = static_cast<std::size_t> (ptr - base_) >> min_shift_;
+
+        if (new_order <= order) {
+            // The block is already aligned to its size, which is at least the alignment. Its
+            // upper halves are released, largest first.
+            this->set_allocated (unit, order, false);
+            this->set_allocated (unit, new_order, true);
+            allocated_units_ -= unit_count (order) - unit_count (new_order);
+            for (auto o = order; o > new_order;) {
+                --o;
+                this->release (unit + unit_count (o), o);
+            }
+            return ptr;
+        }
+
+        // The block can grow in place if it is the lower half of each of the larger blocks and
+        // each of their upper halves is free.
+        auto in_place = (unit & (unit_count (new_order) - 1U)) == 0U;
+        for (auto o = order; in_place && o < new_order; ++o) {
+            in_place = this->is_free (unit + unit_count (o), o);
+        }
+        if (in_place) {
+            for (auto o = order; o < new_order; ++o) {
+                this->reset_free (unit + unit_count (o), o);
+            }
+            this->set_allocated (unit, order, false);
+            this->set_allocated (unit, new_order, true);
+            allocated_units_ += unit_count (new_order) - unit_count (order);
+            return ptr;
+        }
+
+        auto const result = this->allocate (new_size, alignment);
+        if (result != nullptr) {
+            std::memcpy (result, ptr, unit_count (order) << min_shift_);
+            this->free (ptr);
+        }
+        return result;
+    }
+
+    // block size
+    // ~~~~~~~~~~
+    std::size_t buddy_allocator::block_size (address ptr) const {
+        auto const order = this->allocated_order (ptr);
+        if (order == npos_order) {
+            throw no_allocation ();
+        }
+        return unit_count (order) << min_shift_;
+    }
+
+    // largest free block
+    // ~~~~~~~~~~~~~~~~~~
+    std::size_t buddy_allocator::largest_free_block () const noexcept {
+        for (auto order = frees_.size (); order > 0U; --order) {
+            if (!frees_[order - 1U].none ()) {
+                return unit_count (static_cast<unsigned> (order - 1U)) << min_shift_;
+            }
+        }
+        return 0;
+    }
+
+    // metadata footprint
+    // ~~~~~~~~~~~~~~~~~~
+    std::size_t buddy_allocator::metadata_footprint () const noexcept {
+        auto result = std::size_t{0};
+        for (auto const & f : frees_) {
+            result += f.footprint ();
+        }
+        for (auto const & a : allocs_) {
+            result += a.size () * sizeof (std::uint64_t);
+        }
+        return result;
+    }
+
+    // order for
+    // ~~~~~~~~~
+    unsigned buddy_allocator::order_for (std::size_t size, std::size_t alignment) const
+        noexcept {
+        if (size > this->heap_size ()) {
+            return npos_order;
+        }
+        // Blocks are aligned relative to the base, so they can be no more strictly aligned than
+        // it is. A null base is taken to be aligned to everything.
+        auto const b = reinterpret_cast<std::uintptr_t> (base_);
+        if (b != 0U && alignment > (b & (~b + 1U))) {
+            return npos_order;
+        }
+        auto const units = (std::max (size, std::size_t{1}) + this->min_block_size () - 1U) >>
+                           min_shift_;
+        auto order = 0U;
+        while (unit_count (order) < units) {
+            ++order;
+        }
+        if (alignment > this->min_block_size ()) {
+            order = std::max (order, log2 (alignment) - min_shift_);
+        }
+        return order < frees_.size () ? order : npos_order;
+    }
+
+    // allocated order
+    // ~~~~~~~~~~~~~~~
+    unsigned buddy_allocator::allocated_order (address ptr) const noexcept {
+        if (ptr < base_ || ptr >= base_ + this->heap_size ()) {
+            return npos_order;
+        }
+        auto const offset = static_cast<std::size_t> (ptr - base_);
+        if ((offset & (this->min_block_size () - 1U)) != 0U) {
+            return npos_order;
+        }
+        auto const unit = offset >> min_shift_;
+        // Only the orders to which the block is aligned need be tried.
+        for (auto order = 0U; order < allocs_.size (); ++order) {
+            if ((unit & (unit_count (order) - 1U)) != 0U ||
+                (unit >> order) >= (num_units_ >> order)) {
+                break;
+            }
+            if (this->is_allocated (unit, order)) {
+                return order;
+            }
+        }
+        return npos_order;
+    }
+
+    // top order
+    // ~~~~~~~~~
+    unsigned buddy_allocator::top_order (std::size_t unit) const noexcept {
+        auto start = std::size_t{0};
+        for (auto order = static_cast<unsigned> (frees_.size ()); order > 0U;) {
+            --order;
+            if ((num_units_ & unit_count (order)) != 0U) {
+                start += unit_count (order);
+                if (unit < start) {
+                    return order;
+                }
+            }
+        }
+        return npos_order;
+    }
+
+    // take
+    // ~~~~
+    std::size_t buddy_allocator::take (unsigned order) noexcept {
+        for (auto o = order; o < frees_.size (); ++o) {
+            auto const pos = frees_[o].find_first ();
+            if (pos != details::summary_bitmap::npos) {
+                auto const unit = pos << o;
+                this->reset_free (unit, o);
+                // Split the block, freeing the upper half each time.
+                while (o > order) {
+                    --o;
+                    this->set_free (unit + unit_count (o), o);
+                }
+                return unit;
+            }
+        }
+        return details::summary_bitmap::npos;
+    }
+
+    // release
+    // ~~~~~~~
+    void buddy_allocator::release (std::size_t unit, unsigned order) noexcept {
+        // The buddy of a top-level block is never free at the same order so merging stops
+        // there.
+        for (; order + 1U < frees_.size (); ++order) {
+            auto const buddy = unit ^ unit_count (order);
+            if (!this->is_free (buddy, order)) {
+                break;
+            }
+            this->reset_free (buddy, order);
+            unit &= ~unit_count (order);
+        }
+        this->set_free (unit, order);
+    }
+
+    // set free
+    // ~~~~~~~~
+    void buddy_allocator::set_free (std::size_t unit, unsigned order) noexcept {
+        frees_[order].set (unit >> order);
+        ++num_frees_;
+    }
+
+    // reset free
+    // ~~~~~~~~~~
+    void buddy_allocator::reset_free (std::size_t unit, unsigned order) noexcept {
+        frees_[order].reset (unit >> order);
+        --num_frees_;
+    }
+
+    // set allocated
+    // ~~~~~~~~~~~~~
+    void buddy_allocator::set_allocated (std::size_t unit, unsigned order, bool value) noexcept {
+        auto const pos = unit >> order;
+        auto & word = allocs_[order][pos / 64U];
+        auto const mask = std::uint64_t{1} << (pos % 64U);
+        word = value ? word | mask : word & ~mask;
+    }
+
+    // is allocated
+    // ~~~~~~~~~~~~
+    bool buddy_allocator::is_allocated (std::size_t unit, unsigned order) const noexcept {
+        auto const pos = unit >> order;
+        return (allocs_[order][pos / 64U] & (std::uint64_t{1} << (pos % 64U))) != 0U;
+    }
+
+    // block at
+    // ~~~~~~~~
+    auto buddy_allocator::block_at (std::size_t unit) const noexcept
+        -> std::pair<unsigned, bool> {
+        for (auto order = 0U; order < frees_.size (); ++order) {
+            if ((unit & (unit_count (order) - 1U)) != 0U ||
+                (unit >> order) >= (num_units_ >> order)) {
+                break;
+            }
+            if (this->is_allocated (unit, order)) {
+                return {order, true};
+            }
+            if (this->is_free (unit, order)) {
+                return {order, false};
+            }
+        }
+        return {npos_order, false};
+    }
+
+    // rebuild
+    // ~~~~~~~
+    void buddy_allocator::rebuild (std::vector<std::pair<std::size_t, unsigned>> const & blocks) {
+        for (auto & f : frees_) {
+            f.clear ();
+        }
+        for (auto & a : allocs_) {
+            std::fill (std::begin (a), std::end (a), std::uint64_t{0});
+        }
+        num_allocs_ = 0;
+        num_frees_ = 0;
+        allocated_units_ = 0;
+
+        // Each gap between allocations is covered by the largest blocks which fit it. None of
+        // these can have a free buddy: the two would have formed a larger block.
+        auto const fill = [this](std::size_t first, std::size_t last) {
+            while (first < last) {
+                auto order = this->top_order (first);
+                if (first != 0U) {
+                    order = std::min (order, count_trailing_zeros (first));
+                }
+                while (first + unit_count (order) > last) {
+                    --order;
+                }
+                this->set_free (first, order);
+                first += unit_count (order);
+            }
+        };
+        auto prev = std::size_t{0};
+        for (auto const & block : blocks) {
+            fill (prev, block.first);
+            this->set_allocated (block.first, block.second, true);
+            ++num_allocs_;
+            allocated_units_ += unit_count (block.second);
+            prev = block.first + unit_count (block.second);
+        }
+        fill (prev, num_units_);
+    }
+
+    // save
+    // ~~~~
+    std::ostream & buddy_allocator::save (std::ostream & os) const {
+        std::vector<std::uint8_t> out (std::begin (signature), std::end (signature));
+        encoding::put_u64 (out, version);
+        encoding::put_u64 (out, 0U); // The body size is filled in below.
+
+        encoding::put_varint (out, this->heap_size ());
+        encoding::put_varint (out, this->min_block_size ());
+        encoding::put_varint (out, num_allocs_);
+        // Each allocation is recorded as the number of minimum blocks from the end of the
+        // previous one, and its order. The blocks cover the heap so walking it visits each once.
+        auto prev = std::size_t{0};
+        for (auto unit = std::size_t{0}; unit < num_units_;) {
+            auto const block = this->block_at (unit);
+            if (block.second) {
+                encoding::put_varint (out, unit - prev);
+                encoding::put_varint (out, block.first);
+                prev = unit + unit_count (block.first);
+            }
+            unit += unit_count (block.first);
+        }
+
+        auto const body_size = out.size () - header_size;
+        std::vector<std::uint8_t> size_bytes;
+        encoding::put_u64 (size_bytes, body_size);
+        std::copy (std::begin (size_bytes), std::end (size_bytes),
+                   std::begin (out) + (header_size - size_bytes.size ()));
+        encoding::put_u64 (out, encoding::fnv1a (out.data () + header_size, body_size));
+        os.write (reinterpret_cast<std::ostream::char_type const *> (out.data ()),
+                  static_cast<std::streamsize> (out.size ()));
+        return os;
+    }
+
+    // load
+    // ~~~~
+    void buddy_allocator::load (std::istream & is) {
+        std::array<std::uint8_t, header_size> header;
+        is.read (reinterpret_cast<std::istream::char_type *> (header.data ()),
+                 static_cast<std::streamsize> (header.size ()));
+        if (is.gcount () != static_cast<std::streamsize> (header.size ())) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+        if (!std::equal (std::begin (signature), std::end (signature), std::begin (header),
+                         [](char c, std::uint8_t b) {
+                             return static_cast<std::uint8_t> (c) == b;
+                         })) {
+            throw bad_metadata ("saved metadata signature is not valid");
+        }
+        if (encoding::get_u64 (header.data () + signature.size ()) != version) {
+            throw bad_metadata ("saved metadata version is not supported");
+        }
+        auto const body_size = encoding::get_u64 (header.data () + signature.size () + 8U);
+        if (body_size > std::numeric_limits<std::size_t>::max () - 8U) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+
+        // Read the body and its checksum. The size is not trusted until the checksum matches.
+        std::vector<std::uint8_t> body;
+        if (!encoding::read_bytes (is, body_size + 8U, body)) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+        auto const last = body.data () + body_size;
+        if (encoding::fnv1a (body.data (), static_cast<std::size_t> (body_size)) !=
+            encoding::get_u64 (last)) {
+            throw bad_metadata ("saved metadata checksum does not match");
+        }
+
+        std::uint8_t const * p = body.data ();
+        auto const get = [&p, last]() {
+            std::uint64_t v;
+            if (!encoding::get_varint (p, last, &v)) {
+                throw bad_metadata ("saved metadata is truncated");
+            }
+            return v;
+        };
+        if (get () != this->heap_size () || get () != this->min_block_size ()) {
+            throw bad_metadata ("saved metadata describes a different heap");
+        }
+        auto const size = get ();
+        // Each block occupies at least two bytes.
+        if (size > static_cast<std::uint64_t> (last - p) / 2U) {
+            throw bad_metadata ("saved metadata is truncated");
+        }
+
+        std::vector<std::pair<std::size_t, unsigned>> blocks;
+        blocks.reserve (static_cast<std::size_t> (size));
+        auto prev = std::size_t{0};
+        for (auto n = size; n > 0U; --n) {
+            auto const gap = get ();
+            auto const order = get ();
+            if (gap > num_units_ - prev || order >= frees_.size ()) {
+                throw bad_metadata ("saved metadata block is not valid");
+            }
+            auto const unit = prev + static_cast<std::size_t> (gap);
+            auto const o = static_cast<unsigned> (order);
+            // The block must be aligned to its size and lie within a single top-level block.
+            auto const top = this->top_order (unit);
+            if ((unit & (unit_count (o) - 1U)) != 0U || top == npos_order || o > top) {
+                throw bad_metadata ("saved metadata block is not valid");
+            }
+            blocks.emplace_back (unit, o);
+            prev = unit + unit_count (o);
+        }
+        this->rebuild (blocks);
+    }
+
+    // check
+    // ~~~~~
+    bool buddy_allocator::check () const {
+        std::size_t allocs = 0;
+        std::size_t frees = 0;
+        std::size_t allocated = 0;
+        auto unit = std::size_t{0};
+        while (unit < num_units_) {
+            auto const block = this->block_at (unit);
+            if (block.first == npos_order) {
+                return false; // A gap.
+            }
+            if (block.second) {
+                ++allocs;
+                allocated += unit_count (block.first);
+            } else {
+                ++frees;
+                auto const buddy = unit ^ unit_count (block.first);
+                if (this->is_free (buddy, block.first)) {
+                    return false; // Two free buddies which should have been merged.
+                }
+            }
+            unit += unit_count (block.first);
+        }
+        if (unit != num_units_ || allocs != num_allocs_ || frees != num_frees_ ||
+            allocated != allocated_units_) {
+            return false;
+        }
+
+        // Any bit which was not visited belongs to a block which overlaps another.
+        auto bits = std::size_t{0};
+        for (auto order = 0U; order < frees_.size (); ++order) {
+            for (auto pos = std::size_t{0}, end = num_units_ >> order; pos < end; ++pos) {
+                if (frees_[order].test (pos) || this->is_allocated (pos << order, order)) {
+                    ++bits;
+                }
+            }
+        }
+        return bits == allocs + frees;
+    }
+
+} // end namespace extalloc
@@ -0,0 +1,193 @@
+#ifndef EXTALLOC_BUDDY_ALLOCATOR_HPP
+#define EXTALLOC_BUDDY_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <ostream>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
+
+namespace extalloc {
+
+    namespace details {
+
+        /// A fixed-size set of bits which can find its lowest set bit in O(log n) time. Above the
+        /// bits themselves are levels of summary words: each bit of a summary word is set if the
+        /// corresponding word of the level below is non-zero. The top level is a single word.
+        class summary_bitmap {
+        public:
+            static constexpr std::size_t npos = ~std::size_t{0};
+
+            explicit summary_bitmap (std::size_t size = 0);
+
+            bool test (std::size_t pos) const noexcept {
+                return (levels_.front ()[pos / word_bits] & bit (pos)) != 0U;
+            }
+            void set (std::size_t pos) noexcept;
+            void reset (std::size_t pos) noexcept;
+            /// Clears every bit.
+            void clear () noexcept;
+
+            /// Returns the position of the lowest set bit or npos if none is set.
+            std::size_t find_first () const noexcept;
+            bool none () const noexcept { return levels_.back ().front () == 0U; }
+
+            /// The number of bytes used by the bits and their summaries.
+            std::size_t footprint () const noexcept;
+
+        private:
+            static constexpr std::size_t word_bits = 64;
+            static constexpr std::uint64_t bit (std::size_t pos) noexcept {
+                return std::uint64_t{1} << (pos % word_bits);
+            }
+
+            /// levels_[0] holds the bits. Each subsequent level summarizes the one before.
+            std::vector<std::vector<std::uint64_t>> levels_;
+        };
+
+    } // end namespace details
+
+    /// A binary buddy allocator for heaps which mostly serve blocks whose sizes are powers of
+    /// two. Every block is a power-of-two multiple of the minimum block size and is aligned to
+    /// its own size relative to the base of the heap. A request is rounded up to the next such
+    /// size, a larger free block is split in half as often as needed to produce it, and a freed
+    /// block is merged with its buddy, the other half of the block from which it was split,
+    /// for as long as the buddy is also free. Both take O(log n) time for a heap of n minimum
+    /// blocks, with no search of the free space.
+    ///
+    /// As with basic_allocator, the metadata is kept outside the heap. It is a bitmap for each
+    /// order (block size) recording which of that order's blocks are free, with summary words
+    /// above it so that the lowest free block is found without a scan, and a second bitmap per
+    /// order recording which are allocated. A heap whose size is not a power of two is divided
+    /// into one top-level block for each set bit of its size, largest first.
+    class buddy_allocator {
+    public:
+        using address = std::uint8_t *;
+
+        /// \param base  The address of the heap.
+        /// \param heap_size  The number of bytes at \p base. Any part of the last minimum block
+        ///   which is incomplete is not used.
+        /// \param min_block_size  The size of the smallest block. Must be a power of two.
+        /// \throws std::invalid_argument  If \p min_block_size is not a power of two or the heap
+        ///   is smaller than one block.
+        buddy_allocator (address base, std::size_t heap_size, std::size_t min_block_size = 16);
+        buddy_allocator (buddy_allocator const &) = delete;
+        buddy_allocator (buddy_allocator &&) noexcept = default;
+
+        ~buddy_allocator () noexcept = default;
+
+        buddy_allocator & operator= (buddy_allocator const &) = delete;
+        buddy_allocator & operator= (buddy_allocator &&) noexcept = default;
+
+        /// Allocates a block of at least \p size bytes.
+        ///
+        /// \param size  The number of bytes required.
+        /// \param alignment  The required alignment of the block. Must be a power of two. Blocks
+        ///   larger than the alignment are used if necessary to achieve it, but no block is
+        ///   more strictly aligned than the base of the heap.
+        /// \returns  The address of the new block or nullptr if there is no free block large
+        ///   enough.
+        address allocate (std::size_t size, std::size_t alignment = 1);
+        /// \throws no_allocation  If \p ptr is not the address of an allocated block.
+        void free (address ptr);
+        /// Changes the size of the block at \p ptr. A block which shrinks releases its upper
+        /// halves; one which grows absorbs its buddies if they are free. Otherwise it is moved.
+        ///
+        /// \returns  The address of the resized block or nullptr if it could not be grown, in
+        ///   which case the original block is untouched.
+        /// \throws no_allocation  If \p ptr is not the address of an allocated block.
+        address realloc (address ptr, std::size_t new_size, std::size_t alignment = 1);
+
+        /// Writes the allocated blocks to \p os. They are recorded as offsets from the base of
+        /// the heap, which may be at a different address when they are loaded.
+        std::ostream & save (std::ostream & os) const;
+        /// Replaces the allocator's metadata with that read from \p is. The free blocks are
+        /// rebuilt from the gaps between the allocated blocks.
+        ///
+        /// \throws bad_metadata  If the data is truncated, fails its checksum, was written by an
+        ///   unknown version, or describes a heap with a different size or minimum block size.
+        void load (std::istream & is);
+
+        /// Checks that the bitmaps are consistent: that no two blocks overlap, that the blocks
+        /// cover the heap, and that no free block has a free buddy.
+        bool check () const;
+
+        address base () const noexcept { return base_; }
+        /// The number of bytes managed by the allocator.
+        std::size_t heap_size () const noexcept { return num_units_ << min_shift_; }
+        std::size_t min_block_size () const noexcept { return std::size_t{1} << min_shift_; }
+        /// The size of the block at \p ptr.
+        ///
+        /// \throws no_allocation  If \p ptr is not the address of an allocated block.
+        std::size_t block_size (address ptr) const;
+
+        std::size_t num_allocs () const noexcept { return num_allocs_; }
+        std::size_t num_frees () const noexcept { return num_frees_; }
+        /// The total size of the allocated blocks. This includes the space by which requests
+        /// were rounded up.
+        std::size_t allocated_space () const noexcept {
+            return allocated_units_ << min_shift_;
+        }
+        std::size_t free_space () const noexcept {
+            return this->heap_size () - this->allocated_space ();
+        }
+        std::size_t largest_free_block () const noexcept;
+        /// The number of bytes used by the bitmaps.
+        std::size_t metadata_footprint () const noexcept;
+
+    private:
+        static constexpr unsigned npos_order = ~0U;
+
+        /// Returns the order of the smallest block which is at least \p size bytes and is
+        /// aligned to \p alignment, or npos_order if there is none.
+        unsigned order_for (std::size_t size, std::size_t alignment) const noexcept;
+        /// Returns the order of the allocated block at \p ptr or npos_order if there is none.
+        unsigned allocated_order (address ptr) const noexcept;
+        /// Returns the order of the top-level block which contains the minimum block \p unit.
+        unsigned top_order (std::size_t unit) const noexcept;
+
+        /// Removes a free block of \p order or greater, splitting it down to \p order.
+        /// \returns  The first minimum block of the result or npos if there is none.
+        std::size_t take (unsigned order) noexcept;
+        /// Frees the block of \p order starting at minimum block \p unit, merging it with its
+        /// buddies.
+        void release (std::size_t unit, unsigned order) noexcept;
+
+        void set_free (std::size_t unit, unsigned order) noexcept;
+        void reset_free (std::size_t unit, unsigned order) noexcept;
+        /// True if the block of \p order starting at minimum block \p unit lies within the heap
+        /// and is free.
+        bool is_free (std::size_t unit, unsigned order) const noexcept {
+            return (unit >> order) < (num_units_ >> order) && frees_[order].test (unit >> order);
+        }
+        void set_allocated (std::size_t unit, unsigned order, bool value) noexcept;
+        bool is_allocated (std::size_t unit, unsigned order) const noexcept;
+        /// Returns the order of the block which starts at minimum block \p unit, and true if it
+        /// is allocated. The order is npos_order if no block starts there.
+        std::pair<unsigned, bool> block_at (std::size_t unit) const noexcept;
+
+        /// Rebuilds the bitmaps from the allocated blocks \p blocks, each a first minimum block
+        /// and order, in address order.
+        void rebuild (std::vector<std::pair<std::size_t, unsigned>> const & blocks);
+
+        address base_;
+        unsigned min_shift_;
+        /// The number of minimum blocks in the heap.
+        std::size_t num_units_;
+        /// For each order, the free blocks of that size.
+        std::vector<details::summary_bitmap> frees_;
+        /// For each order, a bit for each block of that size which is set if it is allocated.
+        std::vector<std::vector<std::uint64_t>> allocs_;
+
+        std::size_t num_allocs_ = 0;
+        std::size_t num_frees_ = 0;
+        /// The number of minimum blocks which are allocated.
+        std::size_t allocated_units_ = 0;
+    };
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_BUDDY_ALLOCATOR_HPP
@@ -0,0 +1,222 @@
+#include "cached_allocator.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <iterator>
+#include <mutex>
+#include <numeric>
+#include <stdexcept>
+
+namespace extalloc {
+
+    /// The state shared by all of the threads using a cached_allocator. A thread's cache holds a
+    /// reference to it so that the cache can always be flushed, even if the cached_allocator has
+    /// been destroyed.
+    class cached_allocator::heap {
+    public:
+        heap (add_storage_fn const & as, size_classes const & classes)
+                : alloc{as, std::make_pair (nullptr, std::size_t{0}), classes} {}
+
+        mutable std::mutex mutex;
+        allocator alloc;
+
+        std::atomic<std::uint64_t> hits{0};
+        std::atomic<std::uint64_t> misses{0};
+    };
+
+    class cached_allocator::thread_cache {
+    public:
+        explicit thread_cache (std::shared_ptr<cached_allocator::heap> h)
+                : heap{std::move (h)}
+                , bins (heap->alloc.classes ().bounds.size ()) {}
+        thread_cache (thread_cache const &) = delete;
+        thread_cache & operator= (thread_cache const &) = delete;
+
+        ~thread_cache () noexcept {
+            std::lock_guard<std::mutex> const lock{heap->mutex};
+            for (auto & b : bins) {
+                this->release (b, b.size ());
+            }
+            this->publish ();
+        }
+
+        /// Returns the first \p count blocks of \p b to the heap. The heap lock must be held.
+        void release (std::vector<address> & b, std::size_t count) {
+            auto const last = std::begin (b) + static_cast<std::ptrdiff_t> (count);
+            for (auto it = std::begin (b); it != last; ++it) {
+                heap->alloc.free (*it);
+            }
+            b.erase (std::begin (b), last);
+        }
+        /// Adds this thread's counts to the shared statistics.
+        void publish () noexcept {
+            heap->hits.fetch_add (hits, std::memory_order_relaxed);
+            heap->misses.fetch_add (misses, std::memory_order_relaxed);
+            hits = 0;
+            misses = 0;
+        }
+
+        std::shared_ptr<cached_allocator::heap> const heap;
+        /// The cached blocks of each size class. The most recently freed block is at the back.
+        std::vector<std::vector<address>> bins;
+        std::uint64_t hits = 0;
+        std::uint64_t misses = 0;
+    };
+
+    // ctor
+    // ~~~~
+    cached_allocator::cached_allocator (add_storage_fn const & as, size_classes const & classes)
+            : heap_{std::make_shared<heap> (as, classes)} {}
+
+    // dtor
+    // ~~~~
+    cached_allocator::~cached_allocator () noexcept {
+        auto & caches = thread_caches ();
+        caches.erase (std::remove_if (std::begin (caches), std::end (caches),
+                                      [this](std::unique_ptr<thread_cache> const & c) {
+                                          return c->heap == heap_;
+                                      }),
+                      std::end (caches));
+    }
+
+    // thread caches [static]
+    // ~~~~~~~~~~~~~
+    auto cached_allocator::thread_caches () -> std::vector<std::unique_ptr<thread_cache>> & {
+        thread_local std::vector<std::unique_ptr<thread_cache>> caches;
+        return caches;
+    }
+
+    // cache
+    // ~~~~~
+    auto cached_allocator::cache () const -> thread_cache & {
+        auto & caches = thread_caches ();
+        auto const pos = std::find_if (
+            std::begin (caches), std::end (caches),
+            [this](std::unique_ptr<thread_cache> const & c) { return c->heap == heap_; });
+        if (pos != std::end (caches)) {
+            return **pos;
+        }
+        caches.emplace_back (new thread_cache (heap_));
+        auto & result = *caches.back ();
+        for (auto & b : result.bins) {
+            b.reserve (heap_->alloc.classes ().capacity);
+        }
+        return result;
+    }
+
+    // class index
+    // ~~~~~~~~~~~
+    std::size_t cached_allocator::class_index (std::size_t size) const noexcept {
+        auto const & bounds = heap_->alloc.classes ().bounds;
+        return static_cast<std::size_t> (
+            std::lower_bound (std::begin (bounds), std::end (bounds), size) - std::begin (bounds));
+    }
+
+    // allocate
+    // ~~~~~~~~
+    auto cached_allocator::allocate (std::size_t size, std::size_t alignment) -> address {
+        if (alignment == 0U || (alignment & (alignment - 1U)) != 0U) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        thread_cache & c = this->cache ();
+        auto const bin = this->class_index (std::max (size, std::size_t{1}));
+        if (bin < c.bins.size ()) {
+            auto & b = c.bins[bin];
+            if (!b.empty () &&
+                (reinterpret_cast<std::uintptr_t> (b.back ()) & (alignment - 1U)) == 0U) {
+                address const result = b.back ();
+                b.pop_back ();
+                ++c.hits;
+                return result;
+            }
+            ++c.misses;
+        }
+
+        std::lock_guard<std::mutex> const lock{heap_->mutex};
+        c.publish ();
+        return heap_->alloc.allocate (size, alignment);
+    }
+
+    // free
+    // ~~~~
+    void cached_allocator::free (address ptr, std::size_t size) {
+        thread_cache & c = this->cache ();
+        auto const bin = this->class_index (std::max (size, std::size_t{1}));
+        auto const capacity = heap_->alloc.classes ().capacity;
+        if (bin < c.bins.size () && capacity > 0U) {
+            auto & b = c.bins[bin];
+            if (b.size () >= capacity) {
+                // The cache is full: return the older half of its blocks to the heap in one go.
+                std::lock_guard<std::mutex> const lock{heap_->mutex};
+                c.release (b, (capacity + 1U) / 2U);
+                c.publish ();
+            }
+            b.push_back (ptr);
+            return;
+        }
+
+        std::lock_guard<std::mutex> const lock{heap_->mutex};
+        heap_->alloc.free (ptr);
+    }
+
+    // realloc
+    // ~~~~~~~
+    auto cached_allocator::realloc (address ptr, std::size_t new_size, std::size_t alignment)
+        -> address {
+        std::lock_guard<std::mutex> const lock{heap_->mutex};
+        // free() picks a bin from the size it is given, so shrinking the block to a cacheable
+        // size could later put it in a class larger than it is. A block which is shrunk to a
+        // size above the largest class is never cached, so may be resized freely.
+        auto const cacheable = this->class_index (std::max (new_size, std::size_t{1})) <
+                               heap_->alloc.classes ().bounds.size ();
+        if (cacheable && new_size <= heap_->alloc.block_size (ptr) &&
+            (reinterpret_cast<std::uintptr_t> (ptr) & (alignment - 1U)) == 0U) {
+            return ptr;
+        }
+        return heap_->alloc.realloc (ptr, new_size, alignment);
+    }
+
+    // flush
+    // ~~~~~
+    void cached_allocator::flush () {
+        thread_cache & c = this->cache ();
+        std::lock_guard<std::mutex> const lock{heap_->mutex};
+        for (auto & b : c.bins) {
+            c.release (b, b.size ());
+        }
+        c.publish ();
+    }
+
+    // num cached
+    // ~~~~~~~~~~
+    std::size_t cached_allocator::num_cached () const {
+        auto const & bins = this->cache ().bins;
+        return std::accumulate (
+            std::begin (bins), std::end (bins), std::size_t{0},
+            [](std::size_t n, std::vector<address> const & b) { return n + b.size (); });
+    }
+
+    // stats
+    // ~~~~~
+    auto cached_allocator::stats () const noexcept -> statistics {
+        statistics result;
+        result.hits = heap_->hits.load (std::memory_order_relaxed);
+        result.misses = heap_->misses.load (std::memory_order_relaxed);
+        return result;
+    }
+
+    // check
+    // ~~~~~
+    bool cached_allocator::check () const {
+        std::lock_guard<std::mutex> const lock{heap_->mutex};
+        return heap_->alloc.check ();
+    }
+
+    // num allocs
+    // ~~~~~~~~~~
+    std::size_t cached_allocator::num_allocs () const {
+        std::lock_guard<std::mutex> const lock{heap_->mutex};
+        return heap_->alloc.num_allocs ();
+    }
+
+} // end namespace extalloc
@@ -0,0 +1,102 @@
+#ifndef EXTALLOC_CACHED_ALLOCATOR_HPP
+#define EXTALLOC_CACHED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "allocator.hpp"
+
+namespace extalloc {
+
+    /// A single allocator shared by many threads, with a per-thread cache of recently freed
+    /// blocks in front of it. The cache holds up to classes.capacity blocks of each size class.
+    /// A request which can be served from the calling thread's cache does not take the heap
+    /// lock.
+    ///
+    /// Blocks held in a cache remain allocated as far as the shared allocator is concerned. They
+    /// are returned to it with allocator::free(), in batches, when a class's cache is full, when
+    /// flush() is called, or when the thread exits.
+    class cached_allocator {
+    public:
+        using address = allocator::address;
+        using add_storage_fn = allocator::add_storage_fn;
+        using size_classes = allocator::size_classes;
+
+        struct statistics {
+            /// The number of allocations served from a thread cache.
+            std::uint64_t hits = 0;
+            /// The number of allocations of a cacheable size which went to the shared heap.
+            std::uint64_t misses = 0;
+
+            double hit_rate () const noexcept {
+                auto const total = hits + misses;
+                return total == 0U ? 0.0
+                                   : static_cast<double> (hits) / static_cast<double> (total);
+            }
+        };
+
+        /// \param as  A function with signature compatible with `std::pair<address,
+        /// size_t>(std::size_t)` which will be called if the shared allocator cannot satisfy a
+        /// request. It is called with the heap lock held.
+        /// \param classes  The size classes which are cached and the maximum number of blocks of
+        /// each class that a thread may hold.
+        cached_allocator (add_storage_fn const & as, size_classes const & classes);
+        cached_allocator (cached_allocator const &) = delete;
+        cached_allocator (cached_allocator &&) = delete;
+
+        /// Returns the calling thread's cached blocks to the heap. Caches belonging to other
+        /// threads are released when those threads exit.
+        ~cached_allocator () noexcept;
+
+        cached_allocator & operator= (cached_allocator const &) = delete;
+        cached_allocator & operator= (cached_allocator &&) = delete;
+
+        /// Allocates a block of at least \p size bytes. Requests no larger than the largest size
+        /// class are rounded up to the size of their class.
+        address allocate (std::size_t size, std::size_t alignment = 1);
+        /// Frees a block.
+        ///
+        /// \param ptr  The address of an existing allocation.
+        /// \param size  The size that was requested when the block was allocated or any size to
+        ///   which it has since been resized. It selects the cache bin without taking the heap
+        ///   lock to look up the block.
+        void free (address ptr, std::size_t size);
+        /// Resizes a block. This always takes the heap lock. A block is never shrunk to a
+        /// cached size: it stays at least as large as any size requested for it, so that any of
+        /// those sizes may be passed to free() without caching the block in a class which it is
+        /// too small to serve.
+        address realloc (address ptr, std::size_t new_size, std::size_t alignment = 1);
+
+        /// Returns all of the calling thread's cached blocks to the heap.
+        void flush ();
+        /// The number of blocks held in the calling thread's cache.
+        std::size_t num_cached () const;
+
+        /// Cache hits and misses across all threads. A thread's counts are added to the totals
+        /// whenever it takes the heap lock and when its cache is flushed.
+        statistics stats () const noexcept;
+
+        bool check () const;
+        /// The number of allocations in the shared allocator, including blocks held in caches.
+        std::size_t num_allocs () const;
+
+    private:
+        class heap;
+        class thread_cache;
+
+        /// The calling thread's caches, one for each cached_allocator that it has used.
+        static std::vector<std::unique_ptr<thread_cache>> & thread_caches ();
+        /// Returns the calling thread's cache for this allocator, creating it if necessary.
+        thread_cache & cache () const;
+        /// Returns the index of the size class for a request of \p size bytes or the number of
+        /// classes if it is too large to be cached.
+        std::size_t class_index (std::size_t size) const noexcept;
+
+        std::shared_ptr<heap> heap_;
+    };
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_CACHED_ALLOCATOR_HPP
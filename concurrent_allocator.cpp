@@ -0,0 +1,252 @@
+#include "concurrent_allocator.hpp"
+
+#include <algorithm>
+#include <cstring>
+#include <thread>
+
+namespace extalloc {
+
+    constexpr std::size_t concurrent_allocator::min_block_size;
+
+    class concurrent_allocator::arena {
+    public:
+        arena (concurrent_allocator & owner, std::size_t index, size_classes const & classes)
+                : alloc{[&owner, index](std::size_t size) {
+                            return owner.add_storage (index, size);
+                        },
+                        std::make_pair (nullptr, std::size_t{0}), classes} {}
+
+        std::mutex mutex;
+        allocator alloc;
+        /// The head of a stack of blocks freed by threads using other arenas. Each block holds
+        /// the address of the next in its first bytes.
+        std::atomic<address> remote{nullptr};
+    };
+
+    // ctor
+    // ~~~~
+    concurrent_allocator::concurrent_allocator (add_storage_fn const & as, std::size_t num_arenas,
+                                                size_classes const & classes,
+                                                std::size_t max_regions)
+            : add_storage_{as}
+            , regions_{new region[max_regions] ()}
+            , max_regions_{max_regions} {
+        if (num_arenas == 0U) {
+            num_arenas =
+                std::max (std::size_t{std::thread::hardware_concurrency ()}, std::size_t{1});
+        }
+        arenas_.reserve (num_arenas);
+        for (auto index = std::size_t{0}; index < num_arenas; ++index) {
+            arenas_.emplace_back (new arena (*this, index, classes));
+        }
+    }
+
+    // dtor
+    // ~~~~
+    concurrent_allocator::~concurrent_allocator () noexcept = default;
+
+    // this arena
+    // ~~~~~~~~~~
+    std::size_t concurrent_allocator::this_arena () const noexcept {
+        // Threads are numbered in the order in which they first use any concurrent_allocator and
+        // are then dealt out to the arenas in turn.
+        static std::atomic<std::size_t> next_ordinal{0};
+        thread_local std::size_t const ordinal =
+            next_ordinal.fetch_add (1U, std::memory_order_relaxed);
+        return ordinal % arenas_.size ();
+    }
+
+    // owner
+    // ~~~~~
+    std::size_t concurrent_allocator::owner (address ptr) const {
+        constexpr auto none = ~std::size_t{0};
+        for (;;) {
+            auto const seq = regions_seq_.load (std::memory_order_acquire);
+            if ((seq & 1U) != 0U) {
+                std::this_thread::yield ();
+                continue;
+            }
+            // Binary search for the last region which starts at or below ptr. Values read while
+            // an entry is being inserted may be inconsistent, but the result is then discarded.
+            auto low = std::size_t{0};
+            auto high = std::min (num_regions_.load (std::memory_order_relaxed), max_regions_);
+            while (low < high) {
+                auto const mid = low + (high - low) / 2U;
+                if (regions_[mid].first.load (std::memory_order_relaxed) <= ptr) {
+                    low = mid + 1U;
+                } else {
+                    high = mid;
+                }
+            }
+            auto result = none;
+            if (low > 0U && ptr < regions_[low - 1U].last.load (std::memory_order_relaxed)) {
+                result = regions_[low - 1U].arena.load (std::memory_order_relaxed);
+            }
+            std::atomic_thread_fence (std::memory_order_acquire);
+            if (regions_seq_.load (std::memory_order_relaxed) == seq) {
+                if (result == none) {
+                    throw no_allocation ();
+                }
+                return result;
+            }
+        }
+    }
+
+    // add storage
+    // ~~~~~~~~~~~
+    auto concurrent_allocator::add_storage (std::size_t index, std::size_t size)
+        -> std::pair<address, std::size_t> {
+        std::lock_guard<std::mutex> const lock{storage_mutex_};
+        auto const n = num_regions_.load (std::memory_order_relaxed);
+        if (n >= max_regions_) {
+            return {nullptr, 0};
+        }
+        auto const storage = add_storage_ (size);
+        if (storage.first != nullptr && storage.second > 0U) {
+            // Open the sequence lock, move the regions above the new one up by one place, and
+            // close it again.
+            auto const seq = regions_seq_.load (std::memory_order_relaxed);
+            regions_seq_.store (seq + 1U, std::memory_order_relaxed);
+            std::atomic_thread_fence (std::memory_order_release);
+            auto pos = n;
+            for (; pos > 0U && regions_[pos - 1U].first.load (std::memory_order_relaxed) >
+                                   storage.first;
+                 --pos) {
+                region & to = regions_[pos];
+                region const & from = regions_[pos - 1U];
+                to.first.store (from.first.load (std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+                to.last.store (from.last.load (std::memory_order_relaxed),
+                               std::memory_order_relaxed);
+                to.arena.store (from.arena.load (std::memory_order_relaxed),
+                                std::memory_order_relaxed);
+            }
+            regions_[pos].first.store (storage.first, std::memory_order_relaxed);
+            regions_[pos].last.store (storage.first + storage.second, std::memory_order_relaxed);
+            regions_[pos].arena.store (index, std::memory_order_relaxed);
+            num_regions_.store (n + 1U, std::memory_order_relaxed);
+            regions_seq_.store (seq + 2U, std::memory_order_release);
+        }
+        return storage;
+    }
+
+    // push remote
+    // ~~~~~~~~~~~
+    void concurrent_allocator::push_remote (arena & a, address ptr) noexcept {
+        address head = a.remote.load (std::memory_order_relaxed);
+        do {
+            std::memcpy (ptr, &head, sizeof (head));
+        } while (!a.remote.compare_exchange_weak (head, ptr, std::memory_order_release,
+                                                  std::memory_order_relaxed));
+    }
+
+    // drain remote
+    // ~~~~~~~~~~~~
+    std::size_t concurrent_allocator::drain_remote (arena & a) {
+        std::size_t invalid = 0;
+        address ptr = a.remote.exchange (nullptr, std::memory_order_acquire);
+        while (ptr != nullptr) {
+            address next;
+            std::memcpy (&next, ptr, sizeof (next));
+            try {
+                a.alloc.free (ptr);
+            } catch (no_allocation const &) {
+                // The error belongs to the thread which queued the block, not to this one, and
+                // must not cost the blocks which follow it.
+                ++invalid;
+            } catch (...) {
+                // Put back the blocks which have not been released.
+                for (; next != nullptr; next = ptr) {
+                    std::memcpy (&ptr, next, sizeof (ptr));
+                    push_remote (a, next);
+                }
+                throw;
+            }
+            ptr = next;
+        }
+        if (invalid > 0U) {
+            invalid_remote_frees_.fetch_add (invalid, std::memory_order_relaxed);
+        }
+        return invalid;
+    }
+
+    // allocate
+    // ~~~~~~~~
+    auto concurrent_allocator::allocate (std::size_t size, std::size_t alignment) -> address {
+        arena & a = *arenas_[this->this_arena ()];
+        std::lock_guard<std::mutex> const lock{a.mutex};
+        this->drain_remote (a);
+        return a.alloc.allocate (std::max (size, min_block_size), alignment);
+    }
+
+    // free
+    // ~~~~
+    void concurrent_allocator::free (address ptr) {
+        auto const index = this->owner (ptr);
+        arena & a = *arenas_[index];
+        if (index != this->this_arena ()) {
+            push_remote (a, ptr);
+            remote_frees_.fetch_add (1U, std::memory_order_relaxed);
+            return;
+        }
+        std::lock_guard<std::mutex> const lock{a.mutex};
+        this->drain_remote (a);
+        a.alloc.free (ptr);
+    }
+
+    // realloc
+    // ~~~~~~~
+    auto concurrent_allocator::realloc (address ptr, std::size_t new_size, std::size_t alignment)
+        -> address {
+        arena & a = *arenas_[this->owner (ptr)];
+        std::lock_guard<std::mutex> const lock{a.mutex};
+        this->drain_remote (a);
+        return a.alloc.realloc (ptr, std::max (new_size, min_block_size), alignment);
+    }
+
+    // drain
+    // ~~~~~
+    void concurrent_allocator::drain () {
+        std::size_t invalid = 0;
+        for (auto & a : arenas_) {
+            std::lock_guard<std::mutex> const lock{a->mutex};
+            invalid += this->drain_remote (*a);
+        }
+        if (invalid > 0U) {
+            throw no_allocation ();
+        }
+    }
+
+    // check
+    // ~~~~~
+    bool concurrent_allocator::check () {
+        return std::all_of (std::begin (arenas_), std::end (arenas_),
+                            [](std::unique_ptr<arena> const & a) {
+                                std::lock_guard<std::mutex> const lock{a->mutex};
+                                return a->alloc.check ();
+                            });
+    }
+
+    // num allocs
+    // ~~~~~~~~~~
+    std::size_t concurrent_allocator::num_allocs () {
+        std::size_t result = 0;
+        for (auto & a : arenas_) {
+            std::lock_guard<std::mutex> const lock{a->mutex};
+            result += a->alloc.num_allocs ();
+        }
+        return result;
+    }
+
+    // allocated space
+    // ~~~~~~~~~~~~~~~
+    std::size_t concurrent_allocator::allocated_space () {
+        std::size_t result = 0;
+        for (auto & a : arenas_) {
+            std::lock_guard<std::mutex> const lock{a->mutex};
+            result += a->alloc.allocated_space ();
+        }
+        return result;
+    }
+
+} // end namespace extalloc
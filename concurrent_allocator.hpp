@@ -0,0 +1,130 @@
+#ifndef EXTALLOC_CONCURRENT_ALLOCATOR_HPP
+#define EXTALLOC_CONCURRENT_ALLOCATOR_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <memory>
+#include <mutex>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
+
+namespace extalloc {
+
+    /// A thread-safe front end made up of a number of arenas, each of which is an independent
+    /// allocator with its own lock. A thread always allocates from the same arena, so when there
+    /// are at least as many arenas as threads the locks are uncontended.
+    ///
+    /// The storage added to each arena is recorded so that the arena owning any block can be
+    /// found without taking a lock. A thread freeing a block owned by a different arena pushes
+    /// it onto that arena's lock-free remote-free queue. The queue is drained the next time a
+    /// thread using the arena allocates or frees, or when drain() is called.
+    ///
+    /// Queued blocks are linked through their own first bytes, so every request is rounded up to
+    /// at least min_block_size bytes.
+    class concurrent_allocator {
+    public:
+        using address = allocator::address;
+        using add_storage_fn = allocator::add_storage_fn;
+        using size_classes = allocator::size_classes;
+
+        static constexpr std::size_t min_block_size = sizeof (address);
+
+        /// \param as  A function with signature compatible with `std::pair<address,
+        /// size_t>(std::size_t)` which will be called if an arena cannot satisfy an allocation
+        /// request. Calls are serialized, so the function need not be thread-safe.
+        /// \param num_arenas  The number of arenas. If 0, the number of hardware threads is used.
+        /// \param classes  The size classes used for each arena's bins.
+        /// \param max_regions  The maximum number of storage regions that may be added.
+        explicit concurrent_allocator (add_storage_fn const & as, std::size_t num_arenas = 0,
+                                       size_classes const & classes = size_classes{},
+                                       std::size_t max_regions = 4096);
+        concurrent_allocator (concurrent_allocator const &) = delete;
+        concurrent_allocator (concurrent_allocator &&) = delete;
+
+        ~concurrent_allocator () noexcept;
+
+        concurrent_allocator & operator= (concurrent_allocator const &) = delete;
+        concurrent_allocator & operator= (concurrent_allocator &&) = delete;
+
+        /// Allocates a block of at least \p size bytes from the calling thread's arena.
+        address allocate (std::size_t size, std::size_t alignment = 1);
+        /// Frees a block. If the block belongs to a different arena from that of the calling
+        /// thread, it is queued for that arena to release. A queued address which turns out not
+        /// to be allocated is skipped and counted by invalid_remote_frees(), so the rest of the
+        /// queue is still released and the error is not thrown by an unrelated call.
+        ///
+        /// \throws no_allocation  If \p ptr is not within the allocator's storage or, for a
+        ///   block of the calling thread's arena, is not allocated.
+        void free (address ptr);
+        /// Resizes a block in the arena which owns it.
+        address realloc (address ptr, std::size_t new_size, std::size_t alignment = 1);
+
+        /// Releases the blocks waiting on every arena's remote-free queue.
+        ///
+        /// \throws no_allocation  If, once every queue has been emptied, any of them was found
+        ///   to hold an address which was not allocated.
+        void drain ();
+
+        bool check ();
+        std::size_t num_arenas () const noexcept { return arenas_.size (); }
+        std::size_t num_regions () const noexcept {
+            return num_regions_.load (std::memory_order_acquire);
+        }
+        /// The number of allocations across all arenas, including blocks waiting on a remote-free
+        /// queue.
+        std::size_t num_allocs ();
+        std::size_t allocated_space ();
+        /// The number of frees which were passed to a different arena's remote-free queue.
+        std::size_t remote_frees () const noexcept {
+            return remote_frees_.load (std::memory_order_relaxed);
+        }
+        /// The number of queued frees of addresses which were not allocated.
+        std::size_t invalid_remote_frees () const noexcept {
+            return invalid_remote_frees_.load (std::memory_order_relaxed);
+        }
+
+    private:
+        class arena;
+
+        /// A storage region and the arena to which it was given. The members are atomic because
+        /// readers may load them while add_storage() is moving them: see owner().
+        struct region {
+            std::atomic<address> first;
+            std::atomic<address> last;
+            std::atomic<std::size_t> arena;
+        };
+
+        /// Returns the index of the arena used by the calling thread.
+        std::size_t this_arena () const noexcept;
+        /// Returns the index of the arena whose storage contains \p ptr.
+        std::size_t owner (address ptr) const;
+        /// Obtains storage for arena \p index and records the new region.
+        std::pair<address, std::size_t> add_storage (std::size_t index, std::size_t size);
+        /// Pushes \p ptr onto the remote-free queue of \p a.
+        static void push_remote (arena & a, address ptr) noexcept;
+        /// Releases the blocks on the remote-free queue of \p a. The arena's lock must be held.
+        /// \returns  The number of queued addresses which were not allocated.
+        std::size_t drain_remote (arena & a);
+
+        add_storage_fn add_storage_;
+        /// Serializes calls to add_storage_ and additions to the regions table.
+        std::mutex storage_mutex_;
+        /// The storage regions in address order.
+        std::unique_ptr<region[]> regions_;
+        std::size_t const max_regions_;
+        /// The number of entries in regions_.
+        std::atomic<std::size_t> num_regions_{0};
+        /// A sequence lock for regions_: odd while add_storage() is inserting an entry. Readers
+        /// take no lock, but retry a lookup which overlapped a change.
+        std::atomic<std::size_t> regions_seq_{0};
+
+        std::vector<std::unique_ptr<arena>> arenas_;
+        std::atomic<std::size_t> remote_frees_{0};
+        std::atomic<std::size_t> invalid_remote_frees_{0};
+    };
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_CONCURRENT_ALLOCATOR_HPP
@@ -0,0 +1,99 @@
+#ifndef EXTALLOC_ENCODING_HPP
+#define EXTALLOC_ENCODING_HPP
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <istream>
+#include <vector>
+
+namespace extalloc {
+
+    namespace encoding {
+
+        /// Appends \p v to \p out as a little-endian base-128 varint: seven bits per byte with
+        /// the top bit set on every byte but the last. Values below 128 take a single byte.
+        inline void put_varint (std::vector<std::uint8_t> & out, std::uint64_t v) {
+            while (v >= 0x80U) {
+                out.push_back (static_cast<std::uint8_t> (v | 0x80U));
+                v >>= 7U;
+            }
+            out.push_back (static_cast<std::uint8_t> (v));
+        }
+
+        /// Decodes a varint starting at \p p, advancing \p p past it.
+        /// \returns  False if the encoding runs past \p last or is longer than any 64-bit value.
+        inline bool get_varint (std::uint8_t const *& p, std::uint8_t const * last,
+                                std::uint64_t * v) noexcept {
+            std::uint64_t result = 0;
+            for (auto shift = 0U; shift < 64U && p != last; shift += 7U) {
+                auto const byte = *p++;
+                result |= std::uint64_t{byte & 0x7FU} << shift;
+                if ((byte & 0x80U) == 0U) {
+                    *v = result;
+                    return true;
+                }
+            }
+            return false;
+        }
+
+        /// Maps signed values to unsigned so that those of small magnitude, whether positive or
+        /// negative, have short varint encodings: 0, -1, 1, -2, ... become 0, 1, 2, 3, ...
+        constexpr std::uint64_t zigzag (std::int64_t v) noexcept {
+            return (static_cast<std::uint64_t> (v) << 1U) ^ static_cast<std::uint64_t> (v >> 63);
+        }
+        constexpr std::int64_t unzigzag (std::uint64_t v) noexcept {
+            return static_cast<std::int64_t> (v >> 1U) ^ -static_cast<std::int64_t> (v & 1U);
+        }
+
+        /// Appends \p v to \p out as eight little-endian bytes.
+        inline void put_u64 (std::vector<std::uint8_t> & out, std::uint64_t v) {
+            for (auto ctr = 0U; ctr < 8U; ++ctr) {
+                out.push_back (static_cast<std::uint8_t> (v >> (8U * ctr)));
+            }
+        }
+        /// Reads eight little-endian bytes from \p p.
+        inline std::uint64_t get_u64 (std::uint8_t const * p) noexcept {
+            std::uint64_t result = 0;
+            for (auto ctr = 0U; ctr < 8U; ++ctr) {
+                result |= std::uint64_t{p[ctr]} << (8U * ctr);
+            }
+            return result;
+        }
+
+        /// The 64-bit FNV-1a hash of \p size bytes at \p p.
+        inline std::uint64_t fnv1a (std::uint8_t const * p, std::size_t size) noexcept {
+            std::uint64_t result = 0xcbf29ce484222325;
+            for (auto const last = p + size; p != last; ++p) {
+                result = (result ^ *p) * 0x100000001b3;
+            }
+            return result;
+        }
+
+        /// Replaces the contents of \p out with the next \p size bytes of \p is. The bytes are
+        /// read in chunks and \p out grows only as they arrive, so a damaged size field can't
+        /// cause an allocation much larger than the stream.
+        /// \returns  False if the stream ended first.
+        inline bool read_bytes (std::istream & is, std::uint64_t size,
+                                std::vector<std::uint8_t> & out) {
+            constexpr std::uint64_t chunk_size = 64 * 1024;
+            out.clear ();
+            while (size > 0U) {
+                auto const n = static_cast<std::size_t> (std::min (size, chunk_size));
+                auto const pos = out.size ();
+                out.resize (pos + n);
+                is.read (reinterpret_cast<std::istream::char_type *> (out.data () + pos),
+                         static_cast<std::streamsize> (n));
+                if (is.gcount () != static_cast<std::streamsize> (n)) {
+                    return false;
+                }
+                size -= n;
+            }
+            return true;
+        }
+
+    } // end namespace encoding
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_ENCODING_HPP
@@ -0,0 +1,215 @@
+#ifndef EXTALLOC_FLAT_MAP_HPP
+#define EXTALLOC_FLAT_MAP_HPP
+
+#include <algorithm>
+#include <functional>
+#include <iterator>
+#include <utility>
+#include <vector>
+
+namespace extalloc {
+
+    namespace details {
+
+        template <typename Value>
+        struct identity_key {
+            Value const & operator() (Value const & v) const noexcept { return v; }
+        };
+
+        template <typename Pair>
+        struct first_key {
+            typename Pair::first_type const & operator() (Pair const & v) const noexcept {
+                return v.first;
+            }
+        };
+
+        /// An ordered associative container which keeps its elements sorted in a single contiguous
+        /// vector. Lookups are a binary search over densely packed keys; insertion and erasure
+        /// must move the elements which follow the point of change.
+        ///
+        /// Unlike the node-based standard containers, any insertion or erasure invalidates all
+        /// iterators at or after the point of change.
+        ///
+        /// \tparam Container  The underlying sequence. It must provide the random-access
+        ///   iterators and the insert(), erase(), reserve(), and clear() members of std::vector<>.
+        template <typename Key, typename Value, typename KeyOfValue, typename Compare,
+                  typename Container = std::vector<Value>>
+        class flat_tree {
+        public:
+            using key_type = Key;
+            using value_type = Value;
+            using key_compare = Compare;
+            using container_type = Container;
+            using size_type = typename container_type::size_type;
+            using difference_type = typename container_type::difference_type;
+            using reference = value_type &;
+            using const_reference = value_type const &;
+            using iterator = typename container_type::iterator;
+            using const_iterator = typename container_type::const_iterator;
+            using reverse_iterator = typename container_type::reverse_iterator;
+            using const_reverse_iterator = typename container_type::const_reverse_iterator;
+
+            flat_tree () = default;
+            explicit flat_tree (Compare const & comp)
+                    : comp_{comp} {}
+            /// Adopts \p c, whose elements must already be sorted and unique.
+            explicit flat_tree (container_type c, Compare const & comp = Compare{})
+                    : v_ (std::move (c))
+                    , comp_{comp} {}
+
+            iterator begin () noexcept { return v_.begin (); }
+            const_iterator begin () const noexcept { return v_.begin (); }
+            const_iterator cbegin () const noexcept { return v_.cbegin (); }
+            iterator end () noexcept { return v_.end (); }
+            const_iterator end () const noexcept { return v_.end (); }
+            const_iterator cend () const noexcept { return v_.cend (); }
+            reverse_iterator rbegin () noexcept { return v_.rbegin (); }
+            const_reverse_iterator rbegin () const noexcept { return v_.rbegin (); }
+            reverse_iterator rend () noexcept { return v_.rend (); }
+            const_reverse_iterator rend () const noexcept { return v_.rend (); }
+
+            bool empty () const noexcept { return v_.empty (); }
+            size_type size () const noexcept { return v_.size (); }
+            size_type capacity () const noexcept { return v_.capacity (); }
+            void reserve (size_type n) { v_.reserve (n); }
+            void clear () noexcept { v_.clear (); }
+
+            iterator lower_bound (key_type const & k) {
+                return std::lower_bound (v_.begin (), v_.end (), k, value_compare{comp_});
+            }
+            const_iterator lower_bound (key_type const & k) const {
+                return std::lower_bound (v_.begin (), v_.end (), k, value_compare{comp_});
+            }
+            iterator upper_bound (key_type const & k) {
+                return std::upper_bound (v_.begin (), v_.end (), k, key_compare_value{comp_});
+            }
+            const_iterator upper_bound (key_type const & k) const {
+                return std::upper_bound (v_.begin (), v_.end (), k, key_compare_value{comp_});
+            }
+            iterator find (key_type const & k) {
+                auto const pos = this->lower_bound (k);
+                return pos != v_.end () && !comp_ (k, KeyOfValue{}(*pos)) ? pos : v_.end ();
+            }
+            const_iterator find (key_type const & k) const {
+                auto const pos = this->lower_bound (k);
+                return pos != v_.end () && !comp_ (k, KeyOfValue{}(*pos)) ? pos : v_.end ();
+            }
+            size_type count (key_type const & k) const {
+                return this->find (k) != v_.end () ? 1U : 0U;
+            }
+
+            std::pair<iterator, bool> insert (value_type const & v) {
+                auto const pos = this->lower_bound (KeyOfValue{}(v));
+                if (pos != v_.end () && !comp_ (KeyOfValue{}(v), KeyOfValue{}(*pos))) {
+                    return {pos, false};
+                }
+                return {v_.insert (pos, v), true};
+            }
+            /// Inserts \p v using \p hint as a suggestion for its position. If the hint is correct
+            /// the binary search is skipped.
+            iterator insert (const_iterator hint, value_type const & v) {
+                auto const & k = KeyOfValue{}(v);
+                if ((hint == v_.cend () || comp_ (k, KeyOfValue{}(*hint))) &&
+                    (hint == v_.cbegin () || comp_ (KeyOfValue{}(*std::prev (hint)), k))) {
+                    return v_.insert (hint, v);
+                }
+                return this->insert (v).first;
+            }
+            template <typename... Args>
+            std::pair<iterator, bool> emplace (Args &&... args) {
+                return this->insert (value_type (std::forward<Args> (args)...));
+            }
+            template <typename... Args>
+            iterator emplace_hint (const_iterator hint, Args &&... args) {
+                return this->insert (hint, value_type (std::forward<Args> (args)...));
+            }
+
+            /// Replaces the element at \p pos with \p v, moving it to the correct position for
+            /// its key. Only the elements between the old and new positions are moved. The new key
+            /// must not match that of any other element.
+            iterator replace (const_iterator pos, value_type const & v) {
+                auto const first = v_.begin () + (pos - v_.cbegin ());
+                auto const & k = KeyOfValue{}(v);
+                auto const next = std::next (first);
+                if (next != v_.end () && comp_ (KeyOfValue{}(*next), k)) {
+                    // The element moves towards the end.
+                    auto const last =
+                        std::lower_bound (next, v_.end (), k, value_compare{comp_});
+                    std::move (next, last, first);
+                    auto const result = std::prev (last);
+                    *result = v;
+                    return result;
+                }
+                if (first != v_.begin () && comp_ (k, KeyOfValue{}(*std::prev (first)))) {
+                    // The element moves towards the beginning.
+                    auto const dest =
+                        std::upper_bound (v_.begin (), first, k, key_compare_value{comp_});
+                    std::move_backward (dest, first, next);
+                    *dest = v;
+                    return dest;
+                }
+                *first = v;
+                return first;
+            }
+
+            iterator erase (const_iterator pos) { return v_.erase (pos); }
+            iterator erase (const_iterator first, const_iterator last) {
+                return v_.erase (first, last);
+            }
+            size_type erase (key_type const & k) {
+                auto const pos = this->find (k);
+                if (pos == v_.end ()) {
+                    return 0U;
+                }
+                v_.erase (pos);
+                return 1U;
+            }
+
+            bool operator== (flat_tree const & rhs) const { return v_ == rhs.v_; }
+            bool operator!= (flat_tree const & rhs) const { return !operator== (rhs); }
+
+        private:
+            /// Compares a stored value with a key (for lower_bound()).
+            class value_compare {
+            public:
+                explicit value_compare (Compare const & c)
+                        : c_{c} {}
+                bool operator() (value_type const & v, key_type const & k) const {
+                    return c_ (KeyOfValue{}(v), k);
+                }
+
+            private:
+                Compare const & c_;
+            };
+            /// Compares a key with a stored value (for upper_bound()).
+            class key_compare_value {
+            public:
+                explicit key_compare_value (Compare const & c)
+                        : c_{c} {}
+                bool operator() (key_type const & k, value_type const & v) const {
+                    return c_ (k, KeyOfValue{}(v));
+                }
+
+            private:
+                Compare const & c_;
+            };
+
+            container_type v_;
+            Compare comp_;
+        };
+
+    } // end namespace details
+
+    /// A sorted-vector replacement for std::map<>. The element type is std::pair<Key, T> (rather
+    /// than std::pair<Key const, T>) so that elements can be moved within the vector.
+    template <typename Key, typename T, typename Compare = std::less<Key>>
+    using flat_map = details::flat_tree<Key, std::pair<Key, T>,
+                                        details::first_key<std::pair<Key, T>>, Compare>;
+
+    /// A sorted-vector replacement for std::set<>.
+    template <typename Key, typename Compare = std::less<Key>>
+    using flat_set = details::flat_tree<Key, Key, details::identity_key<Key>, Compare>;
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_FLAT_MAP_HPP
@@ -0,0 +1,251 @@
+#ifndef EXTALLOC_HEAP_OFFSET_HPP
+#define EXTALLOC_HEAP_OFFSET_HPP
+
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <type_traits>
+
+namespace extalloc {
+
+    /// The position of a block as an offset from the base of a heap. An allocator whose
+    /// addresses are offsets holds no pointers, so its metadata is equally valid wherever the
+    /// heap is mapped. It supports the subset of pointer arithmetic and comparison used by the
+    /// allocator; the arithmetic is always in bytes. A null offset, which is constructed from
+    /// nullptr, is distinct from every valid offset.
+    ///
+    /// \tparam T  The unsigned integer type in which the offset is stored.
+    /// \tparam Granule  The offset is stored in units of this many bytes, which extends the range
+    ///   of a narrow \p T. Every offset, and every distance added to one, must be a multiple of
+    ///   the granule.
+    template <typename T, std::size_t Granule = 1>
+    class basic_heap_offset {
+        static_assert (std::is_unsigned<T>::value, "offsets must be unsigned");
+        static_assert (Granule > 0U && (Granule & (Granule - 1U)) == 0U,
+                       "the granule must be a power of two");
+
+    public:
+        using value_type = std::uint64_t;
+        static constexpr std::size_t granule = Granule;
+
+        /// Constructs the offset of the base of the heap.
+        constexpr basic_heap_offset () noexcept = default;
+        constexpr basic_heap_offset (std::nullptr_t) noexcept
+                : v_{null_value} {}
+        /// Constructs an offset of \p v bytes. This is a template so that the literal 0 selects
+        /// it rather than the null constructor.
+        template <typename Integer,
+                  typename = typename std::enable_if<std::is_integral<Integer>::value>::type>
+        explicit basic_heap_offset (Integer v) noexcept
+                : v_{static_cast<T> (static_cast<value_type> (v) / Granule)} {
+            assert (static_cast<value_type> (v) % Granule == 0U);
+            assert (static_cast<value_type> (v) / Granule < null_value);
+        }
+
+        /// The offset in bytes.
+        constexpr value_type get () const noexcept { return value_type{v_} * Granule; }
+        constexpr explicit operator bool () const noexcept { return v_ != null_value; }
+        /// True if the \p size bytes starting at this offset are whole granules and the offset of
+        /// their end can be represented.
+        constexpr bool spans (std::size_t size) const noexcept {
+            return v_ != null_value && size % Granule == 0U &&
+                   value_type{size / Granule} < value_type{null_value} - v_;
+        }
+
+        /// Returns the address of the block when the heap is mapped at \p base.
+        template <typename U = std::uint8_t>
+        U * to_pointer (void * base) const noexcept {
+            return v_ == null_value ? nullptr
+                                    : reinterpret_cast<U *> (static_cast<std::uint8_t *> (base) +
+                                                             static_cast<std::size_t> (get ()));
+        }
+        /// Returns the offset of \p ptr from \p base or a null offset if \p ptr is null.
+        static basic_heap_offset from_pointer (void const * ptr, void const * base) noexcept {
+            return ptr == nullptr
+                       ? basic_heap_offset{nullptr}
+                       : basic_heap_offset{static_cast<value_type> (
+                             static_cast<std::uint8_t const *> (ptr) -
+                             static_cast<std::uint8_t const *> (base))};
+        }
+
+        /// Moves the offset by \p n bytes, which may be negative.
+        template <typename Integer>
+        typename std::enable_if<std::is_integral<Integer>::value, basic_heap_offset &>::type
+        operator+= (Integer n) noexcept {
+            auto const d = static_cast<std::int64_t> (n);
+            assert (d % static_cast<std::int64_t> (Granule) == 0);
+            v_ = static_cast<T> (v_ + static_cast<T> (d / static_cast<std::int64_t> (Granule)));
+            return *this;
+        }
+        template <typename Integer>
+        typename std::enable_if<std::is_integral<Integer>::value, basic_heap_offset &>::type
+        operator-= (Integer n) noexcept {
+            return *this += -static_cast<std::int64_t> (n);
+        }
+
+    private:
+        static constexpr T null_value = std::numeric_limits<T>::max ();
+        T v_ = 0;
+    };
+
+    template <typename T, std::size_t Granule>
+    constexpr std::size_t basic_heap_offset<T, Granule>::granule;
+
+    /// A byte offset with a 64-bit range.
+    using heap_offset = basic_heap_offset<std::uint64_t>;
+    /// A 32-bit offset in units of \p Granule bytes. It can address a heap of up to 4 GiB times
+    /// the granule.
+    template <std::size_t Granule = 1>
+    using compact_offset = basic_heap_offset<std::uint32_t, Granule>;
+
+    template <typename T, std::size_t G, typename Integer>
+    inline typename std::enable_if<std::is_integral<Integer>::value, basic_heap_offset<T, G>>::type
+    operator+ (basic_heap_offset<T, G> lhs, Integer n) noexcept {
+        return lhs += n;
+    }
+    template <typename T, std::size_t G, typename Integer>
+    inline typename std::enable_if<std::is_integral<Integer>::value, basic_heap_offset<T, G>>::type
+    operator- (basic_heap_offset<T, G> lhs, Integer n) noexcept {
+        return lhs -= n;
+    }
+    /// The number of bytes from \p rhs to \p lhs.
+    template <typename T, std::size_t G>
+    constexpr std::ptrdiff_t operator- (basic_heap_offset<T, G> lhs,
+                                        basic_heap_offset<T, G> rhs) noexcept {
+        return static_cast<std::ptrdiff_t> (lhs.get () - rhs.get ());
+    }
+
+    template <typename T, std::size_t G>
+    constexpr bool operator== (basic_heap_offset<T, G> lhs, basic_heap_offset<T, G> rhs) noexcept {
+        return lhs.get () == rhs.get ();
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator!= (basic_heap_offset<T, G> lhs, basic_heap_offset<T, G> rhs) noexcept {
+        return !(lhs == rhs);
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator< (basic_heap_offset<T, G> lhs, basic_heap_offset<T, G> rhs) noexcept {
+        return lhs.get () < rhs.get ();
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator> (basic_heap_offset<T, G> lhs, basic_heap_offset<T, G> rhs) noexcept {
+        return rhs < lhs;
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator<= (basic_heap_offset<T, G> lhs, basic_heap_offset<T, G> rhs) noexcept {
+        return !(rhs < lhs);
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator>= (basic_heap_offset<T, G> lhs, basic_heap_offset<T, G> rhs) noexcept {
+        return !(lhs < rhs);
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator== (basic_heap_offset<T, G> lhs, std::nullptr_t) noexcept {
+        return !lhs;
+    }
+    template <typename T, std::size_t G>
+    constexpr bool operator!= (basic_heap_offset<T, G> lhs, std::nullptr_t) noexcept {
+        return static_cast<bool> (lhs);
+    }
+
+
+    /// A block size held in a narrow integer in units of \p Granule bytes. It converts implicitly
+    /// to and from a std::size_t number of bytes so that the allocator's metadata containers can
+    /// hold it in place of a std::size_t. The size must be a multiple of the granule.
+    template <typename T, std::size_t Granule = 1>
+    class granular_size {
+        static_assert (std::is_unsigned<T>::value, "sizes must be unsigned");
+
+    public:
+        constexpr granular_size () noexcept = default;
+        granular_size (std::size_t bytes) noexcept
+                : v_{static_cast<T> (bytes / Granule)} {
+            assert (bytes % Granule == 0U);
+            assert (bytes / Granule <= std::numeric_limits<T>::max ());
+        }
+        constexpr operator std::size_t () const noexcept { return std::size_t{v_} * Granule; }
+
+        granular_size & operator+= (std::size_t bytes) noexcept {
+            return *this = granular_size{std::size_t{*this} + bytes};
+        }
+        granular_size & operator-= (std::size_t bytes) noexcept {
+            return *this = granular_size{std::size_t{*this} - bytes};
+        }
+
+    private:
+        T v_ = 0;
+    };
+
+
+    /// Describes how a basic_allocator's addresses relate to memory. Specialized for byte
+    /// pointers and for basic_heap_offset<>.
+    template <typename Address>
+    struct address_traits;
+
+    /// Addresses are pointers into the heap.
+    template <>
+    struct address_traits<std::uint8_t *> {
+        using address = std::uint8_t *;
+        /// The type in which the metadata records the size of a block.
+        using size_type = std::size_t;
+        /// The address and size of every block is a multiple of this number of bytes.
+        static constexpr std::size_t granule = 1;
+
+        /// The value used for alignment. Blocks are aligned in the address space.
+        static std::uintptr_t to_integer (address a) noexcept {
+            return reinterpret_cast<std::uintptr_t> (a);
+        }
+        /// Returns the memory for \p a when the heap is mapped at \p base.
+        static std::uint8_t * to_pointer (address a, std::uint8_t * /*base*/) noexcept {
+            return a;
+        }
+        /// Returns the address of the memory at \p p when the heap is mapped at \p base.
+        static address from_pointer (std::uint8_t * p, std::uint8_t * /*base*/) noexcept {
+            return p;
+        }
+        /// True if the \p size bytes at \p a can be recorded: that is, if every address within
+        /// them and the address of their end can be represented.
+        static constexpr bool is_representable (address /*a*/, std::size_t /*size*/) noexcept {
+            return true;
+        }
+        /// The address from which saved addresses are measured.
+        template <typename Pointer>
+        static Pointer origin (Pointer base) noexcept {
+            return base;
+        }
+    };
+
+    /// Addresses are offsets from the base of the heap. Blocks are aligned relative to the base,
+    /// which should itself be aligned at least as strictly as any allocation. Offsets narrower
+    /// than a std::size_t are paired with sizes of the same width and granule.
+    template <typename T, std::size_t Granule>
+    struct address_traits<basic_heap_offset<T, Granule>> {
+        using address = basic_heap_offset<T, Granule>;
+        using size_type =
+            typename std::conditional<sizeof (T) >= sizeof (std::size_t) && Granule == 1U,
+                                      std::size_t, granular_size<T, Granule>>::type;
+        static constexpr std::size_t granule = Granule;
+
+        static std::uintptr_t to_integer (address a) noexcept {
+            return static_cast<std::uintptr_t> (a.get ());
+        }
+        static std::uint8_t * to_pointer (address a, std::uint8_t * base) noexcept {
+            return a.to_pointer (base);
+        }
+        static address from_pointer (std::uint8_t * p, std::uint8_t * base) noexcept {
+            return address::from_pointer (p, base);
+        }
+        static constexpr bool is_representable (address a, std::size_t size) noexcept {
+            return a.spans (size);
+        }
+        /// Offsets are saved as they are, whatever base is supplied.
+        static address origin (void const * /*base*/) noexcept { return address{}; }
+    };
+
+    template <typename T, std::size_t Granule>
+    constexpr std::size_t address_traits<basic_heap_offset<T, Granule>>::granule;
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_HEAP_OFFSET_HPP
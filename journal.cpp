@@ -0,0 +1,156 @@
+#include "journal.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+#include "encoding.hpp"
+
+namespace extalloc {
+
+    namespace {
+
+        constexpr std::array<char, 8> signature{{'E', 'X', 'T', 'J', 'O', 'U', 'R', 'N'}};
+        /// The signature and generation.
+        constexpr std::size_t header_size = 16;
+        /// A group is larger than this only if its size field is damaged.
+        constexpr std::uint64_t max_group_size = std::uint64_t{1} << 30U;
+
+    } // end anonymous namespace
+
+    // ctor
+    // ~~~~
+    journal::journal (std::ostream & os, std::uint8_t const * base, std::uint64_t generation,
+                      sync_fn sync, std::size_t group_size)
+            : os_{os}
+            , base_{base}
+            , sync_{std::move (sync)}
+            , group_size_{std::max (group_size, std::size_t{1})}
+            , prev_{base} {
+        std::vector<std::uint8_t> header (std::begin (signature), std::end (signature));
+        encoding::put_u64 (header, generation);
+        os_.write (reinterpret_cast<std::ostream::char_type const *> (header.data ()),
+                   static_cast<std::streamsize> (header.size ()));
+        os_.flush ();
+    }
+
+    // dtor
+    // ~~~~
+    journal::~journal () noexcept {
+        try {
+            this->commit ();
+        } catch (...) {
+        }
+    }
+
+    // record
+    // ~~~~~~
+    void journal::record (journal_op op, address addr, std::size_t size) {
+        // Space for the group's size, which is filled in by commit().
+        if (group_.empty ()) {
+            group_.resize (8U);
+        }
+        group_.push_back (static_cast<std::uint8_t> (op));
+        encoding::put_varint (group_, encoding::zigzag (addr - prev_));
+        encoding::put_varint (group_, size);
+        prev_ = addr;
+        ++pending_;
+        ++num_records_;
+        if (pending_ >= group_size_) {
+            this->commit ();
+        }
+    }
+
+    // commit
+    // ~~~~~~
+    void journal::commit () {
+        if (pending_ == 0U) {
+            return;
+        }
+        auto const body_size = group_.size () - 8U;
+        std::vector<std::uint8_t> size_bytes;
+        encoding::put_u64 (size_bytes, body_size);
+        std::copy (std::begin (size_bytes), std::end (size_bytes), std::begin (group_));
+        encoding::put_u64 (group_, encoding::fnv1a (group_.data () + 8U, body_size));
+
+        os_.write (reinterpret_cast<std::ostream::char_type const *> (group_.data ()),
+                   static_cast<std::streamsize> (group_.size ()));
+        os_.flush ();
+        if (sync_) {
+            sync_ ();
+        }
+        group_.clear ();
+        pending_ = 0;
+        prev_ = base_;
+        ++num_commits_;
+    }
+
+    // read [static]
+    // ~~~~
+    std::size_t journal::read (std::istream & is, std::uint64_t generation, std::uint8_t * base,
+                               record_fn const & f) {
+        std::array<std::uint8_t, header_size> header;
+        is.read (reinterpret_cast<std::istream::char_type *> (header.data ()),
+                 static_cast<std::streamsize> (header.size ()));
+        if (is.gcount () == 0) {
+            // The journal was created but its header was never written.
+            return 0;
+        }
+        if (is.gcount () != static_cast<std::streamsize> (header.size ()) ||
+            !std::equal (std::begin (signature), std::end (signature), std::begin (header),
+                         [](char c, std::uint8_t b) {
+                             return static_cast<std::uint8_t> (c) == b;
+                         })) {
+            throw bad_metadata ("journal header is not valid");
+        }
+        if (encoding::get_u64 (header.data () + signature.size ()) != generation) {
+            // The journal belongs to an earlier snapshot.
+            return 0;
+        }
+
+        std::size_t result = 0;
+        std::vector<std::uint8_t> body;
+        for (;;) {
+            // Stop at the first group which is incomplete or damaged: it was being written when
+            // the journal was abandoned.
+            std::array<std::uint8_t, 8> size_bytes;
+            is.read (reinterpret_cast<std::istream::char_type *> (size_bytes.data ()),
+                     static_cast<std::streamsize> (size_bytes.size ()));
+            if (is.gcount () != static_cast<std::streamsize> (size_bytes.size ())) {
+                break;
+            }
+            auto const body_size = encoding::get_u64 (size_bytes.data ());
+            if (body_size > max_group_size) {
+                break;
+            }
+            // The body grows only as its bytes arrive, so a damaged size in the last group can't
+            // cause a large allocation.
+            if (!encoding::read_bytes (is, body_size + 8U, body)) {
+                break;
+            }
+            auto const last = body.data () + body_size;
+            if (encoding::fnv1a (body.data (), static_cast<std::size_t> (body_size)) !=
+                encoding::get_u64 (last)) {
+                break;
+            }
+
+            std::uint8_t const * p = body.data ();
+            std::uint8_t * prev = base;
+            while (p != last) {
+                auto const op = static_cast<journal_op> (*p++);
+                std::uint64_t delta;
+                std::uint64_t size;
+                if (!encoding::get_varint (p, last, &delta) ||
+                    !encoding::get_varint (p, last, &size)) {
+                    throw bad_metadata ("journal record is not valid");
+                }
+                auto const addr = prev + encoding::unzigzag (delta);
+                f (op, addr, static_cast<std::size_t> (size));
+                prev = addr;
+                ++result;
+            }
+        }
+        return result;
+    }
+
+} // end namespace extalloc
@@ -0,0 +1,115 @@
+#ifndef EXTALLOC_JOURNAL_HPP
+#define EXTALLOC_JOURNAL_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <vector>
+
+#include "allocator.hpp"
+
+namespace extalloc {
+
+    /// An append-only log of the changes made to an allocator's metadata. Together with a
+    /// snapshot written by basic_allocator::save(), it allows the allocator's state to be
+    /// recovered without the whole snapshot being rewritten after every change.
+    ///
+    /// Records are collected into groups. A group is written to the stream with a single call,
+    /// followed by a call to the sync function (which might fsync() the journal file and msync()
+    /// the heap), once it holds group_size records or when commit() is called. Each group carries
+    /// a checksum so that a group which was only partly written when the process stopped is
+    /// recognized and ignored. Changes made since the last commit are lost.
+    ///
+    /// The journal starts with a header holding a generation number which ties it to a snapshot.
+    /// To compact the journal, save a new snapshot and its generation (which should be one
+    /// greater than the last), then start a new journal with the same generation. A journal
+    /// whose generation does not match that of the snapshot predates it and is ignored by
+    /// read().
+    class journal {
+    public:
+        using address = allocator::address;
+        using sync_fn = std::function<void ()>;
+        using record_fn = std::function<void (journal_op, address, std::size_t)>;
+
+        /// Writes the journal header to \p os.
+        ///
+        /// \param os  The stream to which the journal is written. It should be empty.
+        /// \param base  Addresses are recorded relative to this address.
+        /// \param generation  The generation of the snapshot to which the journal applies.
+        /// \param sync  Called after each group has been written and the stream flushed.
+        /// \param group_size  The number of records which are collected before they are written.
+        journal (std::ostream & os, std::uint8_t const * base, std::uint64_t generation,
+                 sync_fn sync = sync_fn{}, std::size_t group_size = 256);
+        journal (journal const &) = delete;
+        journal (journal &&) = delete;
+
+        /// Commits any outstanding records.
+        ~journal () noexcept;
+
+        journal & operator= (journal const &) = delete;
+        journal & operator= (journal &&) = delete;
+
+        /// Returns a function, suitable for basic_allocator::set_journal(), which records each
+        /// change in this journal.
+        record_fn recorder () {
+            return [this](journal_op op, address addr, std::size_t size) {
+                this->record (op, addr, size);
+            };
+        }
+
+        /// Adds a record to the current group, committing the group if it is full.
+        void record (journal_op op, address addr, std::size_t size);
+        /// Writes the current group, if it is not empty, and calls the sync function.
+        void commit ();
+
+        /// The number of records which have not yet been committed.
+        std::size_t pending () const noexcept { return pending_; }
+        std::uint64_t num_records () const noexcept { return num_records_; }
+        std::uint64_t num_commits () const noexcept { return num_commits_; }
+
+        /// Reads a journal, passing each record to \p f.
+        ///
+        /// \param is  The stream from which the journal is read.
+        /// \param generation  The generation of the snapshot to which the records will be applied.
+        ///   If the journal's generation is different, no records are read.
+        /// \param base  Addresses were recorded relative to this address.
+        /// \param f  The function which is called for each record.
+        /// \returns  The number of records read.
+        /// \throws bad_metadata  If the stream does not start with a journal header.
+        static std::size_t read (std::istream & is, std::uint64_t generation, std::uint8_t * base,
+                                 record_fn const & f);
+
+        /// Reads a journal, applying each of its records to \p alloc with
+        /// basic_allocator::replay().
+        template <typename Containers, typename Fit, typename Storage>
+        static std::size_t
+        replay (std::istream & is, std::uint64_t generation, std::uint8_t * base,
+                basic_allocator<Containers, std::uint8_t *, Fit, Storage> & alloc) {
+            return read (is, generation, base,
+                         [&alloc](journal_op op, address addr, std::size_t size) {
+                             alloc.replay (op, addr, size);
+                         });
+        }
+
+    private:
+        std::ostream & os_;
+        std::uint8_t const * const base_;
+        sync_fn sync_;
+        std::size_t const group_size_;
+
+        /// The encoded records of the current group.
+        std::vector<std::uint8_t> group_;
+        std::size_t pending_ = 0;
+        /// The address of the previous record in the group. Each address is encoded as the
+        /// distance from its predecessor.
+        std::uint8_t const * prev_;
+
+        std::uint64_t num_records_ = 0;
+        std::uint64_t num_commits_ = 0;
+    };
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_JOURNAL_HPP
@@ -1,13 +1,18 @@
 #include <algorithm>
 #include <cassert>
+#include <chrono>
 #include <cstdlib>
 #include <deque>
-#include <list>
+#include <fstream>
 #include <iostream>
+#include <memory>
 #include <random>
 #include <tuple>
+#include <vector>
 
 #include "allocator.hpp"
+#include "storage.hpp"
+#include "trace.hpp"
 
 using namespace extalloc;
 
@@ -19,23 +24,44 @@ namespace {
                 : std::runtime_error{"bad allocation contents"} {}
     };
 
-    void stress (unsigned num_passes, unsigned num_allocations, std::size_t max_allocation_size,
-                 std::size_t storage_block_size) {
-        std::list<std::vector<std::uint8_t>> buffers;
+    /// Returns size classes at 16 byte intervals up to \p max_allocation_size.
+    allocator::size_classes make_classes (std::size_t max_allocation_size) {
+        std::vector<std::size_t> bounds;
+        for (auto size = std::size_t{16}; size <= max_allocation_size; size += 16U) {
+            bounds.push_back (size);
+        }
+        return allocator::size_classes{std::move (bounds)};
+    }
 
-        allocator alloc{[&buffers, storage_block_size](std::size_t size) {
-                            buffers.emplace_back (std::max (size, storage_block_size));
-                            auto & buffer = buffers.back ();
-                            return std::pair<uint8_t *, size_t>{buffer.data (), buffer.size ()};
-                        },
-                        std::make_pair (nullptr, std::size_t{0})};
+    /// Runs the workload with the placement policy \p Fit and prints the storage it needed,
+    /// the fragmentation of the heap at the end of the workload, and the time it took.
+    ///
+    /// \param name  The name of the placement policy.
+    /// \param trace  If not null, a trace of the allocator's calls is written to this stream.
+    template <typename Fit>
+    void stress (char const * name, unsigned num_passes, unsigned num_allocations,
+                 std::size_t max_allocation_size, std::size_t storage_block_size,
+                 std::ostream * trace) {
+        using allocator_type = storage_allocator<vector_storage, Fit>;
+        using address = typename allocator_type::address;
+        vector_storage storage{storage_block_size};
+        allocator_type alloc{storage, std::make_pair (nullptr, std::size_t{0}),
+                             make_classes (max_allocation_size)};
+
+        std::unique_ptr<trace_recorder> recorder;
+        if (trace != nullptr) {
+            recorder.reset (new trace_recorder{*trace});
+            alloc.set_trace (recorder->recorder<address> ());
+        }
 
-        std::deque<std::tuple<allocator::address, std::size_t, std::uint8_t>> blocks;
+        std::deque<std::tuple<address, std::size_t, std::uint8_t>> blocks;
 
-        auto const free_n = [&alloc, &blocks](std::size_t n) {
+        std::vector<address> batch;
+        auto const free_n = [&alloc, &blocks, &batch](std::size_t n) {
+            batch.clear ();
             for (; n > 0; --n) {
                 auto const & front = blocks.front ();
-                allocator::address const addr = std::get<0> (front);
+                address const addr = std::get<0> (front);
                 std::size_t const size = std::get<1> (front);
                 std::uint8_t const v = std::get<2> (front);
 
@@ -46,16 +72,17 @@ namespace {
                     throw bad_memory ();
                 }
 
-                alloc.free (addr);
-                assert (alloc.check ());
-
+                batch.push_back (addr);
                 blocks.pop_front ();
             }
+            alloc.free_n (batch.data (), batch.size ());
+            assert (alloc.check ());
         };
 
         std::mt19937 random;
+        auto const start = std::chrono::steady_clock::now ();
 
-        std::cout << "Allocate checks: ";
+        std::cout << name << '\n' << "Allocate checks: ";
         for (unsigned pass = 0; pass < num_passes; ++pass) {
             std::cout << '.' << std::flush;
             while (blocks.size () < num_allocations) {
@@ -92,15 +119,27 @@ namespace {
         }
         std::cout << std::endl;
 
+        alloc.flush_bins ();
+        auto const fragmentation = alloc.stats ().fragmentation ();
         free_n (blocks.size ());
+        auto const elapsed =
+            std::chrono::duration<double> (std::chrono::steady_clock::now () - start);
+        if (recorder) {
+            alloc.set_trace (nullptr);
+            recorder->flush ();
+            std::cerr << "Trace: " << recorder->num_records () << " records.\n";
+        }
 
+        alloc.flush_bins ();
         alloc.dump (std::cout);
         assert (alloc.num_allocs () == 0);
+        std::cout << name << ": " << storage.granted () << " bytes of storage, fragmentation "
+                  << fragmentation << ", " << elapsed.count () << " s\n\n";
     }
 
 } // end anonymous namespace
 
-int main () {
+int main (int argc, char ** argv) {
     int exit_code = EXIT_SUCCESS;
     try {
         constexpr auto num_passes = 16U;
@@ -108,7 +147,18 @@ int main () {
         constexpr auto max_allocation_size = std::size_t{256};
         constexpr auto storage_block_size = std::size_t{32768};
 
-        stress (num_passes, num_allocations, max_allocation_size, storage_block_size);
+        // An optional argument names a file to which a trace of the allocator's calls is written.
+        // The trace is taken with the default placement policy.
+        std::ofstream trace;
+        if (argc > 1) {
+            trace.open (argv[1], std::ios::binary | std::ios::trunc);
+        }
+        stress<best_fit> ("Best fit", num_passes, num_allocations, max_allocation_size,
+                          storage_block_size, argc > 1 ? &trace : nullptr);
+        stress<first_fit> ("First fit", num_passes, num_allocations, max_allocation_size,
+                           storage_block_size, nullptr);
+        stress<next_fit> ("Next fit", num_passes, num_allocations, max_allocation_size,
+                          storage_block_size, nullptr);
     } catch (std::exception const & ex) {
         std::cerr << "Error: " << ex.what () << '\n';
         exit_code = EXIT_FAILURE;
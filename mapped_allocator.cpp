@@ -0,0 +1,363 @@
+#include "mapped_allocator.hpp"
+
+#include <algorithm>
+#include <limits>
+
+namespace extalloc {
+
+    /// The start of the metadata. It is followed by the allocated records (capacity entries),
+    /// then the free records (capacity + 1 entries), and then the free records again in size
+    /// order (capacity + 1 entries). Free blocks are always separated by allocations, so there
+    /// can be at most one more free block than there are allocations.
+    struct mapped_allocator::header {
+        static constexpr std::uint64_t expected_signature = 0x4d4c4c4154584521; // "!EXTALLM"
+        /// Version 2 added the size index.
+        static constexpr std::uint32_t current_version = 2;
+
+        std::uint64_t signature;
+        std::uint32_t version;
+        std::uint32_t record_size;
+        std::uint64_t capacity;
+        std::uint64_t heap_size;
+        std::uint64_t num_allocs;
+        std::uint64_t num_frees;
+        /// Running totals of the sizes of the allocated and free blocks respectively.
+        std::uint64_t allocated_bytes;
+        std::uint64_t free_bytes;
+        /// The number of entries in the size index. This is always num_frees.
+        std::uint64_t num_sizes;
+
+        record * records () noexcept { return reinterpret_cast<record *> (this + 1); }
+    };
+
+    constexpr std::uint64_t mapped_allocator::header::expected_signature;
+    constexpr std::uint32_t mapped_allocator::header::current_version;
+
+    namespace {
+
+        bool is_zero (void const * p, std::size_t size) noexcept {
+            auto const first = static_cast<std::uint8_t const *> (p);
+            return std::all_of (first, first + size, [](std::uint8_t v) { return v == 0U; });
+        }
+
+    } // end anonymous namespace
+
+    // metadata size [static]
+    // ~~~~~~~~~~~~~
+    std::size_t mapped_allocator::metadata_size (std::size_t capacity) noexcept {
+        return sizeof (header) + (3U * capacity + 2U) * sizeof (record);
+    }
+
+    // ctor
+    // ~~~~
+    mapped_allocator::mapped_allocator (void * metadata, std::size_t metadata_size, address base,
+                                        std::size_t heap_size)
+            : mapped_allocator (open (metadata, metadata_size, heap_size), base) {
+        if (heap_size > header_->heap_size) {
+            // The heap has grown since it was last opened.
+            auto const old_size = header_->heap_size;
+            auto const extra = heap_size - old_size;
+            header_->heap_size = heap_size;
+            header_->free_bytes += extra;
+            this->release (old_size, extra);
+        }
+    }
+
+    mapped_allocator::mapped_allocator (header * h, address base)
+            : header_{h}
+            , base_{base}
+            , allocs_{details::mapped_array<record>{h->records (), &h->num_allocs,
+                                                    static_cast<std::size_t> (h->capacity)}}
+            , frees_{details::mapped_array<record>{h->records () + h->capacity, &h->num_frees,
+                                                   static_cast<std::size_t> (h->capacity + 1U)}}
+            , sizes_{details::mapped_array<record>{h->records () + 2U * h->capacity + 1U,
+                                                   &h->num_sizes,
+                                                   static_cast<std::size_t> (h->capacity + 1U)}} {}
+
+    // open [static]
+    // ~~~~
+    auto mapped_allocator::open (void * metadata, std::size_t metadata_size,
+                                 std::size_t heap_size) -> header * {
+        if (reinterpret_cast<std::uintptr_t> (metadata) % alignof (header) != 0U) {
+            throw std::invalid_argument ("mapped_allocator metadata is not aligned");
+        }
+        if (metadata_size < mapped_allocator::metadata_size (1U)) {
+            throw bad_metadata ("mapped_allocator metadata is too small");
+        }
+        auto const h = static_cast<header *> (metadata);
+        if (is_zero (h, sizeof (header))) {
+            // Format a new heap. Initially it is a single free block.
+            h->signature = header::expected_signature;
+            h->version = header::current_version;
+            h->record_size = sizeof (record);
+            h->capacity = (metadata_size - sizeof (header) - 2U * sizeof (record)) /
+                          (3U * sizeof (record));
+            h->heap_size = 0;
+            h->num_allocs = 0;
+            h->num_frees = 0;
+            h->allocated_bytes = 0;
+            h->free_bytes = 0;
+            h->num_sizes = 0;
+            return h;
+        }
+
+        if (h->signature != header::expected_signature) {
+            throw bad_metadata ("mapped_allocator metadata signature is not valid");
+        }
+        if (h->version != header::current_version || h->record_size != sizeof (record)) {
+            throw bad_metadata ("mapped_allocator metadata version is not supported");
+        }
+        auto const max_capacity = (std::numeric_limits<std::size_t>::max () - sizeof (header)) /
+                                  (3U * sizeof (record)) - 1U;
+        if (h->capacity == 0U || h->capacity > max_capacity ||
+            mapped_allocator::metadata_size (static_cast<std::size_t> (h->capacity)) >
+                metadata_size) {
+            throw bad_metadata ("mapped_allocator metadata is truncated");
+        }
+        if (h->heap_size > heap_size || h->num_allocs > h->capacity ||
+            h->num_frees > h->capacity + 1U || h->num_sizes != h->num_frees ||
+            h->allocated_bytes + h->free_bytes != h->heap_size) {
+            throw bad_metadata ("mapped_allocator metadata is inconsistent");
+        }
+        return h;
+    }
+
+    // allocate
+    // ~~~~~~~~
+    auto mapped_allocator::allocate (std::size_t size, std::size_t alignment) -> address {
+        if (alignment == 0U || (alignment & (alignment - 1U)) != 0U) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        size = std::max (size, std::size_t{1});
+        if (allocs_.size () >= allocs_.capacity ()) {
+            return nullptr;
+        }
+
+        // Find the smallest free block that will satisfy the request. The lowest of several
+        // equally good blocks is preferred. The size index is in that order, so the search starts
+        // at the first block which is large enough and, unless alignment padding gets in the
+        // way, ends there too.
+        auto slack_of = [this, alignment](record const & r) {
+            auto const a = reinterpret_cast<std::uintptr_t> (base_ + r.offset);
+            return static_cast<std::uint64_t> (((a + (alignment - 1U)) & ~(alignment - 1U)) - a);
+        };
+        auto fits = [&slack_of, size](record const & r) {
+            auto const slack = slack_of (r);
+            return r.size >= slack && r.size - slack >= size;
+        };
+        auto fit = sizes_.lower_bound (record{0U, size});
+        while (fit != sizes_.end () && !fits (*fit)) {
+            ++fit;
+        }
+        if (fit == sizes_.end ()) {
+            return nullptr;
+        }
+
+        auto const best = frees_.find (fit->offset);
+        auto const slack = slack_of (*best);
+        auto const offset = best->offset + slack;
+        auto const remaining = best->size - slack - size;
+        if (slack > 0U) {
+            // Any space skipped to reach the required alignment remains free.
+            this->replace_free (best, record{best->offset, slack});
+            if (remaining > 0U) {
+                this->insert_free (std::next (best), record{offset + size, remaining});
+            }
+        } else if (remaining > 0U) {
+            // Split this block. Its position in the sorted records does not change.
+            this->replace_free (best, record{offset + size, remaining});
+        } else {
+            this->erase_free (best);
+        }
+
+        allocs_.insert (record{offset, size});
+        header_->allocated_bytes += size;
+        header_->free_bytes -= size;
+        return base_ + offset;
+    }
+
+    // free
+    // ~~~~
+    void mapped_allocator::free (address ptr) {
+        auto const pos = allocs_.find (static_cast<std::uint64_t> (ptr - base_));
+        if (pos == allocs_.end ()) {
+            throw no_allocation ();
+        }
+        auto const r = *pos;
+        allocs_.erase (pos);
+        header_->allocated_bytes -= r.size;
+        header_->free_bytes += r.size;
+        this->release (r.offset, r.size);
+    }
+
+    // realloc
+    // ~~~~~~~
+    auto mapped_allocator::realloc (address ptr, std::size_t new_size, std::size_t alignment)
+        -> address {
+        if (alignment == 0U || (alignment & (alignment - 1U)) != 0U) {
+            throw std::invalid_argument ("alignment must be a power of two");
+        }
+        new_size = std::max (new_size, std::size_t{1});
+        auto const pos = allocs_.find (static_cast<std::uint64_t> (ptr - base_));
+        if (pos == allocs_.end ()) {
+            throw no_allocation ();
+        }
+        auto const old_size = pos->size;
+        auto const aligned = (reinterpret_cast<std::uintptr_t> (ptr) & (alignment - 1U)) == 0U;
+        if (aligned && new_size == old_size) {
+            return ptr;
+        }
+
+        auto const end = pos->offset + old_size;
+        auto const next = frees_.lower_bound (end);
+        bool const has_next = next != frees_.end () && next->offset == end;
+        if (aligned && new_size < old_size) {
+            auto const reduction = old_size - new_size;
+            if (has_next) {
+                this->replace_free (next, record{next->offset - reduction, next->size + reduction});
+            } else {
+                this->insert_free (next, record{end - reduction, reduction});
+            }
+            pos->size = new_size;
+            header_->allocated_bytes -= reduction;
+            header_->free_bytes += reduction;
+            return ptr;
+        }
+        if (aligned && has_next && next->size >= new_size - old_size) {
+            // Grow into the free space immediately following.
+            auto const extra = new_size - old_size;
+            if (next->size > extra) {
+                this->replace_free (next, record{next->offset + extra, next->size - extra});
+            } else {
+                this->erase_free (next);
+            }
+            pos->size = new_size;
+            header_->allocated_bytes += extra;
+            header_->free_bytes -= extra;
+            return ptr;
+        }
+
+        // The block must move.
+        auto const new_ptr = this->allocate (new_size, alignment);
+        if (new_ptr != nullptr) {
+            std::memcpy (new_ptr, ptr, static_cast<std::size_t> (std::min (old_size, new_size)));
+            this->free (ptr);
+        }
+        return new_ptr;
+    }
+
+    // release
+    // ~~~~~~~
+    void mapped_allocator::release (std::uint64_t offset, std::uint64_t size) {
+        auto next = frees_.lower_bound (offset);
+        if (next != frees_.begin ()) {
+            auto const prev = std::prev (next);
+            if (prev->offset + prev->size == offset) {
+                // Merge with the preceding free block and, perhaps, the following one too.
+                auto merged = prev->size + size;
+                if (next != frees_.end () && next->offset == offset + size) {
+                    merged += next->size;
+                    this->erase_free (next);
+                }
+                this->replace_free (prev, record{prev->offset, merged});
+                return;
+            }
+        }
+        if (next != frees_.end () && next->offset == offset + size) {
+            this->replace_free (next, record{offset, size + next->size});
+            return;
+        }
+        this->insert_free (next, record{offset, size});
+    }
+
+    // insert free
+    // ~~~~~~~~~~~
+    void mapped_allocator::insert_free (table::const_iterator hint, record const & r) {
+        frees_.insert (hint, r);
+        sizes_.insert (r);
+    }
+
+    // erase free
+    // ~~~~~~~~~~
+    auto mapped_allocator::erase_free (table::iterator pos) -> table::iterator {
+        sizes_.erase (*pos);
+        return frees_.erase (pos);
+    }
+
+    // replace free
+    // ~~~~~~~~~~~~
+    void mapped_allocator::replace_free (table::iterator pos, record const & r) {
+        sizes_.replace (sizes_.find (*pos), r);
+        *pos = r;
+    }
+
+    // check
+    // ~~~~~
+    bool mapped_allocator::check () const {
+        // The allocated and free blocks must exactly tile the heap and no two free blocks may be
+        // adjacent.
+        auto a = allocs_.begin ();
+        auto f = frees_.begin ();
+        std::uint64_t offset = 0;
+        std::uint64_t allocated = 0;
+        std::uint64_t free = 0;
+        bool last_was_free = false;
+        while (a != allocs_.end () || f != frees_.end ()) {
+            if (f != frees_.end () && f->offset == offset) {
+                if (last_was_free || f->size == 0U) {
+                    return false;
+                }
+                offset += f->size;
+                free += f->size;
+                ++f;
+                last_was_free = true;
+            } else if (a != allocs_.end () && a->offset == offset) {
+                if (a->size == 0U) {
+                    return false;
+                }
+                offset += a->size;
+                allocated += a->size;
+                ++a;
+                last_was_free = false;
+            } else {
+                return false;
+            }
+        }
+        if (offset != header_->heap_size || allocated != header_->allocated_bytes ||
+            free != header_->free_bytes) {
+            return false;
+        }
+
+        // The size index must hold exactly the free blocks, in size order.
+        if (sizes_.size () != frees_.size () ||
+            std::adjacent_find (sizes_.begin (), sizes_.end (), [](record const & a,
+                                                                   record const & b) {
+                return !by_size{}(a, b);
+            }) != sizes_.end ()) {
+            return false;
+        }
+        return std::all_of (frees_.begin (), frees_.end (), [this](record const & r) {
+            auto const pos = sizes_.find (r);
+            return pos != sizes_.end () && pos->offset == r.offset && pos->size == r.size;
+        });
+    }
+
+    // heap size
+    // ~~~~~~~~~
+    std::size_t mapped_allocator::heap_size () const noexcept {
+        return static_cast<std::size_t> (header_->heap_size);
+    }
+
+    // allocated space
+    // ~~~~~~~~~~~~~~~
+    std::size_t mapped_allocator::allocated_space () const noexcept {
+        return static_cast<std::size_t> (header_->allocated_bytes);
+    }
+
+    // free space
+    // ~~~~~~~~~~
+    std::size_t mapped_allocator::free_space () const noexcept {
+        return static_cast<std::size_t> (header_->free_bytes);
+    }
+
+} // end namespace extalloc
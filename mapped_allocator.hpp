@@ -0,0 +1,217 @@
+#ifndef EXTALLOC_MAPPED_ALLOCATOR_HPP
+#define EXTALLOC_MAPPED_ALLOCATOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <iterator>
+#include <stdexcept>
+#include <type_traits>
+
+#include "allocator.hpp"
+#include "flat_map.hpp"
+
+namespace extalloc {
+
+    namespace details {
+
+        /// A sequence with the interface of std::vector<> whose elements live in storage owned by
+        /// someone else: typically a memory-mapped file. The element count is also held in that
+        /// storage so the sequence can be reopened without being rebuilt. The capacity is fixed.
+        template <typename T>
+        class mapped_array {
+            static_assert (std::is_trivially_copyable<T>::value,
+                           "mapped_array elements are moved with memmove");
+
+        public:
+            using value_type = T;
+            using size_type = std::size_t;
+            using difference_type = std::ptrdiff_t;
+            using reference = T &;
+            using const_reference = T const &;
+            using iterator = T *;
+            using const_iterator = T const *;
+            using reverse_iterator = std::reverse_iterator<iterator>;
+            using const_reverse_iterator = std::reverse_iterator<const_iterator>;
+
+            /// \param data  Storage for \p capacity elements.
+            /// \param size  The location of the element count.
+            mapped_array (T * data, std::uint64_t * size, std::size_t capacity) noexcept
+                    : data_{data}
+                    , size_{size}
+                    , capacity_{capacity} {}
+
+            iterator begin () noexcept { return data_; }
+            const_iterator begin () const noexcept { return data_; }
+            const_iterator cbegin () const noexcept { return data_; }
+            iterator end () noexcept { return data_ + *size_; }
+            const_iterator end () const noexcept { return data_ + *size_; }
+            const_iterator cend () const noexcept { return data_ + *size_; }
+            reverse_iterator rbegin () noexcept { return reverse_iterator{this->end ()}; }
+            const_reverse_iterator rbegin () const noexcept {
+                return const_reverse_iterator{this->end ()};
+            }
+            reverse_iterator rend () noexcept { return reverse_iterator{this->begin ()}; }
+            const_reverse_iterator rend () const noexcept {
+                return const_reverse_iterator{this->begin ()};
+            }
+
+            bool empty () const noexcept { return *size_ == 0U; }
+            size_type size () const noexcept { return static_cast<size_type> (*size_); }
+            size_type capacity () const noexcept { return capacity_; }
+            void reserve (size_type n) const {
+                if (n > capacity_) {
+                    throw std::length_error ("mapped_array capacity exceeded");
+                }
+            }
+            void clear () noexcept { *size_ = 0U; }
+
+            iterator insert (const_iterator pos, T const & v) {
+                this->reserve (this->size () + 1U);
+                auto const p = data_ + (pos - data_);
+                std::memmove (p + 1, p, static_cast<std::size_t> (this->end () - p) * sizeof (T));
+                *p = v;
+                ++*size_;
+                return p;
+            }
+            iterator erase (const_iterator pos) { return this->erase (pos, pos + 1); }
+            iterator erase (const_iterator first, const_iterator last) {
+                auto const p = data_ + (first - data_);
+                auto const tail = static_cast<std::size_t> (this->end () - last);
+                std::memmove (p, last, tail * sizeof (T));
+                *size_ -= static_cast<std::uint64_t> (last - first);
+                return p;
+            }
+
+        private:
+            T * data_;
+            std::uint64_t * size_;
+            std::size_t capacity_;
+        };
+
+    } // end namespace details
+
+    /// An allocator whose metadata lives entirely in a caller-supplied block of memory, which is
+    /// normally a memory-mapped file. Blocks are recorded as offsets from the base of the heap
+    /// rather than as pointers, so the heap and its metadata may be mapped at a different
+    /// address each time they are opened. Opening an existing heap only validates the metadata's
+    /// header; allocate(), free(), and realloc() update the mapped records directly.
+    ///
+    /// The allocated and free blocks are held in sorted arrays, and the free blocks are held a
+    /// second time sorted by size. Lookups are a binary search, as is the search of the size
+    /// index for the best fit, but insertion and erasure move the records which follow. The
+    /// number of allocations is limited by the size of the metadata.
+    class mapped_allocator {
+    public:
+        using address = std::uint8_t *;
+
+        /// A block of the heap.
+        struct record {
+            /// The offset of the block from the base of the heap.
+            std::uint64_t offset;
+            std::uint64_t size;
+        };
+
+        /// Returns the number of bytes of metadata needed to track up to \p capacity allocations.
+        static std::size_t metadata_size (std::size_t capacity) noexcept;
+
+        /// If \p metadata is all zero, a new heap covering \p heap_size bytes at \p base is
+        /// created within it. Otherwise it must hold the metadata of an existing heap. If
+        /// \p heap_size is larger than the heap recorded in the metadata, the additional space
+        /// is added to it.
+        ///
+        /// \param metadata  The memory which holds the allocator's metadata. It must be aligned
+        ///   for std::uint64_t and must remain valid for the lifetime of the allocator.
+        /// \param metadata_size  The number of bytes at \p metadata. This determines the capacity
+        ///   of a new heap.
+        /// \param base  The address of the heap.
+        /// \param heap_size  The number of bytes at \p base.
+        /// \throws bad_metadata  If \p metadata does not describe a heap which fits within
+        ///   \p metadata_size and \p heap_size bytes.
+        mapped_allocator (void * metadata, std::size_t metadata_size, address base,
+                          std::size_t heap_size);
+        mapped_allocator (mapped_allocator const &) = delete;
+        mapped_allocator (mapped_allocator &&) noexcept = default;
+
+        ~mapped_allocator () noexcept = default;
+
+        mapped_allocator & operator= (mapped_allocator const &) = delete;
+        mapped_allocator & operator= (mapped_allocator &&) noexcept = default;
+
+        /// Allocates a block of at least \p size bytes.
+        ///
+        /// \param size  The number of bytes required.
+        /// \param alignment  The required alignment of the block. Must be a power of two.
+        /// \returns  The address of the new block or nullptr if there is no free block large
+        ///   enough or the metadata is full.
+        address allocate (std::size_t size, std::size_t alignment = 1);
+        void free (address ptr);
+        /// Changes the size of the block at \p ptr. A block which grows takes the free space
+        /// immediately following it if that is large enough; otherwise it is moved.
+        ///
+        /// \returns  The address of the resized block or nullptr if it could not be grown, in
+        ///   which case the original block is untouched.
+        address realloc (address ptr, std::size_t new_size, std::size_t alignment = 1);
+
+        bool check () const;
+
+        address base () const noexcept { return base_; }
+        std::size_t heap_size () const noexcept;
+        /// The maximum number of allocations.
+        std::size_t capacity () const noexcept { return allocs_.capacity (); }
+
+        std::size_t num_allocs () const noexcept { return allocs_.size (); }
+        std::size_t num_frees () const noexcept { return frees_.size (); }
+        std::size_t allocated_space () const noexcept;
+        std::size_t free_space () const noexcept;
+
+        record const * allocs_begin () const noexcept { return allocs_.begin (); }
+        record const * allocs_end () const noexcept { return allocs_.end (); }
+        record const * frees_begin () const noexcept { return frees_.begin (); }
+        record const * frees_end () const noexcept { return frees_.end (); }
+
+    private:
+        struct header;
+
+        struct offset_of {
+            std::uint64_t const & operator() (record const & r) const noexcept {
+                return r.offset;
+            }
+        };
+        using table = details::flat_tree<std::uint64_t, record, offset_of,
+                                         std::less<std::uint64_t>, details::mapped_array<record>>;
+
+        /// Orders records by size and then by offset.
+        struct by_size {
+            bool operator() (record const & a, record const & b) const noexcept {
+                return a.size < b.size || (a.size == b.size && a.offset < b.offset);
+            }
+        };
+        using size_index = details::flat_tree<record, record, details::identity_key<record>,
+                                              by_size, details::mapped_array<record>>;
+
+        mapped_allocator (header * h, address base);
+
+        /// Validates the header of an existing heap, or formats a new one.
+        static header * open (void * metadata, std::size_t metadata_size, std::size_t heap_size);
+
+        /// Adds a block to the free records, merging it with any free neighbours.
+        void release (std::uint64_t offset, std::uint64_t size);
+
+        /// Each of these changes the free records and the size index together.
+        void insert_free (table::const_iterator hint, record const & r);
+        table::iterator erase_free (table::iterator pos);
+        void replace_free (table::iterator pos, record const & r);
+
+        header * header_;
+        address base_;
+        table allocs_;
+        table frees_;
+        /// The free blocks ordered by size.
+        size_index sizes_;
+    };
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_MAPPED_ALLOCATOR_HPP
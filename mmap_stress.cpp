@@ -1,10 +1,13 @@
 #include <algorithm>
 #include <cassert>
+#include <cerrno>
+#include <cstdio>
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
 #include <memory>
 #include <random>
+#include <string>
 #include <system_error>
 
 #include <fcntl.h>
@@ -17,6 +20,8 @@
 #include <sys/stat.h>
 
 #include "allocator.hpp"
+#include "journal.hpp"
+#include "storage.hpp"
 
 using namespace extalloc;
 
@@ -28,7 +33,11 @@ namespace {
                 : std::runtime_error{"bad allocation contents"} {}
     };
 
-    using blocks_type = std::map<allocator::address, std::pair<std::size_t, std::uint8_t>>;
+    /// The store is a single file mapping, so the allocator is given no storage beyond it.
+    using store_allocator = storage_allocator<no_storage>;
+    using address = store_allocator::address;
+
+    using blocks_type = std::map<address, std::pair<std::size_t, std::uint8_t>>;
 
     bool block_content_okay (blocks_type::value_type const & vt) {
         auto const addr = vt.first;
@@ -38,21 +47,22 @@ namespace {
         return std::find_if (addr, end, [value](std::uint8_t v) { return v != value; }) == end;
     }
 
-    bool blocks_okay (blocks_type const & blocks, allocator & alloc) {
+    bool blocks_okay (blocks_type const & blocks, store_allocator & alloc) {
         if (blocks.size () != alloc.num_allocs ()) {
             return false;
         }
 
-        if (!std::equal (
-                std::begin (blocks), std::end (blocks), alloc.allocs_begin (),
-                [](blocks_type::value_type const & v1,
-                   allocator::container::value_type const & v2) { return v1.first == v2.first; })) {
+        if (!std::equal (std::begin (blocks), std::end (blocks), alloc.allocs_begin (),
+                         [](blocks_type::value_type const & v1,
+                            store_allocator::container::value_type const & v2) {
+                             return v1.first == v2.first;
+                         })) {
             return false;
         }
 
         if (!std::equal (std::begin (blocks), std::end (blocks), alloc.allocs_begin (),
                          [](blocks_type::value_type const & v1,
-                            allocator::container::value_type const & v2) {
+                            store_allocator::container::value_type const & v2) {
                              return std::get<0> (v1.second) <= v2.second;
                          })) {
             return false;
@@ -64,7 +74,7 @@ namespace {
     }
 
 
-    void free_n (std::mt19937 & random, blocks_type * const blocks, allocator * const alloc) {
+    void free_n (std::mt19937 & random, blocks_type * const blocks, store_allocator * const alloc) {
         if (blocks->size () == 0) {
             return;
         }
@@ -96,7 +106,7 @@ namespace {
 
     void allocate_test (unsigned num_passes, unsigned num_allocations,
                         std::size_t max_allocation_size, std::mt19937 & random,
-                        blocks_type & blocks, allocator * const alloc) {
+                        blocks_type & blocks, store_allocator * const alloc) {
         std::cout << "Allocate checks: ";
 
         for (auto pass = 0U; pass < num_passes; ++pass) {
@@ -124,7 +134,7 @@ namespace {
 
     void realloc_test (unsigned num_passes, unsigned num_allocations,
                        std::size_t max_allocation_size, std::mt19937 & random, blocks_type & blocks,
-                       allocator * const alloc) {
+                       store_allocator * const alloc) {
         std::cout << "Realloc checks: ";
 
         // Now the same again but doing a realloc on the block immediately after it has been
@@ -173,17 +183,49 @@ namespace {
         }
     }
 
-    std::unique_ptr<std::uint8_t, deleter> memory_map (int fd, std::size_t mapped_size) {
-        auto mptr =
-            static_cast<std::uint8_t *> (mmap (nullptr, mapped_size, PROT_READ | PROT_WRITE,
-                                               MAP_FILE | MAP_SHARED, fd, off_t{0} /*offset*/));
-        if (mptr == MAP_FAILED) {
+    /// Maps the first \p mapped_size bytes of a file. Address space for \p reserved_size bytes is
+    /// set aside so that the mapping can later be extended in place by map_more().
+    std::unique_ptr<std::uint8_t, deleter> memory_map (int fd, std::size_t mapped_size,
+                                                       std::size_t reserved_size) {
+        auto const reserved = mmap (nullptr, reserved_size, PROT_NONE,
+                                    MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, off_t{0});
+        if (reserved == MAP_FAILED) {
             throw std::system_error{errno, std::generic_category ()};
         }
-        return {mptr, deleter{mapped_size}};
+        std::unique_ptr<std::uint8_t, deleter> result{static_cast<std::uint8_t *> (reserved),
+                                                      deleter{reserved_size}};
+        if (mmap (reserved, mapped_size, PROT_READ | PROT_WRITE, MAP_FILE | MAP_SHARED | MAP_FIXED,
+                  fd, off_t{0} /*offset*/) == MAP_FAILED) {
+            throw std::system_error{errno, std::generic_category ()};
+        }
+        return result;
+    }
+
+    /// Lengthens the file and maps the new bytes immediately after the existing mapping of
+    /// \p size bytes at \p base.
+    /// \returns  True on success.
+    bool map_more (int fd, std::uint8_t * base, std::size_t size, std::size_t new_size) {
+        if (ftruncate (fd, static_cast<off_t> (new_size)) != 0) {
+            return false;
+        }
+        if (mmap (base + size, new_size - size, PROT_READ | PROT_WRITE,
+                  MAP_FILE | MAP_SHARED | MAP_FIXED, fd, static_cast<off_t> (size)) == MAP_FAILED) {
+            // Put the file back as it was.
+            static_cast<void> (ftruncate (fd, static_cast<off_t> (size)));
+            return false;
+        }
+        return true;
     }
 
 
+    std::size_t file_size (int fd) {
+        struct stat stat_buf;
+        if (fstat (fd, &stat_buf) != 0) {
+            throw std::system_error{errno, std::generic_category ()};
+        }
+        return static_cast<std::size_t> (stat_buf.st_size);
+    }
+
     bool file_is_available (char const * path) {
         struct stat stat_buf;
         if (stat (path, &stat_buf) == 0) {
@@ -224,20 +266,44 @@ namespace {
         save_blocks (file, blocks, base);
     }
 
-    void save_allocs (char const * file_path, allocator const & alloc, std::uint8_t * base) {
-        std::ofstream allocs_file{file_path, std::ios::binary | std::ios::trunc};
-        alloc.save (allocs_file, base);
+    /// Writes a snapshot of the allocator's metadata followed by its generation number. The
+    /// snapshot replaces the old one only once it is complete.
+    void save_allocs (char const * file_path, store_allocator const & alloc, std::uint8_t * base,
+                      std::uint64_t generation) {
+        auto const temp_path = std::string{file_path} + ".tmp";
+        {
+            std::ofstream allocs_file{temp_path, std::ios::binary | std::ios::trunc};
+            alloc.save (allocs_file, base);
+            write (allocs_file, generation);
+        }
+        if (std::rename (temp_path.c_str (), file_path) != 0) {
+            throw std::system_error{errno, std::generic_category ()};
+        }
+    }
+
+    /// Loads a snapshot written by save_allocs().
+    /// \returns  The snapshot's generation number. This is 0 for a snapshot written without one.
+    std::uint64_t load_allocs (char const * file_path, store_allocator & alloc,
+                               std::uint8_t * base) {
+        std::ifstream allocs_file (file_path, std::ios::binary);
+        alloc.load (allocs_file, base);
+        auto const generation = read<std::uint64_t> (allocs_file);
+        return allocs_file ? generation : 0U;
     }
 
     void mmap_stress () {
         constexpr auto alloc_persist = "./map.alloc";
+        constexpr auto journal_persist = "./map.journal";
         constexpr auto store_persist = "./store.alloc";
         constexpr auto blocks_persist = "./blocks.alloc";
 
-        constexpr auto mapped_size = std::size_t{1024} * std::size_t{1024};
+        constexpr auto initial_size = std::size_t{1024} * std::size_t{1024};
+        constexpr auto reserved_size = std::size_t{1024} * initial_size;
         constexpr auto num_passes = 16U;
         constexpr auto max_allocation_size = std::size_t{256};
-        constexpr auto num_allocations = mapped_size / max_allocation_size;
+        constexpr auto num_allocations = initial_size / max_allocation_size;
+        constexpr auto journal_group_size = std::size_t{1024};
+        constexpr auto compact_budget = std::size_t{64} * std::size_t{1024};
 
 
 
@@ -245,21 +311,68 @@ namespace {
         if (fd == -1) {
             throw std::system_error{errno, std::generic_category ()};
         }
-        if (ftruncate (fd, mapped_size) != 0) {
+        // The store may have been grown by an earlier run.
+        auto const mapped_size = std::max (file_size (fd), initial_size);
+        if (ftruncate (fd, static_cast<off_t> (mapped_size)) != 0) {
             throw std::system_error{errno, std::generic_category ()};
         }
 
-        auto backing_ptr = memory_map (fd, mapped_size);
-        allocator alloc{[](std::size_t /*size*/) {
-                            return std::pair<std::uint8_t *, std::size_t> (nullptr, 0);
-                        },
-                        std::make_pair (backing_ptr.get (), mapped_size)};
+        auto backing_ptr = memory_map (fd, mapped_size, reserved_size);
+        auto current_size = mapped_size;
+        store_allocator alloc{no_storage{}, std::make_pair (backing_ptr.get (), mapped_size)};
+
+        // The store is a single file mapping which can't be given back, but the pages of its free
+        // blocks needn't stay resident.
+        alloc.set_release_storage (
+            [](address addr, std::size_t size, release_kind kind) {
+                return kind == release_kind::pages && madvise (addr, size, MADV_DONTNEED) == 0;
+            });
+
+        auto const page_size = static_cast<std::size_t> (sysconf (_SC_PAGESIZE));
+        // Rather than failing when the store is full, lengthen the file and grow the mapping into
+        // the reserved address space. The mapping must not move because the allocator holds
+        // addresses within it.
+        alloc.set_extend_storage ([fd, page_size, &current_size](address addr,
+                                                                 std::size_t size,
+                                                                 std::size_t additional) {
+            auto const new_size = (size + additional + page_size - 1U) & ~(page_size - 1U);
+            if (new_size > reserved_size || !map_more (fd, addr, size, new_size)) {
+                return std::size_t{0};
+            }
+            current_size = new_size;
+            return new_size - size;
+        });
 
+        // Recover the metadata: the last snapshot plus any changes recorded in the journal since
+        // it was taken. If there were any, fold them into a new snapshot.
+        std::uint64_t generation = 0;
         if (file_is_available (alloc_persist)) {
-            std::ifstream file (alloc_persist, std::ios::binary);
-            alloc.load (file, backing_ptr.get ());
+            generation = load_allocs (alloc_persist, alloc, backing_ptr.get ());
+        }
+        if (file_is_available (journal_persist)) {
+            std::ifstream file (journal_persist, std::ios::binary);
+            auto const replayed = journal::replay (file, generation, backing_ptr.get (), alloc);
+            std::cout << "Journal: replayed " << replayed << " records.\n";
+            if (replayed > 0U) {
+                save_allocs (alloc_persist, alloc, backing_ptr.get (), ++generation);
+            }
         }
 
+        // Record each change in a new journal. Every group of records is made durable, along
+        // with the contents of the store, before the next is written.
+        std::ofstream journal_file{journal_persist, std::ios::binary | std::ios::trunc};
+        int const journal_fd = open (journal_persist, O_WRONLY);
+        if (journal_fd == -1) {
+            throw std::system_error{errno, std::generic_category ()};
+        }
+        journal log{journal_file, backing_ptr.get (), generation,
+                    [&backing_ptr, &current_size, journal_fd]() {
+                        msync (backing_ptr.get (), current_size, MS_SYNC);
+                        fsync (journal_fd);
+                    },
+                    journal_group_size};
+        alloc.set_journal (log.recorder ());
+
         blocks_type blocks;
 
         if (file_is_available (blocks_persist)) {
@@ -271,9 +384,7 @@ namespace {
         }
 
 
-        std::cout << "On start: " << alloc.allocated_space () << " allocated bytes ("
-                  << alloc.num_allocs () << " allocations), " << alloc.free_space ()
-                  << " free bytes (" << alloc.num_frees () << " blocks).\n";
+        std::cout << "On start: " << alloc.stats ();
 
         std::mt19937 random;
 
@@ -295,8 +406,48 @@ namespace {
             }
         }
 
-        save_allocs (alloc_persist, alloc, backing_ptr.get ());
+        // Gather the free space scattered between the remaining blocks, a slice at a time as a
+        // long-running program would, keeping our record of the blocks in step. The blocks were
+        // allocated without alignment, so they may be packed tightly.
+        auto const frees_before = alloc.num_frees ();
+        auto const fragmentation = alloc.stats ().fragmentation ();
+        auto compactions = 0U;
+        std::size_t compacted = 0;
+        for (;;) {
+            auto const moved = alloc.compact (
+                [&blocks](address from, address to, std::size_t) {
+                    auto const pos = blocks.find (from);
+                    if (pos != std::end (blocks)) {
+                        blocks[to] = pos->second;
+                        blocks.erase (pos);
+                    }
+                },
+                compact_budget, 1);
+            if (moved == 0U) {
+                break;
+            }
+            compacted += moved;
+            ++compactions;
+        }
+        if (!blocks_okay (blocks, alloc)) {
+            throw bad_memory ();
+        }
+        std::cout << "Compact: fragmentation " << fragmentation << "; moved " << compacted
+                  << " bytes in " << compactions << " steps; " << frees_before
+                  << " free blocks became " << alloc.num_frees () << ".\n";
+
+        std::cout << "Trim: offered " << alloc.trim (0, page_size) << " bytes.\n";
+
+        log.commit ();
+        alloc.set_journal (nullptr);
+        std::cout << "Journal: " << log.num_records () << " records in " << log.num_commits ()
+                  << " group commits.\n";
+
+        // Compact the journal by folding it into a new snapshot. The journal's generation no
+        // longer matches, so it will be ignored.
+        save_allocs (alloc_persist, alloc, backing_ptr.get (), ++generation);
         save_blocks (blocks_persist, blocks, backing_ptr.get ());
+        close (journal_fd);
     }
 
 } // end anonymous namespace
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <iomanip>
+#include <iostream>
+#include <list>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "concurrent_allocator.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    class bad_memory : public std::runtime_error {
+    public:
+        bad_memory ()
+                : std::runtime_error{"bad allocation contents"} {}
+    };
+
+    struct result {
+        double ops_per_second;
+        std::size_t remote_frees;
+    };
+
+    /// Runs the workload on \p num_threads threads. Each thread repeatedly replaces one of its own
+    /// live blocks. One replacement in \p exchange_interval is instead swapped into a table shared
+    /// by all of the threads, so that blocks are freed by threads other than those which
+    /// allocated them.
+    result run (unsigned num_threads, unsigned ops_per_thread, unsigned live_blocks,
+                std::size_t max_allocation_size, std::size_t storage_block_size,
+                unsigned exchange_interval) {
+        std::list<std::vector<std::uint8_t>> buffers;
+        concurrent_allocator alloc{[&buffers, storage_block_size](std::size_t size) {
+                                       buffers.emplace_back (std::max (size, storage_block_size));
+                                       auto & buffer = buffers.back ();
+                                       return std::pair<std::uint8_t *, std::size_t>{
+                                           buffer.data (), buffer.size ()};
+                                   },
+                                   num_threads};
+
+        std::vector<std::atomic<allocator::address>> shared (num_threads * 16U);
+        for (auto & s : shared) {
+            s.store (nullptr);
+        }
+
+        auto const worker = [&](unsigned seed) {
+            std::mt19937 random{seed};
+            std::vector<std::pair<allocator::address, std::uint8_t>> blocks (live_blocks);
+            for (unsigned op = 0; op < ops_per_thread; ++op) {
+                auto & block = blocks[random () % blocks.size ()];
+                if (block.first != nullptr) {
+                    if (*block.first != block.second) {
+                        throw bad_memory ();
+                    }
+                    alloc.free (block.first);
+                }
+
+                auto const size = random () % max_allocation_size;
+                auto ptr = alloc.allocate (size);
+                if (ptr == nullptr) {
+                    throw std::bad_alloc ();
+                }
+                block.second = static_cast<std::uint8_t> (random ());
+                std::fill_n (ptr, std::max (size, std::size_t{1}), block.second);
+
+                if (op % exchange_interval == 0U) {
+                    ptr = shared[random () % shared.size ()].exchange (ptr);
+                    if (ptr != nullptr) {
+                        alloc.free (ptr);
+                    }
+                    block.first = nullptr;
+                } else {
+                    block.first = ptr;
+                }
+            }
+            for (auto const & block : blocks) {
+                if (block.first != nullptr) {
+                    alloc.free (block.first);
+                }
+            }
+        };
+
+        auto const start = std::chrono::steady_clock::now ();
+        std::vector<std::exception_ptr> errors (num_threads);
+        std::vector<std::thread> threads;
+        for (auto t = 0U; t < num_threads; ++t) {
+            threads.emplace_back ([&worker, &errors, t]() {
+                try {
+                    worker (t);
+                } catch (...) {
+                    errors[t] = std::current_exception ();
+                }
+            });
+        }
+        for (auto & t : threads) {
+            t.join ();
+        }
+        for (auto const & e : errors) {
+            if (e) {
+                std::rethrow_exception (e);
+            }
+        }
+        auto const elapsed =
+            std::chrono::duration<double> (std::chrono::steady_clock::now () - start);
+
+        for (auto & s : shared) {
+            if (auto const ptr = s.exchange (nullptr)) {
+                alloc.free (ptr);
+            }
+        }
+        alloc.drain ();
+        if (alloc.num_allocs () != 0U || !alloc.check ()) {
+            throw bad_memory ();
+        }
+
+        // Each op is a free and an allocation.
+        auto const ops = 2.0 * num_threads * ops_per_thread;
+        return {ops / elapsed.count (), alloc.remote_frees ()};
+    }
+
+} // end anonymous namespace
+
+int main (int argc, char ** argv) {
+    int exit_code = EXIT_SUCCESS;
+    try {
+        constexpr auto ops_per_thread = 200000U;
+        constexpr auto live_blocks = 1000U;
+        constexpr auto max_allocation_size = std::size_t{256};
+        constexpr auto storage_block_size = std::size_t{1024 * 1024};
+        constexpr auto exchange_interval = 16U;
+
+        auto max_threads = std::max (std::thread::hardware_concurrency (), 1U);
+        if (argc > 1) {
+            max_threads = static_cast<unsigned> (std::stoul (argv[1]));
+        }
+
+        std::cout << "threads,ops/sec,speedup,remote frees\n";
+        double base = 0.0;
+        for (auto num_threads = 1U; num_threads <= max_threads; ++num_threads) {
+            auto const r = run (num_threads, ops_per_thread, live_blocks, max_allocation_size,
+                                storage_block_size, exchange_interval);
+            if (num_threads == 1U) {
+                base = r.ops_per_second;
+            }
+            std::cout << num_threads << ',' << std::fixed << std::setprecision (0)
+                      << r.ops_per_second << ',' << std::setprecision (2)
+                      << r.ops_per_second / base << ',' << r.remote_frees << '\n';
+        }
+    } catch (std::exception const & ex) {
+        std::cerr << "Error: " << ex.what () << '\n';
+        exit_code = EXIT_FAILURE;
+    } catch (...) {
+        std::cerr << "Unknown error\n";
+        exit_code = EXIT_FAILURE;
+    }
+    return exit_code;
+}
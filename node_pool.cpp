@@ -0,0 +1,89 @@
+#include "node_pool.hpp"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdint>
+
+namespace extalloc {
+
+    constexpr std::size_t node_pool::min_slab_chunks;
+    constexpr std::size_t node_pool::header_size;
+
+    // dtor
+    // ~~~~
+    node_pool::~node_pool () noexcept {
+        assert (in_use_ == 0U);
+        while (slab_list_ != nullptr) {
+            slab * const next = slab_list_->next;
+            ::operator delete (slab_list_);
+            slab_list_ = next;
+        }
+    }
+
+    // allocate
+    // ~~~~~~~~
+    void * node_pool::allocate (std::size_t size, std::size_t alignment) {
+        if (chunk_size_ == 0U) {
+            // The first allocation fixes the chunk size. Each chunk must be large enough to hold a
+            // free-list link and be aligned for both the link and the caller's type.
+            auto const align = std::max (alignment, alignof (chunk));
+            node_size_ = size;
+            chunk_size_ = (std::max (size, sizeof (chunk)) + align - 1U) & ~(align - 1U);
+        }
+        if (!this->is_pooled (size, alignment)) {
+            return ::operator new (size);
+        }
+
+        if (free_ == nullptr) {
+            this->grow ();
+        }
+        chunk * const result = free_;
+        free_ = result->next;
+        ++in_use_;
+        return result;
+    }
+
+    // deallocate
+    // ~~~~~~~~~~
+    void node_pool::deallocate (void * p, std::size_t size, std::size_t alignment) noexcept {
+        if (p == nullptr) {
+            return;
+        }
+        // An over-aligned request of the pool's size came from the heap and must go back there.
+        if (!this->is_pooled (size, alignment)) {
+            ::operator delete (p);
+            return;
+        }
+        assert (in_use_ > 0U);
+        auto * const c = static_cast<chunk *> (p);
+        c->next = free_;
+        free_ = c;
+        --in_use_;
+    }
+
+    // grow
+    // ~~~~
+    void node_pool::grow () {
+        // The first slab is sized by the caller's hint. After that, each slab doubles the pool's
+        // capacity so that the number of slabs grows logarithmically.
+        auto const chunks = std::max (slabs_ == 0U ? hint_ : capacity_, min_slab_chunks);
+        auto const bytes = header_size + chunks * chunk_size_;
+
+        auto * const s = static_cast<slab *> (::operator new (bytes));
+        s->next = slab_list_;
+        slab_list_ = s;
+
+        // Thread the new chunks onto the free list so that they are handed out in address order.
+        auto * const first = reinterpret_cast<std::uint8_t *> (s) + header_size;
+        for (auto index = chunks; index > 0U; --index) {
+            auto * const c = reinterpret_cast<chunk *> (first + (index - 1U) * chunk_size_);
+            c->next = free_;
+            free_ = c;
+        }
+
+        footprint_ += bytes;
+        capacity_ += chunks;
+        ++slabs_;
+    }
+
+} // end namespace extalloc
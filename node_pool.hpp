@@ -0,0 +1,131 @@
+#ifndef EXTALLOC_NODE_POOL_HPP
+#define EXTALLOC_NODE_POOL_HPP
+
+#include <cstddef>
+#include <memory>
+#include <new>
+#include <type_traits>
+
+namespace extalloc {
+
+    /// A pool of fixed-size memory chunks for the nodes of node-based containers. Storage is
+    /// obtained from the system heap in "slabs", each of which is carved into chunks. Released
+    /// chunks are kept on a free list and recycled, so once the pool has grown to hold the peak
+    /// number of nodes no further calls to the system heap are made.
+    ///
+    /// The chunk size is fixed by the first allocation. Requests for any other size are passed
+    /// straight to the global operator new.
+    class node_pool {
+    public:
+        /// \param hint  The number of chunks expected to be in use at any one time. The first slab
+        ///   is sized to hold this many.
+        explicit node_pool (std::size_t hint = 0) noexcept
+                : hint_{hint} {}
+        node_pool (node_pool const &) = delete;
+        node_pool (node_pool &&) = delete;
+
+        ~node_pool () noexcept;
+
+        node_pool & operator= (node_pool const &) = delete;
+        node_pool & operator= (node_pool &&) = delete;
+
+        void * allocate (std::size_t size, std::size_t alignment);
+        /// \p size and \p alignment must be those passed to allocate().
+        void deallocate (void * p, std::size_t size, std::size_t alignment) noexcept;
+
+        /// The total number of bytes obtained from the system heap.
+        std::size_t footprint () const noexcept { return footprint_; }
+        /// The number of slabs obtained from the system heap.
+        std::size_t slabs () const noexcept { return slabs_; }
+        /// The number of chunks that the pool can hand out without growing.
+        std::size_t capacity () const noexcept { return capacity_; }
+        /// The number of chunks currently allocated.
+        std::size_t in_use () const noexcept { return in_use_; }
+
+    private:
+        struct chunk {
+            chunk * next;
+        };
+        struct slab {
+            slab * next;
+        };
+
+        static constexpr std::size_t min_slab_chunks = 64;
+        static constexpr std::size_t header_size =
+            (sizeof (slab) + alignof (std::max_align_t) - 1U) & ~(alignof (std::max_align_t) - 1U);
+
+        /// True if a request of \p size and \p alignment is served from the pool rather than
+        /// the system heap.
+        bool is_pooled (std::size_t size, std::size_t alignment) const noexcept {
+            return size == node_size_ && alignment <= alignof (std::max_align_t);
+        }
+        /// Adds a new slab of chunks to the free list.
+        void grow ();
+
+        std::size_t hint_;
+        /// The size of the objects served by the pool. Zero until the first allocation.
+        std::size_t node_size_ = 0;
+        /// The size of each chunk: node_size_ rounded up for alignment.
+        std::size_t chunk_size_ = 0;
+
+        chunk * free_ = nullptr;
+        slab * slab_list_ = nullptr;
+
+        std::size_t footprint_ = 0;
+        std::size_t slabs_ = 0;
+        std::size_t capacity_ = 0;
+        std::size_t in_use_ = 0;
+    };
+
+
+    /// A standard library compatible allocator which obtains single objects from a shared
+    /// node_pool. Copies of a pool_allocator, including those rebound to a different type, share
+    /// the same pool.
+    template <typename T>
+    class pool_allocator {
+    public:
+        using value_type = T;
+        using propagate_on_container_move_assignment = std::true_type;
+        using propagate_on_container_swap = std::true_type;
+
+        /// Constructs an allocator with a new pool of its own.
+        pool_allocator ()
+                : pool_{std::make_shared<node_pool> ()} {}
+        explicit pool_allocator (std::shared_ptr<node_pool> pool) noexcept
+                : pool_{std::move (pool)} {}
+        template <typename U>
+        pool_allocator (pool_allocator<U> const & other) noexcept
+                : pool_{other.pool ()} {}
+
+        T * allocate (std::size_t n) {
+            if (n == 1U) {
+                return static_cast<T *> (pool_->allocate (sizeof (T), alignof (T)));
+            }
+            return static_cast<T *> (::operator new (n * sizeof (T)));
+        }
+        void deallocate (T * p, std::size_t n) noexcept {
+            if (n == 1U) {
+                pool_->deallocate (p, sizeof (T), alignof (T));
+            } else {
+                ::operator delete (p);
+            }
+        }
+
+        std::shared_ptr<node_pool> const & pool () const noexcept { return pool_; }
+
+    private:
+        std::shared_ptr<node_pool> pool_;
+    };
+
+    template <typename T, typename U>
+    bool operator== (pool_allocator<T> const & lhs, pool_allocator<U> const & rhs) noexcept {
+        return lhs.pool () == rhs.pool ();
+    }
+    template <typename T, typename U>
+    bool operator!= (pool_allocator<T> const & lhs, pool_allocator<U> const & rhs) noexcept {
+        return !(lhs == rhs);
+    }
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_NODE_POOL_HPP
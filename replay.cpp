@@ -0,0 +1,176 @@
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <exception>
+#include <fstream>
+#include <iostream>
+#include <list>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "trace.hpp"
+
+using namespace extalloc;
+
+namespace {
+
+    struct options {
+        std::string containers = "pooled";
+        std::string fit = "best";
+        /// Size classes are made at 16 byte intervals up to this size. 0 disables the bins.
+        std::size_t max_class = 0;
+        /// The smallest amount of storage requested from the add-storage function.
+        std::size_t storage_block_size = std::size_t{1024} * 1024U;
+    };
+
+    allocator::size_classes make_classes (std::size_t max_class) {
+        std::vector<std::size_t> bounds;
+        for (auto size = std::size_t{16}; size <= max_class; size += 16U) {
+            bounds.push_back (size);
+        }
+        return allocator::size_classes{std::move (bounds)};
+    }
+
+    /// Drives an allocator from the records of a trace and reports the throughput and the
+    /// state of the heap.
+    template <typename Containers, typename Fit>
+    void replay (std::vector<trace_record> const & records, options const & opts) {
+        using allocator_type = basic_allocator<Containers, std::uint8_t *, Fit>;
+        using address = typename allocator_type::address;
+
+        std::list<std::vector<std::uint8_t>> buffers;
+        std::size_t storage = 0;
+        allocator_type alloc{[&buffers, &storage, &opts](std::size_t size) {
+                                 buffers.emplace_back (std::max (size, opts.storage_block_size));
+                                 auto & buffer = buffers.back ();
+                                 storage += buffer.size ();
+                                 return std::make_pair (buffer.data (), buffer.size ());
+                             },
+                             std::make_pair (nullptr, std::size_t{0}),
+                             make_classes (opts.max_class)};
+
+        // The address of each block, by number.
+        std::vector<address> blocks;
+        std::size_t failures = 0;
+        std::size_t peak_allocated = 0;
+        std::size_t peak_metadata = 0;
+        double peak_fragmentation = 0.0;
+        // The counters are sampled after every operation so that no peak is missed. None of the
+        // queries depends on the size of the heap, so sampling adds little to the time measured.
+        auto const sample = [&]() {
+            peak_allocated = std::max (peak_allocated, alloc.allocated_space ());
+            peak_metadata = std::max (peak_metadata, alloc.metadata_footprint ());
+            auto const free = static_cast<double> (alloc.free_space ());
+            auto const largest = static_cast<double> (alloc.largest_free_block ());
+            if (free > 0.0) {
+                peak_fragmentation = std::max (peak_fragmentation, 1.0 - largest / free);
+            }
+        };
+
+        auto const start = std::chrono::steady_clock::now ();
+        for (trace_record const & r : records) {
+            switch (r.op) {
+            case trace_op::allocate: {
+                auto const ptr = alloc.allocate (r.size, r.alignment);
+                if (!r.failed) {
+                    if (ptr == nullptr) {
+                        ++failures;
+                    }
+                    blocks.resize (std::max (blocks.size (), r.id + 1U));
+                    blocks[r.id] = ptr;
+                }
+            } break;
+            case trace_op::free:
+                if (blocks[r.id] != nullptr) {
+                    alloc.free (blocks[r.id]);
+                    blocks[r.id] = nullptr;
+                }
+                break;
+            case trace_op::realloc:
+                if (blocks[r.id] != nullptr) {
+                    auto const ptr = alloc.realloc (blocks[r.id], r.size, r.alignment);
+                    if (ptr != nullptr) {
+                        blocks[r.id] = ptr;
+                    } else if (!r.failed) {
+                        ++failures;
+                    }
+                }
+                break;
+            }
+            sample ();
+        }
+        auto const elapsed =
+            std::chrono::duration<double> (std::chrono::steady_clock::now () - start);
+
+        std::cout << records.size () << " operations in " << elapsed.count () << " s: "
+                  << static_cast<double> (records.size ()) / elapsed.count () << " ops/sec\n"
+                  << "Peak footprint: " << storage << " bytes of storage, " << peak_allocated
+                  << " bytes allocated, " << peak_metadata << " bytes of metadata\n"
+                  << "Peak fragmentation: " << peak_fragmentation << '\n'
+                  << "Allocations which succeeded when traced but failed: " << failures << '\n'
+                  << "At the end: " << alloc.stats ();
+    }
+
+    template <typename Containers>
+    void replay (std::vector<trace_record> const & records, options const & opts) {
+        if (opts.fit == "best") {
+            replay<Containers, best_fit> (records, opts);
+        } else if (opts.fit == "first") {
+            replay<Containers, first_fit> (records, opts);
+        } else if (opts.fit == "next") {
+            replay<Containers, next_fit> (records, opts);
+        } else {
+            throw std::invalid_argument{"fit must be best, first, or next"};
+        }
+    }
+
+} // end anonymous namespace
+
+int main (int argc, char ** argv) {
+    int exit_code = EXIT_SUCCESS;
+    try {
+        if (argc < 2) {
+            std::cerr << "Usage: " << argv[0]
+                      << " trace-file [map|flat|pooled [best|first|next [max-class-size "
+                         "[storage-block-size]]]]\n";
+            return EXIT_FAILURE;
+        }
+        options opts;
+        if (argc > 2) {
+            opts.containers = argv[2];
+        }
+        if (argc > 3) {
+            opts.fit = argv[3];
+        }
+        if (argc > 4) {
+            opts.max_class = static_cast<std::size_t> (std::stoul (argv[4]));
+        }
+        if (argc > 5) {
+            opts.storage_block_size = static_cast<std::size_t> (std::stoul (argv[5]));
+        }
+
+        std::ifstream file{argv[1], std::ios::binary};
+        if (!file) {
+            throw std::runtime_error{std::string{"cannot open "} + argv[1]};
+        }
+        auto const records = trace_recorder::read (file);
+
+        if (opts.containers == "map") {
+            replay<map_containers> (records, opts);
+        } else if (opts.containers == "flat") {
+            replay<flat_containers> (records, opts);
+        } else if (opts.containers == "pooled") {
+            replay<pooled_containers> (records, opts);
+        } else {
+            throw std::invalid_argument{"containers must be map, flat, or pooled"};
+        }
+    } catch (std::exception const & ex) {
+        std::cerr << "Error: " << ex.what () << '\n';
+        exit_code = EXIT_FAILURE;
+    } catch (...) {
+        std::cerr << "Unknown error\n";
+        exit_code = EXIT_FAILURE;
+    }
+    return exit_code;
+}
@@ -0,0 +1,91 @@
+#include "storage.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <system_error>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+namespace extalloc {
+
+    namespace {
+
+        std::size_t page_size () noexcept {
+            return static_cast<std::size_t> (sysconf (_SC_PAGESIZE));
+        }
+
+    } // end anonymous namespace
+
+    // operator() [vector storage]
+    // ~~~~~~~~~~
+    std::pair<std::uint8_t *, std::size_t> vector_storage::operator() (std::size_t size) {
+        state_->buffers.emplace_back (std::max (size, state_->block_size));
+        auto & buffer = state_->buffers.back ();
+        state_->granted += buffer.size ();
+        return {buffer.data (), buffer.size ()};
+    }
+
+    // ctor [mmap storage]
+    // ~~~~
+    mmap_storage::mmap_storage (std::size_t block_size)
+            : state_{std::make_shared<state> (-1, block_size)} {
+        state_->page_size = page_size ();
+    }
+
+    mmap_storage::mmap_storage (int fd, std::size_t block_size)
+            : state_{std::make_shared<state> (fd, block_size)} {
+        state_->page_size = page_size ();
+        struct stat stat_buf;
+        if (fstat (fd, &stat_buf) != 0) {
+            throw std::system_error{errno, std::generic_category ()};
+        }
+        // A mapping must start at a multiple of the page size within the file.
+        auto const size = static_cast<std::size_t> (stat_buf.st_size);
+        state_->file_end = (size + state_->page_size - 1U) & ~(state_->page_size - 1U);
+    }
+
+    // operator() [mmap storage]
+    // ~~~~~~~~~~
+    std::pair<std::uint8_t *, std::size_t> mmap_storage::operator() (std::size_t size) {
+        auto & s = *state_;
+        auto const length =
+            (std::max (size, s.block_size) + s.page_size - 1U) & ~(s.page_size - 1U);
+        void * p;
+        if (s.fd == -1) {
+            p = mmap (nullptr, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1,
+                      off_t{0});
+        } else {
+            auto const new_end = s.file_end + length;
+            if (ftruncate (s.fd, static_cast<off_t> (new_end)) != 0) {
+                return {nullptr, 0};
+            }
+            p = mmap (nullptr, length, PROT_READ | PROT_WRITE, MAP_SHARED, s.fd,
+                      static_cast<off_t> (s.file_end));
+            if (p != MAP_FAILED) {
+                s.file_end = new_end;
+            }
+        }
+        if (p == MAP_FAILED) {
+            return {nullptr, 0};
+        }
+        s.mappings.emplace_back (p, length);
+        s.granted += length;
+        return {static_cast<std::uint8_t *> (p), length};
+    }
+
+    // dtor [mmap storage state]
+    // ~~~~
+    mmap_storage::state::~state () noexcept {
+        for (auto const & m : mappings) {
+            munmap (m.first, m.second);
+        }
+    }
+
+    template class basic_allocator<pooled_containers, std::uint8_t *, best_fit, no_storage>;
+    template class basic_allocator<pooled_containers, std::uint8_t *, best_fit, fixed_storage>;
+    template class basic_allocator<pooled_containers, std::uint8_t *, best_fit, vector_storage>;
+    template class basic_allocator<pooled_containers, std::uint8_t *, best_fit, mmap_storage>;
+
+} // end namespace extalloc
@@ -0,0 +1,140 @@
+#ifndef EXTALLOC_STORAGE_HPP
+#define EXTALLOC_STORAGE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "allocator.hpp"
+
+namespace extalloc {
+
+    // Storage providers for the Storage argument of basic_allocator. Each is a function object
+    // which is called with the number of bytes that the allocator needs and returns the start and
+    // size of the storage it grants, or (nullptr, 0) if it can grant none. Because the provider's
+    // type is known to the allocator, the call is direct and may be inlined. Copies of a provider
+    // share the storage that it has granted, so the allocator's copy and the caller's report the
+    // same totals.
+
+    /// Grants no storage: the heap is confined to the initial storage passed to the allocator.
+    struct no_storage {
+        std::pair<std::uint8_t *, std::size_t> operator() (std::size_t /*size*/) const noexcept {
+            return {nullptr, 0};
+        }
+    };
+
+    /// Grants a single buffer, which remains owned by the caller, the first time that the
+    /// allocator needs storage for which it is large enough.
+    class fixed_storage {
+    public:
+        fixed_storage (std::uint8_t * buffer, std::size_t size)
+                : state_{std::make_shared<block> (buffer, size)} {}
+
+        std::pair<std::uint8_t *, std::size_t> operator() (std::size_t size) noexcept {
+            if (state_->first == nullptr || state_->second < size) {
+                return {nullptr, 0};
+            }
+            auto const result = *state_;
+            *state_ = std::make_pair (nullptr, std::size_t{0});
+            return result;
+        }
+
+        /// True if the buffer has been granted.
+        bool exhausted () const noexcept { return state_->first == nullptr; }
+
+    private:
+        using block = std::pair<std::uint8_t *, std::size_t>;
+        std::shared_ptr<block> state_;
+    };
+
+    /// Grants storage from vectors on the system heap. The vectors are freed when the provider and
+    /// all of its copies, including the allocator's, have been destroyed.
+    class vector_storage {
+    public:
+        /// \param block_size  The smallest grant. Larger requests are granted exactly.
+        explicit vector_storage (std::size_t block_size = 32768)
+                : state_{std::make_shared<state> (block_size)} {}
+
+        std::pair<std::uint8_t *, std::size_t> operator() (std::size_t size);
+
+        /// The total number of bytes granted.
+        std::size_t granted () const noexcept { return state_->granted; }
+
+    private:
+        struct state {
+            explicit state (std::size_t bs) noexcept
+                    : block_size{bs} {}
+            std::size_t block_size;
+            std::size_t granted = 0;
+            std::list<std::vector<std::uint8_t>> buffers;
+        };
+        std::shared_ptr<state> state_;
+    };
+
+    /// Grants storage by mapping pages, either anonymous memory or successive ranges of a file
+    /// which is lengthened to hold them. The mappings are removed when the provider and all of its
+    /// copies have been destroyed. Pointers into a file mapping are not valid across runs: to
+    /// persist a heap in a file, use an offset_allocator or a mapped_allocator.
+    class mmap_storage {
+    public:
+        /// Maps anonymous memory.
+        ///
+        /// \param block_size  The smallest grant. Each grant is rounded up to a whole number of
+        ///   pages.
+        explicit mmap_storage (std::size_t block_size = std::size_t{1024} * 1024U);
+        /// Maps ranges of a file, starting at its current end.
+        ///
+        /// \param fd  A file descriptor open for reading and writing. It is not closed by the
+        ///   provider, and must remain open until the provider and its copies are destroyed.
+        /// \param block_size  The smallest grant. Each grant is rounded up to a whole number of
+        ///   pages.
+        /// \throws std::system_error  If the size of the file cannot be found.
+        mmap_storage (int fd, std::size_t block_size);
+
+        std::pair<std::uint8_t *, std::size_t> operator() (std::size_t size);
+
+        /// The total number of bytes granted.
+        std::size_t granted () const noexcept { return state_->granted; }
+
+    private:
+        struct state {
+            state (int f, std::size_t bs) noexcept
+                    : fd{f}
+                    , block_size{bs} {}
+            state (state const &) = delete;
+            state (state &&) = delete;
+            ~state () noexcept;
+            state & operator= (state const &) = delete;
+            state & operator= (state &&) = delete;
+
+            /// The file which backs the mappings or -1 for anonymous memory.
+            int fd;
+            std::size_t block_size;
+            std::size_t page_size = 0;
+            /// The size of the file, which is where the next mapping will start.
+            std::size_t file_end = 0;
+            std::size_t granted = 0;
+            /// The address and size of each mapping.
+            std::vector<std::pair<void *, std::size_t>> mappings;
+        };
+        std::shared_ptr<state> state_;
+    };
+
+    /// An allocator whose add-storage function is the provider \p Storage.
+    template <typename Storage, typename Fit = best_fit, typename Containers = pooled_containers>
+    using storage_allocator = basic_allocator<Containers, std::uint8_t *, Fit, Storage>;
+
+    extern template class basic_allocator<pooled_containers, std::uint8_t *, best_fit, no_storage>;
+    extern template class basic_allocator<pooled_containers, std::uint8_t *, best_fit,
+                                          fixed_storage>;
+    extern template class basic_allocator<pooled_containers, std::uint8_t *, best_fit,
+                                          vector_storage>;
+    extern template class basic_allocator<pooled_containers, std::uint8_t *, best_fit,
+                                          mmap_storage>;
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_STORAGE_HPP
@@ -0,0 +1,248 @@
+#include "buddy_allocator.hpp"
+
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+TEST (SummaryBitmap, FindFirst) {
+    // Large enough for three levels.
+    details::summary_bitmap bits{64U * 64U * 2U};
+    EXPECT_TRUE (bits.none ());
+    EXPECT_EQ (bits.find_first (), details::summary_bitmap::npos);
+
+    bits.set (5000);
+    bits.set (70);
+    EXPECT_FALSE (bits.none ());
+    EXPECT_TRUE (bits.test (70));
+    EXPECT_FALSE (bits.test (71));
+    EXPECT_EQ (bits.find_first (), 70U);
+    bits.reset (70);
+    EXPECT_EQ (bits.find_first (), 5000U);
+    bits.clear ();
+    EXPECT_TRUE (bits.none ());
+}
+
+namespace {
+
+    class BuddyAllocator : public ::testing::Test {
+    protected:
+        static constexpr std::size_t heap_size = 1024;
+
+        BuddyAllocator ()
+                : heap_ (heap_size + 64U)
+                , alloc_{this->base (), heap_size} {}
+
+        /// A 64-byte aligned address within the heap buffer.
+        std::uint8_t * base () noexcept {
+            auto const p = reinterpret_cast<std::uintptr_t> (heap_.data ());
+            return heap_.data () + ((64U - p % 64U) % 64U);
+        }
+        std::size_t offset (std::uint8_t * ptr) const noexcept {
+            return static_cast<std::size_t> (ptr - alloc_.base ());
+        }
+
+        std::vector<std::uint8_t> heap_;
+        buddy_allocator alloc_;
+    };
+
+    constexpr std::size_t BuddyAllocator::heap_size;
+
+} // end anonymous namespace
+
+TEST_F (BuddyAllocator, NewHeapIsOneFreeBlock) {
+    EXPECT_EQ (alloc_.heap_size (), heap_size);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.largest_free_block (), heap_size);
+    EXPECT_TRUE (alloc_.check ());
+
+    EXPECT_THROW ((buddy_allocator{alloc_.base (), heap_size, 24}), std::invalid_argument);
+    EXPECT_THROW ((buddy_allocator{alloc_.base (), 8}), std::invalid_argument);
+}
+
+TEST_F (BuddyAllocator, SplitAndMerge) {
+    // A 16 byte block is split from the 1024 byte heap, leaving free blocks of 16, 32, ... 512.
+    auto const p1 = alloc_.allocate (10);
+    EXPECT_EQ (this->offset (p1), 0U);
+    EXPECT_EQ (alloc_.block_size (p1), 16U);
+    EXPECT_EQ (alloc_.num_frees (), 6U);
+    EXPECT_EQ (alloc_.largest_free_block (), 512U);
+
+    // The lowest block of the right size is used without further splitting.
+    auto const p2 = alloc_.allocate (100);
+    EXPECT_EQ (this->offset (p2), 128U);
+    EXPECT_EQ (alloc_.block_size (p2), 128U);
+    auto const p3 = alloc_.allocate (16);
+    EXPECT_EQ (this->offset (p3), 16U);
+    EXPECT_EQ (alloc_.allocated_space (), 160U);
+    EXPECT_TRUE (alloc_.check ());
+
+    alloc_.free (p1);
+    EXPECT_EQ (alloc_.num_frees (), 5U);
+    alloc_.free (p3);
+    EXPECT_EQ (alloc_.num_frees (), 3U);
+    alloc_.free (p2);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.allocated_space (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+
+    EXPECT_THROW (alloc_.free (p2), no_allocation);
+    EXPECT_THROW (alloc_.free (p2 + 16), no_allocation);
+}
+
+TEST_F (BuddyAllocator, AlignmentAndExhaustion) {
+    auto const p1 = alloc_.allocate (1);
+    auto const p2 = alloc_.allocate (1, 64);
+    EXPECT_EQ (this->offset (p2) % 64U, 0U);
+    EXPECT_EQ (alloc_.block_size (p2), 64U);
+    // The heap's base is only known to be 64-byte aligned.
+    if (reinterpret_cast<std::uintptr_t> (alloc_.base ()) % 128U != 0U) {
+        EXPECT_EQ (alloc_.allocate (1, 128), nullptr);
+    }
+    EXPECT_EQ (alloc_.allocate (heap_size), nullptr);
+    EXPECT_EQ (alloc_.allocate (heap_size + 1U), nullptr);
+    alloc_.free (p1);
+    alloc_.free (p2);
+    EXPECT_NE (alloc_.allocate (heap_size), nullptr);
+    EXPECT_EQ (alloc_.allocate (1), nullptr);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (BuddyAllocator, HeapWhichIsNotAPowerOfTwo) {
+    // 448 bytes is top-level blocks of 256, 128, and 64 bytes.
+    buddy_allocator alloc{this->base (), 448 + 8};
+    EXPECT_EQ (alloc.heap_size (), 448U);
+    EXPECT_EQ (alloc.num_frees (), 3U);
+    EXPECT_EQ (alloc.largest_free_block (), 256U);
+    EXPECT_EQ (alloc.allocate (512), nullptr);
+
+    std::vector<std::uint8_t *> blocks;
+    while (auto const p = alloc.allocate (64)) {
+        blocks.push_back (p);
+    }
+    EXPECT_EQ (blocks.size (), 7U);
+    EXPECT_TRUE (alloc.check ());
+    for (auto const p : blocks) {
+        alloc.free (p);
+    }
+    // The top-level blocks are never merged with one another.
+    EXPECT_EQ (alloc.num_frees (), 3U);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (BuddyAllocator, Realloc) {
+    auto const p1 = alloc_.allocate (16);
+    std::fill (p1, p1 + 16, std::uint8_t{0xAA});
+
+    // The buddies of a block at offset 0 are free, so it grows in place.
+    EXPECT_EQ (alloc_.realloc (p1, 200), p1);
+    EXPECT_EQ (alloc_.block_size (p1), 256U);
+    EXPECT_TRUE (alloc_.check ());
+
+    // Shrinking releases the upper halves.
+    EXPECT_EQ (alloc_.realloc (p1, 32), p1);
+    EXPECT_EQ (alloc_.block_size (p1), 32U);
+    EXPECT_TRUE (alloc_.check ());
+
+    // With its buddy allocated, the block must move.
+    auto const p2 = alloc_.allocate (32);
+    EXPECT_EQ (this->offset (p2), 32U);
+    auto const p3 = alloc_.realloc (p1, 64);
+    ASSERT_NE (p3, nullptr);
+    EXPECT_NE (p3, p1);
+    EXPECT_TRUE (std::all_of (p3, p3 + 16, [](std::uint8_t v) { return v == 0xAA; }));
+    EXPECT_EQ (alloc_.num_allocs (), 2U);
+
+    // A failed realloc leaves the block as it was.
+    EXPECT_EQ (alloc_.realloc (p3, heap_size), nullptr);
+    EXPECT_EQ (alloc_.block_size (p3), 64U);
+    EXPECT_TRUE (alloc_.check ());
+    EXPECT_THROW (alloc_.realloc (p1, 16), no_allocation);
+}
+
+TEST_F (BuddyAllocator, SaveAndLoad) {
+    std::mt19937 random;
+    std::vector<std::uint8_t *> blocks;
+    for (auto ctr = 0U; ctr < 20U; ++ctr) {
+        if (auto const p = alloc_.allocate (std::size_t{1} << (random () % 6U))) {
+            blocks.push_back (p);
+        }
+    }
+    for (auto ctr = std::size_t{0}; ctr < blocks.size (); ctr += 3U) {
+        alloc_.free (blocks[ctr]);
+        blocks[ctr] = nullptr;
+    }
+    std::stringstream ss;
+    alloc_.save (ss);
+
+    buddy_allocator copy{this->base (), heap_size};
+    copy.load (ss);
+    EXPECT_TRUE (copy.check ());
+    EXPECT_EQ (copy.num_allocs (), alloc_.num_allocs ());
+    EXPECT_EQ (copy.num_frees (), alloc_.num_frees ());
+    EXPECT_EQ (copy.allocated_space (), alloc_.allocated_space ());
+    for (auto const p : blocks) {
+        if (p != nullptr) {
+            EXPECT_EQ (copy.block_size (p), alloc_.block_size (p));
+        }
+    }
+
+    // A heap of a different size can't load it.
+    buddy_allocator small{this->base (), heap_size / 2U};
+    std::istringstream is{ss.str ()};
+    EXPECT_THROW (small.load (is), bad_metadata);
+
+    auto corrupt = ss.str ();
+    corrupt.back () = static_cast<char> (corrupt.back () ^ 1);
+    std::istringstream bad{corrupt};
+    EXPECT_THROW (copy.load (bad), bad_metadata);
+    std::istringstream truncated{ss.str ().substr (0, 30)};
+    EXPECT_THROW (copy.load (truncated), bad_metadata);
+
+    // A body size far larger than the stream is reported as truncation.
+    auto oversized = ss.str ();
+    oversized[22] = 0x7F;
+    std::istringstream huge{oversized};
+    EXPECT_THROW (copy.load (huge), bad_metadata);
+}
+
+TEST_F (BuddyAllocator, RandomWorkload) {
+    std::mt19937 random;
+    std::vector<std::uint8_t *> blocks;
+    for (auto ctr = 0U; ctr < 2000U; ++ctr) {
+        auto const size = std::size_t{1} << (random () % 8U);
+        switch (random () % 3U) {
+        case 0:
+            if (auto const p = alloc_.allocate (size)) {
+                blocks.push_back (p);
+            }
+            break;
+        case 1:
+            if (!blocks.empty ()) {
+                auto const index = random () % blocks.size ();
+                alloc_.free (blocks[index]);
+                blocks[index] = blocks.back ();
+                blocks.pop_back ();
+            }
+            break;
+        case 2:
+            if (!blocks.empty ()) {
+                auto & block = blocks[random () % blocks.size ()];
+                if (auto const p = alloc_.realloc (block, size)) {
+                    block = p;
+                }
+            }
+            break;
+        }
+        ASSERT_TRUE (alloc_.check ()) << ctr;
+    }
+    for (auto const p : blocks) {
+        alloc_.free (p);
+    }
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
@@ -0,0 +1,145 @@
+#include "cached_allocator.hpp"
+
+#include <algorithm>
+#include <list>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+namespace {
+
+    class CachedAllocator : public ::testing::Test {
+    protected:
+        static constexpr std::size_t buffer_size = 64 * 1024;
+
+        CachedAllocator ()
+                : alloc_{[this](std::size_t size) {
+                             buffers_.emplace_back (std::max (size, buffer_size));
+                             auto & buffer = buffers_.back ();
+                             return std::make_pair (buffer.data (), buffer.size ());
+                         },
+                         allocator::size_classes{{16, 32, 64}, 4}} {}
+
+        std::list<std::vector<std::uint8_t>> buffers_;
+        cached_allocator alloc_;
+    };
+
+    constexpr std::size_t CachedAllocator::buffer_size;
+
+} // end anonymous namespace
+
+TEST_F (CachedAllocator, FreedBlockIsCached) {
+    auto const p1 = alloc_.allocate (10);
+    alloc_.free (p1, 10);
+    EXPECT_EQ (alloc_.num_cached (), 1U);
+    // A cached block is still allocated as far as the heap is concerned.
+    EXPECT_EQ (alloc_.num_allocs (), 1U);
+
+    // Any request of the same class is served from the cache.
+    EXPECT_EQ (alloc_.allocate (16), p1);
+    EXPECT_EQ (alloc_.num_cached (), 0U);
+    alloc_.free (p1, 16);
+    alloc_.flush ();
+
+    auto const s = alloc_.stats ();
+    EXPECT_EQ (s.hits, 1U);
+    EXPECT_EQ (s.misses, 1U);
+    EXPECT_DOUBLE_EQ (s.hit_rate (), 0.5);
+}
+
+TEST_F (CachedAllocator, ShrinkThenFreeWithOriginalSize) {
+    auto const p1 = alloc_.allocate (60);
+    // The block keeps its size, so the space after it isn't given to the next allocation.
+    EXPECT_EQ (alloc_.realloc (p1, 10), p1);
+    auto const p2 = alloc_.allocate (32);
+    std::fill_n (p2, 32, std::uint8_t{0x55});
+
+    // Freed with the size it was allocated with, the block goes to the 64-byte class and is
+    // handed out for a 60-byte request.
+    alloc_.free (p1, 60);
+    auto const p3 = alloc_.allocate (60);
+    EXPECT_EQ (p3, p1);
+    std::fill_n (p3, 60, std::uint8_t{0xAA});
+    EXPECT_EQ (std::count (p2, p2 + 32, std::uint8_t{0x55}), 32);
+
+    // Growing still works. Freed with its original size, the larger block is cached in a class
+    // which it more than fills.
+    auto const p4 = alloc_.realloc (p3, 1000);
+    ASSERT_NE (p4, nullptr);
+    alloc_.free (p4, 60);
+    alloc_.free (p2, 32);
+    alloc_.flush ();
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (CachedAllocator, LargeBlocksAreNotCached) {
+    auto const p1 = alloc_.allocate (100);
+    alloc_.free (p1, 100);
+    EXPECT_EQ (alloc_.num_cached (), 0U);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+}
+
+TEST_F (CachedAllocator, FullCacheIsFlushedInABatch) {
+    std::vector<cached_allocator::address> blocks;
+    for (auto ctr = 0; ctr < 5; ++ctr) {
+        blocks.push_back (alloc_.allocate (32));
+    }
+    for (auto const p : blocks) {
+        alloc_.free (p, 32);
+    }
+    // The fifth free found the cache full and returned the oldest two blocks to the heap.
+    EXPECT_EQ (alloc_.num_cached (), 3U);
+    EXPECT_EQ (alloc_.num_allocs (), 3U);
+    EXPECT_TRUE (alloc_.check ());
+
+    alloc_.flush ();
+    EXPECT_EQ (alloc_.num_cached (), 0U);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+}
+
+TEST_F (CachedAllocator, CacheIsFlushedOnThreadExit) {
+    std::thread ([this]() {
+        auto const p1 = alloc_.allocate (64);
+        alloc_.free (p1, 64);
+        EXPECT_EQ (alloc_.num_cached (), 1U);
+    })
+        .join ();
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.stats ().misses, 1U);
+}
+
+TEST_F (CachedAllocator, ManyThreads) {
+    constexpr auto num_threads = 4U;
+    constexpr auto iterations = 5000U;
+
+    std::vector<std::thread> threads;
+    for (auto t = 0U; t < num_threads; ++t) {
+        threads.emplace_back ([this, t]() {
+            std::mt19937 random{t};
+            std::vector<std::pair<cached_allocator::address, std::size_t>> live (16);
+            for (auto ctr = 0U; ctr < iterations; ++ctr) {
+                auto & block = live[random () % live.size ()];
+                if (block.first != nullptr) {
+                    alloc_.free (block.first, block.second);
+                }
+                block.second = random () % 128U;
+                block.first = alloc_.allocate (block.second);
+                ASSERT_NE (block.first, nullptr);
+            }
+            for (auto const & block : live) {
+                alloc_.free (block.first, block.second);
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join ();
+    }
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+    EXPECT_GT (alloc_.stats ().hit_rate (), 0.0);
+}
@@ -0,0 +1,161 @@
+#include "concurrent_allocator.hpp"
+
+#include <list>
+#include <mutex>
+#include <random>
+#include <thread>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+namespace {
+
+    class ConcurrentAllocator : public ::testing::Test {
+    protected:
+        static constexpr std::size_t num_arenas = 64;
+        static constexpr std::size_t buffer_size = 64 * 1024;
+
+        ConcurrentAllocator ()
+                : alloc_{[this](std::size_t size) {
+                             buffers_.emplace_back (std::max (size, buffer_size));
+                             auto & buffer = buffers_.back ();
+                             return std::make_pair (buffer.data (), buffer.size ());
+                         },
+                         num_arenas} {}
+
+        std::list<std::vector<std::uint8_t>> buffers_;
+        concurrent_allocator alloc_;
+    };
+
+    constexpr std::size_t ConcurrentAllocator::num_arenas;
+    constexpr std::size_t ConcurrentAllocator::buffer_size;
+
+} // end anonymous namespace
+
+TEST_F (ConcurrentAllocator, AllocateAndFree) {
+    auto const p1 = alloc_.allocate (1);
+    auto const p2 = alloc_.allocate (100);
+    EXPECT_NE (p1, p2);
+    EXPECT_EQ (alloc_.num_allocs (), 2U);
+    // Small requests are rounded up so that a block can hold a queue link.
+    EXPECT_EQ (alloc_.allocated_space (), concurrent_allocator::min_block_size + 100U);
+
+    alloc_.free (p1);
+    alloc_.free (p2);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.remote_frees (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (ConcurrentAllocator, Realloc) {
+    auto const p1 = alloc_.allocate (16);
+    std::fill_n (p1, 16, std::uint8_t{7});
+    auto const p2 = alloc_.realloc (p1, 4096);
+    ASSERT_NE (p2, nullptr);
+    EXPECT_EQ (std::count (p2, p2 + 16, std::uint8_t{7}), 16);
+    EXPECT_EQ (alloc_.allocated_space (), 4096U);
+    alloc_.free (p2);
+}
+
+TEST_F (ConcurrentAllocator, FreeUnknownAddress) {
+    std::uint8_t local;
+    EXPECT_THROW (alloc_.free (&local), no_allocation);
+}
+
+TEST_F (ConcurrentAllocator, RemoteFreeIsQueued) {
+    // A new thread is given a different arena from this one, so the block it allocates must be
+    // queued when it is freed here.
+    concurrent_allocator::address ptr = nullptr;
+    std::thread ([this, &ptr]() { ptr = alloc_.allocate (32); }).join ();
+    ASSERT_NE (ptr, nullptr);
+
+    alloc_.free (ptr);
+    EXPECT_EQ (alloc_.remote_frees (), 1U);
+    EXPECT_EQ (alloc_.num_allocs (), 1U);
+
+    alloc_.drain ();
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (ConcurrentAllocator, InvalidRemoteFreeDoesNotLoseTheQueue) {
+    concurrent_allocator::address p1 = nullptr;
+    concurrent_allocator::address p2 = nullptr;
+    std::thread ([this, &p1, &p2]() {
+        p1 = alloc_.allocate (32);
+        p2 = alloc_.allocate (32);
+    }).join ();
+    ASSERT_NE (p1, nullptr);
+    ASSERT_NE (p2, nullptr);
+
+    // An address in the other arena's storage which is not allocated is queued between the two
+    // real blocks.
+    alloc_.free (p2);
+    alloc_.free (p1 + 1024);
+    alloc_.free (p1);
+    EXPECT_EQ (alloc_.remote_frees (), 3U);
+
+    EXPECT_THROW (alloc_.drain (), no_allocation);
+    EXPECT_EQ (alloc_.invalid_remote_frees (), 1U);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+    EXPECT_NO_THROW (alloc_.drain ());
+}
+
+TEST_F (ConcurrentAllocator, OwnerIsFoundAmongManyRegions) {
+    // Each allocation is larger than a storage block, so each needs a new region. The buffers
+    // are at unrelated addresses, so the regions are inserted at various places in the table.
+    std::vector<concurrent_allocator::address> blocks;
+    for (auto ctr = 0U; ctr < 32U; ++ctr) {
+        blocks.push_back (alloc_.allocate (buffer_size + 16U));
+        ASSERT_NE (blocks.back (), nullptr);
+    }
+    EXPECT_EQ (alloc_.num_regions (), 32U);
+    for (auto it = blocks.rbegin (); it != blocks.rend (); ++it) {
+        EXPECT_NO_THROW (alloc_.free (*it));
+    }
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    std::uint8_t local;
+    EXPECT_THROW (alloc_.free (&local), no_allocation);
+}
+
+TEST_F (ConcurrentAllocator, ThreadsExchangeBlocks) {
+    constexpr auto num_threads = 4U;
+    constexpr auto iterations = 5000U;
+
+    // Each thread swaps the blocks that it allocates with those left in a shared table by the
+    // other threads, then frees whatever it receives.
+    std::mutex mutex;
+    std::vector<concurrent_allocator::address> shared (64, nullptr);
+    std::vector<std::thread> threads;
+    for (auto t = 0U; t < num_threads; ++t) {
+        threads.emplace_back ([this, t, &mutex, &shared]() {
+            std::mt19937 random{t};
+            for (auto ctr = 0U; ctr < iterations; ++ctr) {
+                auto ptr = alloc_.allocate (random () % 256U);
+                {
+                    std::lock_guard<std::mutex> const lock{mutex};
+                    std::swap (ptr, shared[random () % shared.size ()]);
+                }
+                if (ptr != nullptr) {
+                    alloc_.free (ptr);
+                }
+            }
+        });
+    }
+    for (auto & t : threads) {
+        t.join ();
+    }
+    for (auto ptr : shared) {
+        if (ptr != nullptr) {
+            alloc_.free (ptr);
+        }
+    }
+    alloc_.drain ();
+    EXPECT_GT (alloc_.remote_frees (), 0U);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.allocated_space (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+}
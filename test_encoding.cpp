@@ -0,0 +1,84 @@
+#include "encoding.hpp"
+
+#include <limits>
+#include <sstream>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+TEST (Encoding, VarintLengths) {
+    std::vector<std::uint8_t> out;
+    encoding::put_varint (out, 0U);
+    EXPECT_EQ (out.size (), 1U);
+    encoding::put_varint (out, 127U);
+    EXPECT_EQ (out.size (), 2U);
+    encoding::put_varint (out, 128U);
+    EXPECT_EQ (out.size (), 4U);
+    encoding::put_varint (out, std::numeric_limits<std::uint64_t>::max ());
+    EXPECT_EQ (out.size (), 14U);
+}
+
+TEST (Encoding, VarintRoundTrip) {
+    std::vector<std::uint64_t> const values{0U, 1U, 127U, 128U, 300U, 1U << 20U,
+                                            std::numeric_limits<std::uint64_t>::max ()};
+    std::vector<std::uint8_t> out;
+    for (auto const v : values) {
+        encoding::put_varint (out, v);
+    }
+    std::uint8_t const * p = out.data ();
+    for (auto const v : values) {
+        std::uint64_t actual;
+        ASSERT_TRUE (encoding::get_varint (p, out.data () + out.size (), &actual));
+        EXPECT_EQ (actual, v);
+    }
+    EXPECT_EQ (p, out.data () + out.size ());
+}
+
+TEST (Encoding, VarintTruncated) {
+    std::vector<std::uint8_t> out;
+    encoding::put_varint (out, 300U);
+    std::uint8_t const * p = out.data ();
+    std::uint64_t v;
+    EXPECT_FALSE (encoding::get_varint (p, out.data () + 1, &v));
+}
+
+TEST (Encoding, ZigZag) {
+    EXPECT_EQ (encoding::zigzag (0), 0U);
+    EXPECT_EQ (encoding::zigzag (-1), 1U);
+    EXPECT_EQ (encoding::zigzag (1), 2U);
+    EXPECT_EQ (encoding::zigzag (-2), 3U);
+    for (auto const v : {std::int64_t{0}, std::int64_t{-5}, std::int64_t{1} << 40,
+                         std::numeric_limits<std::int64_t>::min (),
+                         std::numeric_limits<std::int64_t>::max ()}) {
+        EXPECT_EQ (encoding::unzigzag (encoding::zigzag (v)), v);
+    }
+}
+
+TEST (Encoding, U64IsLittleEndian) {
+    std::vector<std::uint8_t> out;
+    encoding::put_u64 (out, 0x0102030405060708U);
+    ASSERT_EQ (out.size (), 8U);
+    EXPECT_EQ (out[0], 0x08U);
+    EXPECT_EQ (out[7], 0x01U);
+    EXPECT_EQ (encoding::get_u64 (out.data ()), 0x0102030405060708U);
+}
+
+TEST (Encoding, ReadBytes) {
+    std::string const data (100000, 'x');
+    std::vector<std::uint8_t> out{1, 2, 3};
+    std::istringstream is{data};
+    ASSERT_TRUE (encoding::read_bytes (is, 70000, out));
+    EXPECT_EQ (out.size (), 70000U);
+    EXPECT_EQ (out.front (), 'x');
+    // Only 30000 bytes remain.
+    EXPECT_FALSE (encoding::read_bytes (is, std::uint64_t{1} << 62U, out));
+    EXPECT_LE (out.size (), 64U * 1024U);
+}
+
+TEST (Encoding, Fnv1a) {
+    // Published test vectors.
+    EXPECT_EQ (encoding::fnv1a (nullptr, 0), 0xcbf29ce484222325U);
+    std::uint8_t const a = 'a';
+    EXPECT_EQ (encoding::fnv1a (&a, 1), 0xaf63dc4c8601ec8cU);
+}
@@ -0,0 +1,145 @@
+#include "flat_map.hpp"
+
+#include <map>
+#include <random>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+TEST (FlatMap, Empty) {
+    flat_map<int, int> m;
+    EXPECT_TRUE (m.empty ());
+    EXPECT_EQ (m.size (), 0U);
+    EXPECT_EQ (m.begin (), m.end ());
+    EXPECT_EQ (m.find (1), m.end ());
+}
+
+TEST (FlatMap, InsertKeepsOrder) {
+    flat_map<int, int> m;
+    EXPECT_TRUE (m.insert ({3, 30}).second);
+    EXPECT_TRUE (m.insert ({1, 10}).second);
+    EXPECT_TRUE (m.insert ({2, 20}).second);
+    EXPECT_FALSE (m.insert ({2, 21}).second);
+
+    ASSERT_EQ (m.size (), 3U);
+    auto it = m.begin ();
+    EXPECT_EQ (*it++, std::make_pair (1, 10));
+    EXPECT_EQ (*it++, std::make_pair (2, 20));
+    EXPECT_EQ (*it++, std::make_pair (3, 30));
+    EXPECT_EQ (it, m.end ());
+}
+
+TEST (FlatMap, Find) {
+    flat_map<int, int> m;
+    m.emplace (1, 10);
+    m.emplace (3, 30);
+    auto const pos = m.find (3);
+    ASSERT_NE (pos, m.end ());
+    EXPECT_EQ (pos->second, 30);
+    EXPECT_EQ (m.find (2), m.end ());
+    EXPECT_EQ (m.count (1), 1U);
+    EXPECT_EQ (m.count (2), 0U);
+}
+
+TEST (FlatMap, Bounds) {
+    flat_map<int, int> m;
+    m.emplace (10, 0);
+    m.emplace (20, 0);
+    EXPECT_EQ (m.lower_bound (10)->first, 10);
+    EXPECT_EQ (m.lower_bound (11)->first, 20);
+    EXPECT_EQ (m.upper_bound (10)->first, 20);
+    EXPECT_EQ (m.upper_bound (20), m.end ());
+}
+
+TEST (FlatMap, HintedInsert) {
+    flat_map<int, int> m;
+    m.emplace (1, 0);
+    m.emplace (5, 0);
+    // A correct hint.
+    auto pos = m.emplace_hint (m.find (5), 3, 0);
+    EXPECT_EQ (pos->first, 3);
+    // An incorrect hint is ignored.
+    pos = m.emplace_hint (m.begin (), 7, 0);
+    EXPECT_EQ (pos->first, 7);
+    // Inserting at the end.
+    pos = m.emplace_hint (m.end (), 9, 0);
+    EXPECT_EQ (pos->first, 9);
+
+    std::vector<int> keys;
+    for (auto const & kvp : m) {
+        keys.push_back (kvp.first);
+    }
+    EXPECT_EQ (keys, (std::vector<int>{1, 3, 5, 7, 9}));
+}
+
+TEST (FlatMap, Erase) {
+    flat_map<int, int> m;
+    m.emplace (1, 0);
+    m.emplace (2, 0);
+    m.emplace (3, 0);
+    EXPECT_EQ (m.erase (2), 1U);
+    EXPECT_EQ (m.erase (2), 0U);
+    auto const next = m.erase (m.begin ());
+    ASSERT_NE (next, m.end ());
+    EXPECT_EQ (next->first, 3);
+    EXPECT_EQ (m.size (), 1U);
+}
+
+TEST (FlatMap, Replace) {
+    flat_map<int, int> m;
+    for (int k : {10, 20, 30, 40}) {
+        m.emplace (k, k);
+    }
+    auto keys = [&m]() {
+        std::vector<int> result;
+        for (auto const & kvp : m) {
+            result.push_back (kvp.first);
+        }
+        return result;
+    };
+
+    // Same position.
+    auto pos = m.replace (m.find (20), {25, 1});
+    EXPECT_EQ (*pos, std::make_pair (25, 1));
+    EXPECT_EQ (keys (), (std::vector<int>{10, 25, 30, 40}));
+    // Towards the end.
+    pos = m.replace (m.find (10), {35, 2});
+    EXPECT_EQ (*pos, std::make_pair (35, 2));
+    EXPECT_EQ (keys (), (std::vector<int>{25, 30, 35, 40}));
+    // Towards the beginning.
+    pos = m.replace (m.find (40), {5, 3});
+    EXPECT_EQ (*pos, std::make_pair (5, 3));
+    EXPECT_EQ (keys (), (std::vector<int>{5, 25, 30, 35}));
+}
+
+TEST (FlatMap, MatchesStdMap) {
+    flat_map<unsigned, unsigned> fm;
+    std::map<unsigned, unsigned> sm;
+    std::mt19937 random;
+    for (auto ctr = 0U; ctr < 10000U; ++ctr) {
+        auto const k = random () % 512U;
+        if (random () % 3U == 0U) {
+            EXPECT_EQ (fm.erase (k), sm.erase (k));
+        } else {
+            EXPECT_EQ (fm.emplace (k, ctr).second, sm.emplace (k, ctr).second);
+        }
+    }
+    ASSERT_EQ (fm.size (), sm.size ());
+    EXPECT_TRUE (std::equal (fm.begin (), fm.end (), sm.begin (),
+                             [](std::pair<unsigned, unsigned> const & a,
+                                std::pair<unsigned const, unsigned> const & b) {
+                                 return a.first == b.first && a.second == b.second;
+                             }));
+}
+
+TEST (FlatSet, InsertAndErase) {
+    flat_set<std::pair<int, int>> s;
+    EXPECT_TRUE (s.insert ({2, 1}).second);
+    EXPECT_TRUE (s.insert ({1, 2}).second);
+    EXPECT_FALSE (s.insert ({1, 2}).second);
+    EXPECT_EQ (s.begin ()->first, 1);
+    EXPECT_EQ (s.rbegin ()->first, 2);
+    EXPECT_EQ (s.erase ({1, 2}), 1U);
+    EXPECT_EQ (s.size (), 1U);
+}
@@ -0,0 +1,89 @@
+#include "heap_offset.hpp"
+
+#include <array>
+#include <functional>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+TEST (HeapOffset, Null) {
+    constexpr heap_offset null{nullptr};
+    EXPECT_FALSE (null);
+    EXPECT_EQ (null, nullptr);
+    EXPECT_TRUE (heap_offset{});
+    EXPECT_NE (heap_offset{}, nullptr);
+    EXPECT_NE (heap_offset{}, null);
+}
+
+TEST (HeapOffset, Arithmetic) {
+    heap_offset o{100};
+    EXPECT_EQ ((o + 28U).get (), 128U);
+    EXPECT_EQ ((o - 36).get (), 64U);
+    EXPECT_EQ ((o + std::ptrdiff_t{-100}).get (), 0U);
+    EXPECT_EQ (heap_offset{128} - o, 28);
+    EXPECT_EQ (o - heap_offset{128}, -28);
+    o += std::size_t{8};
+    EXPECT_EQ (o.get (), 108U);
+}
+
+TEST (HeapOffset, Ordering) {
+    heap_offset const a{1};
+    heap_offset const b{2};
+    EXPECT_TRUE (a < b);
+    EXPECT_TRUE (a <= b);
+    EXPECT_TRUE (b > a);
+    EXPECT_TRUE (b >= a);
+    EXPECT_FALSE (b < a);
+    EXPECT_TRUE (std::less<heap_offset>{}(a, b));
+}
+
+TEST (HeapOffset, Pointers) {
+    std::array<std::uint8_t, 16> heap1{};
+    std::array<std::uint8_t, 16> heap2{};
+    auto const o = heap_offset::from_pointer (&heap1[5], heap1.data ());
+    EXPECT_EQ (o.get (), 5U);
+    // The same offset refers to the same position wherever the heap is.
+    EXPECT_EQ (o.to_pointer (heap2.data ()), &heap2[5]);
+    EXPECT_EQ (heap_offset{nullptr}.to_pointer (heap1.data ()), nullptr);
+    EXPECT_EQ (heap_offset::from_pointer (nullptr, heap1.data ()), nullptr);
+}
+
+TEST (HeapOffset, Granules) {
+    using offset = compact_offset<16>;
+    static_assert (sizeof (offset) == sizeof (std::uint32_t), "a compact offset is 32 bits");
+    offset o{32};
+    EXPECT_EQ (o.get (), 32U);
+    EXPECT_EQ ((o + 48U).get (), 80U);
+    EXPECT_EQ ((o - 32).get (), 0U);
+    // A 32-bit offset in granules reaches beyond 4 GiB.
+    EXPECT_EQ (offset{std::uint64_t{1} << 35U} - offset{0}, std::ptrdiff_t{1} << 35U);
+    // The null value is distinct from the largest offset.
+    EXPECT_NE (offset{nullptr}, offset{(std::uint64_t{0xFFFFFFFE}) * 16U});
+}
+
+TEST (HeapOffset, Spans) {
+    using offset = compact_offset<16>;
+    EXPECT_TRUE (offset{0}.spans (64));
+    EXPECT_FALSE (offset{0}.spans (60));
+    EXPECT_FALSE (offset{nullptr}.spans (16));
+    // The end of a range may be the largest offset, but no further.
+    auto const largest = std::uint64_t{0xFFFFFFFE} * 16U;
+    EXPECT_TRUE (offset{largest - 32U}.spans (32));
+    EXPECT_FALSE (offset{largest - 32U}.spans (48));
+    EXPECT_TRUE (heap_offset{0}.spans (1000));
+}
+
+TEST (GranularSize, ConvertsToBytes) {
+    using size = granular_size<std::uint32_t, 8>;
+    static_assert (sizeof (size) == sizeof (std::uint32_t), "a granular size is 32 bits");
+    size s = 24U;
+    EXPECT_EQ (std::size_t{s}, 24U);
+    s += 8U;
+    EXPECT_EQ (std::size_t{s}, 32U);
+    s -= 16U;
+    EXPECT_EQ (std::size_t{s}, 16U);
+    // The largest size is 4 GiB less one granule.
+    size const largest = (std::size_t{1} << 35U) - 8U;
+    EXPECT_EQ (std::size_t{largest}, 0x7FFFFFFF8U);
+}
@@ -0,0 +1,177 @@
+#include "journal.hpp"
+
+#include <list>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+namespace {
+
+    class Journal : public ::testing::Test {
+    protected:
+        static constexpr std::size_t buffer_size = 4096;
+
+        Journal ()
+                : alloc_{[this](std::size_t size) {
+                             buffers_.emplace_back (std::max (size, buffer_size));
+                             auto & buffer = buffers_.back ();
+                             return std::make_pair (buffer.data (), buffer.size ());
+                         },
+                         std::make_pair (nullptr, std::size_t{0}),
+                         allocator::size_classes{{16, 32, 64}, 4}} {}
+
+        /// Makes a mixture of changes of every kind.
+        void exercise (unsigned seed, unsigned iterations);
+
+        /// Loads the snapshot \p s, applies the journal \p j, and saves the result.
+        static std::string recover (std::string const & s, std::uint64_t generation,
+                                    std::string const & j, std::size_t * records = nullptr);
+
+        std::list<std::vector<std::uint8_t>> buffers_;
+        allocator alloc_;
+        std::vector<allocator::address> live_;
+    };
+
+    constexpr std::size_t Journal::buffer_size;
+
+    void Journal::exercise (unsigned seed, unsigned iterations) {
+        std::mt19937 random{seed};
+        for (auto ctr = 0U; ctr < iterations; ++ctr) {
+            switch (live_.empty () ? 0U : random () % 5U) {
+            case 0:
+            case 1: live_.push_back (alloc_.allocate (random () % 200U)); break;
+            case 2: {
+                auto const index = random () % live_.size ();
+                alloc_.free (live_[index]);
+                live_.erase (live_.begin () + static_cast<std::ptrdiff_t> (index));
+            } break;
+            case 3: {
+                auto & p = live_[random () % live_.size ()];
+                p = alloc_.realloc (p, random () % 300U);
+            } break;
+            default: {
+                std::size_t const sizes[] = {8, 24, 40};
+                allocator::address result[3];
+                ASSERT_TRUE (alloc_.allocate_n (sizes, 3, result));
+                live_.insert (live_.end (), std::begin (result), std::end (result));
+            } break;
+            }
+        }
+        ASSERT_TRUE (alloc_.check ());
+    }
+
+    std::string Journal::recover (std::string const & s, std::uint64_t generation,
+                                  std::string const & j, std::size_t * records) {
+        allocator alloc{[](std::size_t) {
+            return std::pair<std::uint8_t *, std::size_t>{nullptr, 0};
+        }};
+        std::istringstream snapshot{s};
+        alloc.load (snapshot);
+        std::istringstream js{j};
+        auto const n = journal::replay (js, generation, nullptr, alloc);
+        if (records != nullptr) {
+            *records = n;
+        }
+        EXPECT_TRUE (alloc.check ());
+        std::ostringstream os;
+        alloc.save (os);
+        return os.str ();
+    }
+
+    std::string save (allocator const & alloc) {
+        std::ostringstream os;
+        alloc.save (os);
+        return os.str ();
+    }
+
+} // end anonymous namespace
+
+TEST_F (Journal, ReplayRecoversState) {
+    this->exercise (1, 200);
+    auto const snapshot = save (alloc_);
+
+    std::ostringstream js;
+    {
+        journal j{js, nullptr, 7};
+        alloc_.set_journal (j.recorder ());
+        this->exercise (2, 2000);
+        alloc_.set_journal (nullptr);
+    }
+    std::size_t records = 0;
+    EXPECT_EQ (recover (snapshot, 7, js.str (), &records), save (alloc_));
+    EXPECT_GT (records, 2000U);
+}
+
+TEST_F (Journal, GroupCommit) {
+    std::ostringstream js;
+    auto syncs = 0U;
+    journal j{js, nullptr, 0, [&syncs]() { ++syncs; }, 4};
+    alloc_.set_journal (j.recorder ());
+    for (auto ctr = 0; ctr < 10; ++ctr) {
+        alloc_.allocate (100);
+    }
+    // The first allocation also added a region.
+    EXPECT_EQ (j.num_records (), 11U);
+    EXPECT_EQ (j.num_commits (), 2U);
+    EXPECT_EQ (syncs, 2U);
+    EXPECT_EQ (j.pending (), 3U);
+    j.commit ();
+    EXPECT_EQ (j.pending (), 0U);
+    EXPECT_EQ (syncs, 3U);
+    alloc_.set_journal (nullptr);
+}
+
+TEST_F (Journal, IncompleteGroupIsIgnored) {
+    auto const snapshot = save (alloc_);
+    std::ostringstream js;
+    std::string committed;
+    {
+        journal j{js, nullptr, 0, journal::sync_fn{}, 8};
+        alloc_.set_journal (j.recorder ());
+        this->exercise (3, 100);
+        j.commit ();
+        committed = save (alloc_);
+        this->exercise (4, 100);
+        alloc_.set_journal (nullptr);
+        j.commit ();
+    }
+    // Lose the end of the last group, as if the process had stopped while writing it.
+    auto const full = js.str ();
+    auto const torn = full.substr (0, full.size () - 3U);
+    std::size_t all = 0;
+    std::size_t some = 0;
+    EXPECT_EQ (recover (snapshot, 0, full, &all), save (alloc_));
+    recover (snapshot, 0, torn, &some);
+    EXPECT_LT (some, all);
+    EXPECT_GE (some, 100U);
+
+    // A group whose size field claims far more than remains is also incomplete. Its body is read
+    // only as far as the stream goes.
+    std::string oversized (8, '\0');
+    oversized[3] = 0x40; // 1 GiB.
+    std::size_t records = 0;
+    EXPECT_EQ (recover (snapshot, 0, full + oversized + "abc", &records), save (alloc_));
+    EXPECT_EQ (records, all);
+}
+
+TEST_F (Journal, StaleJournalIsIgnored) {
+    std::ostringstream js;
+    {
+        journal j{js, nullptr, 1};
+        alloc_.set_journal (j.recorder ());
+        this->exercise (5, 50);
+        alloc_.set_journal (nullptr);
+    }
+    // The snapshot taken at compaction already includes the journal's changes.
+    auto const snapshot = save (alloc_);
+    std::size_t records = 1;
+    EXPECT_EQ (recover (snapshot, 2, js.str (), &records), snapshot);
+    EXPECT_EQ (records, 0U);
+
+    std::istringstream bad{"not a journal"};
+    EXPECT_THROW (journal::replay (bad, 2, nullptr, alloc_), bad_metadata);
+}
@@ -0,0 +1,204 @@
+#include "mapped_allocator.hpp"
+
+#include <algorithm>
+#include <random>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+namespace {
+
+    class MappedAllocator : public ::testing::Test {
+    protected:
+        static constexpr std::size_t capacity = 64;
+        static constexpr std::size_t heap_size = 4096;
+
+        MappedAllocator ()
+                : metadata_ (mapped_allocator::metadata_size (capacity) / sizeof (std::uint64_t))
+                , heap_ (heap_size) {}
+
+        mapped_allocator open () {
+            return mapped_allocator{metadata_.data (), metadata_.size () * sizeof (std::uint64_t),
+                                    heap_.data (), heap_.size ()};
+        }
+
+        // Stands in for a memory-mapped metadata file. Zero-filled, as is a new file.
+        std::vector<std::uint64_t> metadata_;
+        std::vector<std::uint8_t> heap_;
+    };
+
+    constexpr std::size_t MappedAllocator::capacity;
+    constexpr std::size_t MappedAllocator::heap_size;
+
+} // end anonymous namespace
+
+TEST_F (MappedAllocator, NewHeapIsOneFreeBlock) {
+    auto alloc = this->open ();
+    EXPECT_EQ (alloc.capacity (), capacity);
+    EXPECT_EQ (alloc.heap_size (), heap_size);
+    EXPECT_EQ (alloc.num_allocs (), 0U);
+    EXPECT_EQ (alloc.num_frees (), 1U);
+    EXPECT_EQ (alloc.free_space (), heap_size);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (MappedAllocator, AllocateAndFree) {
+    auto alloc = this->open ();
+    auto const p1 = alloc.allocate (100);
+    auto const p2 = alloc.allocate (200, 64);
+    EXPECT_EQ (p1, heap_.data ());
+    EXPECT_EQ (reinterpret_cast<std::uintptr_t> (p2) % 64U, 0U);
+    EXPECT_EQ (alloc.allocated_space (), 300U);
+    EXPECT_TRUE (alloc.check ());
+
+    alloc.free (p1);
+    alloc.free (p2);
+    EXPECT_EQ (alloc.num_allocs (), 0U);
+    EXPECT_EQ (alloc.num_frees (), 1U);
+    EXPECT_TRUE (alloc.check ());
+    EXPECT_THROW (alloc.free (p1), no_allocation);
+}
+
+TEST_F (MappedAllocator, Realloc) {
+    auto alloc = this->open ();
+    auto const p1 = alloc.allocate (16);
+    std::fill_n (p1, 16, std::uint8_t{7});
+    // Grows into the following free space.
+    EXPECT_EQ (alloc.realloc (p1, 64), p1);
+    auto const p2 = alloc.allocate (16);
+    // Must move.
+    auto const p3 = alloc.realloc (p1, 128);
+    EXPECT_NE (p3, p1);
+    EXPECT_EQ (std::count (p3, p3 + 16, std::uint8_t{7}), 16);
+    // Shrinks in place.
+    EXPECT_EQ (alloc.realloc (p3, 8), p3);
+    EXPECT_EQ (alloc.allocated_space (), 24U);
+    alloc.free (p2);
+    alloc.free (p3);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (MappedAllocator, SmallestFreeBlockIsChosen) {
+    auto alloc = this->open ();
+    // Free blocks of 64, 32, 48, and 32 bytes, each followed by an allocation.
+    std::vector<std::uint8_t *> holes;
+    for (auto const size : {64U, 32U, 48U, 32U}) {
+        holes.push_back (alloc.allocate (size));
+        ASSERT_NE (alloc.allocate (8), nullptr);
+    }
+    for (auto const p : holes) {
+        alloc.free (p);
+    }
+    EXPECT_TRUE (alloc.check ());
+
+    // The lowest of the two smallest blocks which fit, then the other, then the 48 byte block.
+    EXPECT_EQ (alloc.allocate (20), holes[1]);
+    EXPECT_EQ (alloc.allocate (32), holes[3]);
+    EXPECT_EQ (alloc.allocate (33), holes[2]);
+    // The remainder of the first 32 byte block is now the best fit.
+    EXPECT_EQ (alloc.allocate (12), holes[1] + 20);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (MappedAllocator, ReopenSeesTheSameHeap) {
+    std::vector<std::uint8_t *> blocks;
+    {
+        auto alloc = this->open ();
+        for (auto size = 1U; size < 40U; ++size) {
+            blocks.push_back (alloc.allocate (size));
+        }
+        alloc.free (blocks[10]);
+        blocks.erase (blocks.begin () + 10);
+    }
+
+    // Opening the heap again only validates the header.
+    auto alloc = this->open ();
+    ASSERT_EQ (alloc.num_allocs (), blocks.size ());
+    EXPECT_TRUE (alloc.check ());
+    EXPECT_TRUE (std::equal (blocks.begin (), blocks.end (), alloc.allocs_begin (),
+                             [this](std::uint8_t * p, mapped_allocator::record const & r) {
+                                 return p == heap_.data () + r.offset;
+                             }));
+}
+
+TEST_F (MappedAllocator, HeapMayMove) {
+    auto const offset = [this]() {
+        auto alloc = this->open ();
+        return alloc.allocate (32) - heap_.data ();
+    }();
+
+    // The records hold offsets so the heap can be mapped at a different address.
+    std::vector<std::uint8_t> moved (heap_size);
+    mapped_allocator alloc{metadata_.data (), metadata_.size () * sizeof (std::uint64_t),
+                           moved.data (), moved.size ()};
+    alloc.free (moved.data () + offset);
+    EXPECT_EQ (alloc.num_allocs (), 0U);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (MappedAllocator, HeapGrows) {
+    auto const p1 = this->open ().allocate (heap_size);
+    ASSERT_NE (p1, nullptr);
+
+    heap_.resize (2 * heap_size);
+    auto alloc = this->open ();
+    EXPECT_EQ (alloc.heap_size (), 2 * heap_size);
+    EXPECT_EQ (alloc.free_space (), heap_size);
+    EXPECT_NE (alloc.allocate (100), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (MappedAllocator, CapacityLimitsAllocations) {
+    auto alloc = this->open ();
+    for (auto ctr = std::size_t{0}; ctr < capacity; ++ctr) {
+        EXPECT_NE (alloc.allocate (1), nullptr);
+    }
+    EXPECT_EQ (alloc.allocate (1), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (MappedAllocator, BadMetadataIsRejected) {
+    this->open ();
+    auto const good = metadata_;
+
+    metadata_[0] ^= 1U;
+    EXPECT_THROW (this->open (), bad_metadata);
+    metadata_ = good;
+
+    // A heap larger than the one supplied.
+    heap_.resize (heap_size / 2);
+    EXPECT_THROW (this->open (), bad_metadata);
+    heap_.resize (heap_size);
+
+    // Metadata which has been truncated.
+    EXPECT_THROW ((mapped_allocator{metadata_.data (), sizeof (std::uint64_t) * 32,
+                                    heap_.data (), heap_.size ()}),
+                  bad_metadata);
+}
+
+TEST_F (MappedAllocator, RandomOperations) {
+    auto alloc = this->open ();
+    std::mt19937 random;
+    std::vector<std::uint8_t *> live;
+    for (auto ctr = 0U; ctr < 2000U; ++ctr) {
+        auto const op = random () % 3U;
+        if (op == 0U || live.empty ()) {
+            auto const alignment = std::size_t{1} << (random () % 4U);
+            if (auto const p = alloc.allocate (random () % 128U, alignment)) {
+                live.push_back (p);
+            }
+        } else {
+            auto const index = random () % live.size ();
+            if (op == 1U) {
+                alloc.free (live[index]);
+                live.erase (live.begin () + static_cast<std::ptrdiff_t> (index));
+            } else if (auto const p = alloc.realloc (live[index], random () % 128U)) {
+                live[index] = p;
+            }
+        }
+        ASSERT_TRUE (alloc.check ());
+    }
+    EXPECT_EQ (alloc.num_allocs (), live.size ());
+}
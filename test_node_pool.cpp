@@ -0,0 +1,158 @@
+#include "allocator.hpp"
+#include "node_pool.hpp"
+
+#include <atomic>
+#include <cstdlib>
+#include <map>
+#include <new>
+#include <random>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+namespace {
+    // Counts the calls made to the global operator new so that tests can check that a pool is
+    // not going to the system heap.
+    std::atomic<std::size_t> heap_calls{0};
+
+    std::pair<std::uint8_t *, std::size_t> no_storage (std::size_t) {
+        return {nullptr, 0};
+    }
+} // end anonymous namespace
+
+void * operator new (std::size_t size) {
+    ++heap_calls;
+    if (void * const p = std::malloc (size == 0U ? 1U : size)) {
+        return p;
+    }
+    throw std::bad_alloc ();
+}
+void operator delete (void * p) noexcept {
+    std::free (p);
+}
+void operator delete (void * p, std::size_t) noexcept {
+    std::free (p);
+}
+
+TEST (NodePool, RecyclesChunks) {
+    node_pool pool;
+    void * const a = pool.allocate (24, alignof (void *));
+    void * const b = pool.allocate (24, alignof (void *));
+    EXPECT_NE (a, b);
+    EXPECT_EQ (pool.in_use (), 2U);
+    EXPECT_EQ (pool.slabs (), 1U);
+
+    pool.deallocate (a, 24, alignof (void *));
+    EXPECT_EQ (pool.in_use (), 1U);
+    EXPECT_EQ (pool.allocate (24, alignof (void *)), a);
+
+    pool.deallocate (a, 24, alignof (void *));
+    pool.deallocate (b, 24, alignof (void *));
+    EXPECT_EQ (pool.in_use (), 0U);
+}
+
+TEST (NodePool, HintSizesFirstSlab) {
+    node_pool pool{1000};
+    std::vector<void *> chunks;
+    for (auto ctr = 0; ctr < 1000; ++ctr) {
+        chunks.push_back (pool.allocate (16, 8));
+    }
+    EXPECT_EQ (pool.slabs (), 1U);
+    EXPECT_GE (pool.capacity (), 1000U);
+    for (void * p : chunks) {
+        pool.deallocate (p, 16, 8);
+    }
+}
+
+TEST (NodePool, OtherSizesUseTheHeap) {
+    node_pool pool;
+    void * const a = pool.allocate (16, 8);
+    void * const b = pool.allocate (100, 8);
+    EXPECT_EQ (pool.in_use (), 1U);
+    pool.deallocate (b, 100, 8);
+    pool.deallocate (a, 16, 8);
+}
+
+TEST (NodePool, OverAlignedRequestsUseTheHeap) {
+    node_pool pool;
+    auto const over_aligned = alignof (std::max_align_t) * 2U;
+    void * const a = pool.allocate (16, 8);
+    void * const b = pool.allocate (16, over_aligned);
+    EXPECT_EQ (pool.in_use (), 1U);
+    // Returning the heap block must not put it on the pool's free list.
+    pool.deallocate (b, 16, over_aligned);
+    EXPECT_EQ (pool.in_use (), 1U);
+    pool.deallocate (a, 16, 8);
+    EXPECT_EQ (pool.in_use (), 0U);
+    void * const c = pool.allocate (16, 8);
+    EXPECT_EQ (c, a);
+    pool.deallocate (c, 16, 8);
+}
+
+TEST (NodePool, MapSharesPool) {
+    auto pool = std::make_shared<node_pool> (16);
+    using alloc = pool_allocator<std::pair<int const, int>>;
+    std::map<int, int, std::less<int>, alloc> m{std::less<int>{}, alloc{pool}};
+    for (auto ctr = 0; ctr < 10; ++ctr) {
+        m.emplace (ctr, ctr);
+    }
+    EXPECT_EQ (pool->in_use (), 10U);
+    m.clear ();
+    EXPECT_EQ (pool->in_use (), 0U);
+}
+
+TEST (PooledAllocator, SteadyStateMakesNoHeapCalls) {
+    constexpr auto size = std::size_t{1024 * 1024};
+    static std::uint8_t buffer[size];
+    basic_allocator<pooled_containers> alloc{no_storage,
+                                             {buffer, sizeof (buffer)},
+                                             size_classes{},
+                                             2048};
+    std::mt19937 generator;
+    std::uniform_int_distribution<std::size_t> sizes{1, 256};
+    std::vector<std::uint8_t *> live (512, nullptr);
+
+    auto const step = [&](std::size_t index) {
+        auto & slot = live[index % live.size ()];
+        if (slot != nullptr) {
+            alloc.free (slot);
+        }
+        slot = alloc.allocate (sizes (generator));
+    };
+    // Warm up: reach the peak number of live blocks.
+    for (auto ctr = std::size_t{0}; ctr < live.size (); ++ctr) {
+        step (ctr);
+    }
+
+    auto const before = heap_calls.load ();
+    for (auto ctr = std::size_t{0}; ctr < 20000; ++ctr) {
+        step (ctr);
+    }
+    EXPECT_EQ (heap_calls.load (), before);
+    EXPECT_TRUE (alloc.check ());
+    EXPECT_GT (alloc.metadata_footprint (), 0U);
+}
+
+TEST (PooledAllocator, LoadKeepsPools) {
+    constexpr auto size = std::size_t{4096};
+    static std::uint8_t buffer[size];
+    basic_allocator<pooled_containers> alloc{no_storage,
+                                             {buffer, sizeof (buffer)},
+                                             size_classes{},
+                                             64};
+    auto const a = alloc.allocate (16);
+    alloc.allocate (32);
+    alloc.free (a);
+    auto const footprint = alloc.metadata_footprint ();
+
+    std::stringstream str;
+    alloc.save (str, buffer);
+    alloc.load (str, buffer);
+    EXPECT_EQ (alloc.num_allocs (), 1U);
+    EXPECT_EQ (alloc.num_frees (), 2U);
+    EXPECT_EQ (alloc.metadata_footprint (), footprint);
+    EXPECT_TRUE (alloc.check ());
+}
@@ -0,0 +1,92 @@
+#include "storage.hpp"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+TEST (Storage, NoStorage) {
+    std::vector<std::uint8_t> buffer (64);
+    storage_allocator<no_storage> alloc{no_storage{},
+                                        std::make_pair (buffer.data (), buffer.size ())};
+    EXPECT_NE (alloc.allocate (64), nullptr);
+    EXPECT_EQ (alloc.allocate (1), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (Storage, FixedStorageIsGrantedOnce) {
+    std::vector<std::uint8_t> buffer (256);
+    fixed_storage storage{buffer.data (), buffer.size ()};
+    storage_allocator<fixed_storage> alloc{storage};
+    // A request too large for the buffer doesn't use it up.
+    EXPECT_EQ (alloc.allocate (512), nullptr);
+    EXPECT_FALSE (storage.exhausted ());
+
+    auto const p1 = alloc.allocate (200);
+    EXPECT_EQ (p1, buffer.data ());
+    EXPECT_TRUE (storage.exhausted ());
+    EXPECT_NE (alloc.allocate (56), nullptr);
+    EXPECT_EQ (alloc.allocate (1), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (Storage, VectorStorage) {
+    vector_storage storage{1024};
+    {
+        storage_allocator<vector_storage, next_fit> alloc{storage};
+        std::vector<std::uint8_t *> blocks;
+        for (auto ctr = 0; ctr < 100; ++ctr) {
+            auto const p = alloc.allocate (100);
+            ASSERT_NE (p, nullptr);
+            std::fill_n (p, 100, static_cast<std::uint8_t> (ctr));
+            blocks.push_back (p);
+        }
+        // The provider's copy reports the storage granted to the allocator's.
+        EXPECT_GE (storage.granted (), 100U * 100U);
+        EXPECT_LT (storage.granted (), 100U * 100U + 1024U);
+        EXPECT_NE (alloc.allocate (5000), nullptr);
+        EXPECT_GE (storage.granted (), 100U * 100U + 5000U);
+        for (auto ctr = std::size_t{0}; ctr < blocks.size (); ++ctr) {
+            EXPECT_EQ (blocks[ctr][99], static_cast<std::uint8_t> (ctr));
+        }
+        EXPECT_TRUE (alloc.check ());
+    }
+}
+
+TEST (Storage, AnonymousMmapStorage) {
+    mmap_storage storage{4096};
+    storage_allocator<mmap_storage> alloc{storage};
+    auto const p1 = alloc.allocate (10000);
+    ASSERT_NE (p1, nullptr);
+    std::fill_n (p1, 10000, std::uint8_t{0xFF});
+    // Grants are whole pages.
+    EXPECT_GE (storage.granted (), 10000U);
+    EXPECT_EQ (storage.granted () % 4096U, 0U);
+    EXPECT_NE (alloc.allocate (100), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (Storage, FileMmapStorage) {
+    std::FILE * const file = std::tmpfile ();
+    ASSERT_NE (file, nullptr);
+    {
+        mmap_storage storage{fileno (file), 4096};
+        storage_allocator<mmap_storage> alloc{storage};
+        auto const p1 = alloc.allocate (6000);
+        ASSERT_NE (p1, nullptr);
+        std::fill_n (p1, 6000, std::uint8_t{'a'});
+        auto const p2 = alloc.allocate (6000);
+        ASSERT_NE (p2, nullptr);
+        EXPECT_TRUE (alloc.check ());
+
+        // The storage is the file's contents.
+        std::fseek (file, 0, SEEK_END);
+        EXPECT_EQ (static_cast<std::size_t> (std::ftell (file)), storage.granted ());
+        std::fseek (file, 0, SEEK_SET);
+        EXPECT_EQ (std::fgetc (file), 'a');
+    }
+    std::fclose (file);
+}
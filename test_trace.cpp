@@ -0,0 +1,144 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <list>
+#include <sstream>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+using namespace extalloc;
+
+namespace {
+
+    class Trace : public ::testing::Test {
+    protected:
+        static constexpr std::size_t buffer_size = 4096;
+
+        Trace ()
+                : alloc_{[this](std::size_t size) {
+                             buffers_.emplace_back (std::max (size, buffer_size));
+                             auto & buffer = buffers_.back ();
+                             return std::make_pair (buffer.data (), buffer.size ());
+                         },
+                         std::make_pair (nullptr, std::size_t{0})} {}
+
+        std::vector<trace_record> read () {
+            std::istringstream is{os_.str ()};
+            return trace_recorder::read (is);
+        }
+
+        std::list<std::vector<std::uint8_t>> buffers_;
+        allocator alloc_;
+        std::ostringstream os_;
+    };
+
+    constexpr std::size_t Trace::buffer_size;
+
+} // end anonymous namespace
+
+TEST_F (Trace, RecordsCallsByBlockNumber) {
+    {
+        // A ring smaller than the number of calls is drained more than once.
+        trace_recorder trace{os_, 2};
+        alloc_.set_trace (trace.recorder<allocator::address> ());
+        auto const p1 = alloc_.allocate (10);
+        auto const p2 = alloc_.allocate (20, 16);
+        auto const p3 = alloc_.realloc (p1, 30);
+        alloc_.free (p2);
+        // The freed space is reused by a new block, which gets a new number.
+        auto const p4 = alloc_.allocate (20);
+        alloc_.free (p3);
+        alloc_.free (p4);
+        alloc_.set_trace (nullptr);
+        // The last call waits in the ring until the recorder is destroyed.
+        EXPECT_EQ (trace.num_records (), 6U);
+    }
+
+    auto const records = this->read ();
+    ASSERT_EQ (records.size (), 7U);
+    auto const check = [&records](std::size_t index, trace_op op, std::uint64_t id,
+                                  std::size_t size, std::size_t alignment) {
+        EXPECT_EQ (records[index].op, op) << index;
+        EXPECT_EQ (records[index].id, id) << index;
+        EXPECT_EQ (records[index].size, size) << index;
+        EXPECT_EQ (records[index].alignment, alignment) << index;
+        EXPECT_FALSE (records[index].failed) << index;
+    };
+    check (0, trace_op::allocate, 0, 10, 1);
+    check (1, trace_op::allocate, 1, 20, 16);
+    check (2, trace_op::realloc, 0, 30, 1);
+    check (3, trace_op::free, 1, 0, 1);
+    check (4, trace_op::allocate, 2, 20, 1);
+    check (5, trace_op::free, 0, 0, 1);
+    check (6, trace_op::free, 2, 0, 1);
+}
+
+TEST_F (Trace, NestedCallsAreNotRecorded) {
+    auto const p1 = alloc_.allocate (32);
+    alloc_.allocate (32);
+    {
+        trace_recorder trace{os_};
+        alloc_.set_trace (trace.recorder<allocator::address> ());
+        // The block is hemmed in so realloc() allocates a new one and frees the old.
+        auto const p2 = alloc_.realloc (p1, 64);
+        EXPECT_NE (p2, p1);
+        std::size_t const sizes[] = {8, 8};
+        allocator::address result[2];
+        ASSERT_TRUE (alloc_.allocate_n (sizes, 2, result));
+        alloc_.free_n (result, 2);
+        alloc_.set_trace (nullptr);
+    }
+
+    // The realloc of a block allocated before the recorder was installed is recorded as an
+    // allocation.
+    auto const records = this->read ();
+    ASSERT_EQ (records.size (), 5U);
+    EXPECT_EQ (records[0].op, trace_op::allocate);
+    EXPECT_EQ (records[0].size, 64U);
+    EXPECT_EQ (records[1].op, trace_op::allocate);
+    EXPECT_EQ (records[2].op, trace_op::allocate);
+    EXPECT_EQ (records[3].op, trace_op::free);
+    EXPECT_EQ (records[4].op, trace_op::free);
+}
+
+TEST_F (Trace, FailuresAndUnknownBlocks) {
+    allocator exhausted{[](std::size_t) {
+        return std::pair<std::uint8_t *, std::size_t>{nullptr, 0};
+    }};
+    auto const before = alloc_.allocate (16);
+    {
+        trace_recorder trace{os_};
+        exhausted.set_trace (trace.recorder<allocator::address> ());
+        EXPECT_EQ (exhausted.allocate (100), nullptr);
+        exhausted.set_trace (nullptr);
+        alloc_.set_trace (trace.recorder<allocator::address> ());
+        alloc_.free (before);
+        trace.flush ();
+        EXPECT_EQ (trace.num_dropped (), 1U);
+        alloc_.set_trace (nullptr);
+    }
+
+    auto const records = this->read ();
+    ASSERT_EQ (records.size (), 1U);
+    EXPECT_EQ (records[0].op, trace_op::allocate);
+    EXPECT_TRUE (records[0].failed);
+    EXPECT_EQ (records[0].size, 100U);
+}
+
+TEST_F (Trace, TruncatedRecordIsIgnored) {
+    {
+        trace_recorder trace{os_};
+        alloc_.set_trace (trace.recorder<allocator::address> ());
+        alloc_.allocate (1000);
+        alloc_.allocate (1000);
+        alloc_.set_trace (nullptr);
+    }
+    // Each allocation takes one byte for the operation and two for the size.
+    auto const full = os_.str ();
+    std::istringstream is{full.substr (0, full.size () - 1U)};
+    EXPECT_EQ (trace_recorder::read (is).size (), 1U);
+
+    std::istringstream bad{"not a trace at all"};
+    EXPECT_THROW (trace_recorder::read (bad), bad_metadata);
+}
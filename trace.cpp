@@ -0,0 +1,188 @@
+#include "trace.hpp"
+
+#include <algorithm>
+#include <array>
+#include <iterator>
+
+#include "encoding.hpp"
+
+namespace extalloc {
+
+    namespace {
+
+        constexpr std::array<char, 8> signature{{'E', 'X', 'T', 'T', 'R', 'A', 'C', 'E'}};
+        constexpr std::uint64_t version = 1;
+        /// The signature and version.
+        constexpr std::size_t header_size = 16;
+
+        constexpr unsigned op_mask = 0x03U;
+        constexpr unsigned failed_flag = 0x04U;
+        constexpr unsigned alignment_shift = 3U;
+
+        std::size_t round_up_to_power_of_two (std::size_t n) noexcept {
+            std::size_t result = 1;
+            while (result < n) {
+                result <<= 1U;
+            }
+            return result;
+        }
+
+        unsigned log2 (std::size_t n) noexcept {
+            auto result = 0U;
+            while (n >>= 1U) {
+                ++result;
+            }
+            return result;
+        }
+
+    } // end anonymous namespace
+
+    // ctor
+    // ~~~~
+    trace_recorder::trace_recorder (std::ostream & os, std::size_t capacity)
+            : os_{os}
+            , ring_ (round_up_to_power_of_two (std::max (capacity, std::size_t{1}))) {
+        std::vector<std::uint8_t> header (std::begin (signature), std::end (signature));
+        encoding::put_u64 (header, version);
+        os_.write (reinterpret_cast<std::ostream::char_type const *> (header.data ()),
+                   static_cast<std::streamsize> (header.size ()));
+    }
+
+    // dtor
+    // ~~~~
+    trace_recorder::~trace_recorder () noexcept {
+        try {
+            this->flush ();
+        } catch (...) {
+        }
+    }
+
+    // flush
+    // ~~~~~
+    void trace_recorder::flush () {
+        this->drain ();
+        os_.flush ();
+    }
+
+    // drain
+    // ~~~~~
+    void trace_recorder::drain () {
+        encoded_.clear ();
+        for (; tail_ != head_; ++tail_) {
+            event const & e = ring_[tail_ & (ring_.size () - 1U)];
+            switch (e.op) {
+            case trace_op::allocate:
+                this->encode (trace_op::allocate, e.failed, e.alignment, 0U, e.size);
+                if (!e.failed) {
+                    ids_[e.result] = next_id_++;
+                }
+                break;
+            case trace_op::free: {
+                auto const pos = ids_.find (e.ptr);
+                if (pos == std::end (ids_)) {
+                    ++num_dropped_;
+                    break;
+                }
+                this->encode (trace_op::free, false, 1U, pos->second, 0U);
+                ids_.erase (pos);
+            } break;
+            case trace_op::realloc: {
+                auto const pos = ids_.find (e.ptr);
+                if (pos == std::end (ids_)) {
+                    // The block predates the recorder. From here on it is a new one.
+                    this->encode (trace_op::allocate, e.failed, e.alignment, 0U, e.size);
+                    if (!e.failed) {
+                        ids_[e.result] = next_id_++;
+                    }
+                    break;
+                }
+                auto const id = pos->second;
+                this->encode (trace_op::realloc, e.failed, e.alignment, id, e.size);
+                if (!e.failed && e.result != e.ptr) {
+                    ids_.erase (pos);
+                    ids_[e.result] = id;
+                }
+            } break;
+            }
+        }
+        os_.write (reinterpret_cast<std::ostream::char_type const *> (encoded_.data ()),
+                   static_cast<std::streamsize> (encoded_.size ()));
+    }
+
+    // encode
+    // ~~~~~~
+    void trace_recorder::encode (trace_op op, bool failed, std::size_t alignment,
+                                 std::uint64_t id, std::size_t size) {
+        encoded_.push_back (static_cast<std::uint8_t> (
+            static_cast<unsigned> (op) | (failed ? failed_flag : 0U) |
+            (log2 (alignment) << alignment_shift)));
+        if (op != trace_op::allocate) {
+            encoding::put_varint (encoded_, next_id_ - 1U - id);
+        }
+        if (op != trace_op::free) {
+            encoding::put_varint (encoded_, size);
+        }
+        ++num_records_;
+    }
+
+    // read [static]
+    // ~~~~
+    std::vector<trace_record> trace_recorder::read (std::istream & is) {
+        std::vector<std::uint8_t> const data{std::istreambuf_iterator<char> (is),
+                                             std::istreambuf_iterator<char> ()};
+        if (data.size () < header_size ||
+            !std::equal (std::begin (signature), std::end (signature), std::begin (data),
+                         [](char c, std::uint8_t b) {
+                             return static_cast<std::uint8_t> (c) == b;
+                         })) {
+            throw bad_metadata ("trace header is not valid");
+        }
+        if (encoding::get_u64 (data.data () + signature.size ()) != version) {
+            throw bad_metadata ("trace version is not supported");
+        }
+
+        std::vector<trace_record> result;
+        std::uint64_t next_id = 0;
+        auto const last = data.data () + data.size ();
+        for (std::uint8_t const * p = data.data () + header_size; p != last;) {
+            auto const byte = *p++;
+            if ((byte & op_mask) > static_cast<unsigned> (trace_op::realloc)) {
+                throw bad_metadata ("trace record is not valid");
+            }
+            trace_record record{static_cast<trace_op> (byte & op_mask), 0U, 0U,
+                                std::size_t{1} << (byte >> alignment_shift),
+                                (byte & failed_flag) != 0U};
+            std::uint64_t v;
+            switch (record.op) {
+            case trace_op::allocate:
+                if (!encoding::get_varint (p, last, &v)) {
+                    return result;
+                }
+                record.size = static_cast<std::size_t> (v);
+                if (!record.failed) {
+                    record.id = next_id++;
+                }
+                break;
+            case trace_op::free:
+            case trace_op::realloc:
+                if (!encoding::get_varint (p, last, &v)) {
+                    return result;
+                }
+                if (v >= next_id) {
+                    throw bad_metadata ("trace record refers to an unknown block");
+                }
+                record.id = next_id - 1U - v;
+                if (record.op == trace_op::realloc) {
+                    if (!encoding::get_varint (p, last, &v)) {
+                        return result;
+                    }
+                    record.size = static_cast<std::size_t> (v);
+                }
+                break;
+            }
+            result.push_back (record);
+        }
+        return result;
+    }
+
+} // end namespace extalloc
@@ -0,0 +1,143 @@
+#ifndef EXTALLOC_TRACE_HPP
+#define EXTALLOC_TRACE_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <istream>
+#include <ostream>
+#include <unordered_map>
+#include <vector>
+
+#include "allocator.hpp"
+
+namespace extalloc {
+
+    /// A call read from a trace.
+    struct trace_record {
+        trace_op op;
+        /// The logical identity of the block. Blocks are numbered from 0 in the order in which
+        /// they were allocated, and keep their number when they are reallocated. It is 0 for an
+        /// allocation which failed.
+        std::uint64_t id;
+        /// The number of bytes requested. This is 0 for a free.
+        std::size_t size;
+        std::size_t alignment;
+        /// True if the allocation or reallocation returned null.
+        bool failed;
+    };
+
+    /// Records the calls made to an allocator as a compact binary trace which can be replayed,
+    /// with read(), against another allocator configuration. Blocks are identified by number
+    /// rather than address, so the trace doesn't depend on where the heap was.
+    ///
+    /// To keep the cost to the allocator low, each call is copied, as it is, into a ring buffer.
+    /// The addresses are translated to block numbers and encoded only when the ring is full or
+    /// flush() is called, at which point the encoded records are written to the stream with a
+    /// single call. A recorder is not thread-safe: it must only be used by the allocator's
+    /// thread.
+    ///
+    /// The trace starts with a signature and version number. Each record is a byte holding the
+    /// operation, a flag which is set if the call failed, and the base-2 logarithm of the
+    /// alignment. It is followed, as varints, by the age of the block (the number of blocks
+    /// allocated after it) for a free or realloc, and by the requested size for an allocate or
+    /// realloc. An allocation is given the next block number, so it needs none.
+    class trace_recorder {
+    public:
+        /// Writes the trace header to \p os.
+        ///
+        /// \param os  The stream to which the trace is written. It should be empty.
+        /// \param capacity  The number of calls held in the ring buffer. This is rounded up to a
+        ///   power of two.
+        explicit trace_recorder (std::ostream & os, std::size_t capacity = 4096);
+        trace_recorder (trace_recorder const &) = delete;
+        trace_recorder (trace_recorder &&) = delete;
+
+        /// Writes any calls which remain in the ring buffer.
+        ~trace_recorder () noexcept;
+
+        trace_recorder & operator= (trace_recorder const &) = delete;
+        trace_recorder & operator= (trace_recorder &&) = delete;
+
+        /// Returns a function, suitable for basic_allocator::set_trace(), which records each call
+        /// made to an allocator whose addresses are of type Address.
+        template <typename Address>
+        std::function<void (trace_op, Address, Address, std::size_t, std::size_t)> recorder () {
+            return [this](trace_op op, Address ptr, Address result, std::size_t size,
+                          std::size_t alignment) {
+                using traits = address_traits<Address>;
+                bool const failed = op != trace_op::free && result == nullptr;
+                this->record (op, op == trace_op::allocate ? 0U : traits::to_integer (ptr),
+                              failed ? 0U : traits::to_integer (result), size, alignment,
+                              failed);
+            };
+        }
+
+        /// Adds a call to the ring buffer, first writing the calls which it holds if it is full.
+        ///
+        /// \param op  The operation.
+        /// \param ptr  The address passed to free() or realloc().
+        /// \param result  The address returned by allocate() or realloc().
+        /// \param size  The number of bytes requested.
+        /// \param alignment  The alignment requested. Must be a power of two.
+        /// \param failed  True if the allocation or reallocation returned null.
+        void record (trace_op op, std::uintptr_t ptr, std::uintptr_t result, std::size_t size,
+                     std::size_t alignment, bool failed) {
+            if (head_ - tail_ == ring_.size ()) {
+                this->drain ();
+            }
+            ring_[head_ & (ring_.size () - 1U)] = event{ptr, result, size, alignment, op, failed};
+            ++head_;
+        }
+        /// Writes the calls held in the ring buffer and flushes the stream.
+        void flush ();
+
+        /// The number of records which have been written.
+        std::uint64_t num_records () const noexcept { return num_records_; }
+        /// The number of frees which were not written because the block was allocated before
+        /// the recorder was installed.
+        std::uint64_t num_dropped () const noexcept { return num_dropped_; }
+
+        /// Reads a trace.
+        ///
+        /// \param is  The stream from which the trace is read.
+        /// \returns  The records in the trace. A record which was cut short, because the trace
+        ///   was not flushed, is ignored.
+        /// \throws bad_metadata  If the stream does not start with a trace header or a record
+        ///   refers to a block which doesn't exist.
+        static std::vector<trace_record> read (std::istream & is);
+
+    private:
+        struct event {
+            std::uintptr_t ptr;
+            std::uintptr_t result;
+            std::size_t size;
+            std::size_t alignment;
+            trace_op op;
+            bool failed;
+        };
+
+        /// Translates and encodes the calls held in the ring buffer and writes them.
+        void drain ();
+        /// Appends a record to encoded_. \p id is ignored for an allocation.
+        void encode (trace_op op, bool failed, std::size_t alignment, std::uint64_t id,
+                     std::size_t size);
+
+        std::ostream & os_;
+        std::vector<event> ring_;
+        /// The number of calls which have been added to and removed from the ring.
+        std::size_t head_ = 0;
+        std::size_t tail_ = 0;
+
+        /// The number of each live block, by address.
+        std::unordered_map<std::uintptr_t, std::uint64_t> ids_;
+        std::uint64_t next_id_ = 0;
+        std::vector<std::uint8_t> encoded_;
+
+        std::uint64_t num_records_ = 0;
+        std::uint64_t num_dropped_ = 0;
+    };
+
+} // end namespace extalloc
+
+#endif // EXTALLOC_TRACE_HPP
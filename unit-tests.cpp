@@ -1,7 +1,13 @@
 #include "allocator.hpp"
 #include <gtest/gtest.h>
 
+#include <algorithm>
+#include <functional>
 #include <list>
+#include <numeric>
+#include <random>
+#include <sstream>
+#include <tuple>
 #include <vector>
 
 using namespace extalloc;
@@ -28,6 +34,30 @@ namespace {
                      },
                      std::make_pair (nullptr, std::size_t{0})} {}
 
+
+    class BinnedAllocator : public ::testing::Test {
+    public:
+        BinnedAllocator ();
+
+        static constexpr std::size_t buffer_size = 256;
+        static constexpr std::size_t bin_capacity = 2;
+
+        std::list<std::vector<std::uint8_t>> buffers_;
+        allocator alloc_;
+    };
+
+    constexpr std::size_t BinnedAllocator::buffer_size;
+    constexpr std::size_t BinnedAllocator::bin_capacity;
+
+    BinnedAllocator::BinnedAllocator ()
+            : alloc_{[this](std::size_t size) {
+                         buffers_.emplace_back (std::max (size, buffer_size));
+                         auto & buffer = buffers_.back ();
+                         return std::pair<uint8_t *, size_t>{buffer.data (), buffer.size ()};
+                     },
+                     std::make_pair (nullptr, std::size_t{0}),
+                     allocator::size_classes{{16, 32, 64}, bin_capacity}} {}
+
 } // end anonymous namespace
 
 
@@ -295,3 +325,1298 @@ TEST_F (Allocator, ReallocLargerWithoutFollowingFreeSpace) {
     EXPECT_EQ (alloc_.num_allocs (), 2U);
     EXPECT_EQ (alloc_.num_frees (), 2U);
 }
+
+TEST_F (Allocator, BestFitPrefersSmallestBlock) {
+    auto p1 = alloc_.allocate (64);
+    auto p2 = alloc_.allocate (16);
+    auto p3 = alloc_.allocate (16);
+    auto p4 = alloc_.allocate (16);
+    ASSERT_TRUE (alloc_.check ());
+
+    alloc_.free (p1);
+    alloc_.free (p3);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_frees (), 3U);
+
+    // The 16 byte hole left by p3 is a better fit than the 64 byte block at p1.
+    auto p5 = alloc_.allocate (16);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (p5, p3);
+    EXPECT_EQ (alloc_.num_frees (), 2U);
+
+    alloc_.free (p2);
+    alloc_.free (p4);
+    alloc_.free (p5);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+namespace {
+
+    template <typename Fit>
+    using fit_allocator = basic_allocator<pooled_containers, std::uint8_t *, Fit>;
+
+    /// Leaves free blocks of 64, 16, and 144 bytes, in address order, in a 256 byte heap.
+    template <typename Fit>
+    std::vector<std::uint8_t *> make_holes (fit_allocator<Fit> & alloc) {
+        auto const p1 = alloc.allocate (64);
+        auto const p2 = alloc.allocate (16);
+        auto const p3 = alloc.allocate (16);
+        auto const p4 = alloc.allocate (16);
+        alloc.free (p1);
+        alloc.free (p3);
+        EXPECT_TRUE (alloc.check ());
+        return {p1, p2, p3, p4};
+    }
+
+    std::pair<std::uint8_t *, std::size_t> no_storage (std::size_t) {
+        return {nullptr, 0};
+    }
+
+} // end anonymous namespace
+
+TEST (AllocatorFit, FirstFitPrefersLowestBlock) {
+    std::vector<std::uint8_t> buffer (256);
+    fit_allocator<first_fit> alloc{no_storage, std::make_pair (buffer.data (), buffer.size ())};
+    auto const blocks = make_holes (alloc);
+    // The 64 byte block at p1 comes before the 16 byte hole left by p3.
+    EXPECT_EQ (alloc.allocate (16), blocks[0]);
+    EXPECT_EQ (alloc.allocate (16), blocks[0] + 16);
+    EXPECT_EQ (alloc.allocate (40), blocks[3] + 16);
+    EXPECT_EQ (alloc.allocate (32), blocks[0] + 32);
+    EXPECT_EQ (alloc.allocate (200), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (AllocatorFit, NextFitResumesFromRover) {
+    std::vector<std::uint8_t> buffer (256);
+    fit_allocator<next_fit> alloc{no_storage, std::make_pair (buffer.data (), buffer.size ())};
+    auto const blocks = make_holes (alloc);
+    auto const end = blocks[3] + 16;
+    // The search starts where p4 ended, passing over the holes below it.
+    EXPECT_EQ (alloc.allocate (16), end);
+    EXPECT_EQ (alloc.allocate (64), end + 16);
+    EXPECT_EQ (alloc.allocate (48), end + 80);
+    // 16 bytes remain at the end of the heap. The search wraps around to the start.
+    EXPECT_EQ (alloc.allocate (32), blocks[0]);
+    EXPECT_EQ (alloc.allocate (16), blocks[0] + 32);
+    // From there the holes are visited in address order, including one freed ahead of the
+    // rover, before the end of the heap.
+    alloc.free (end);
+    EXPECT_EQ (alloc.allocate (16), blocks[0] + 48);
+    EXPECT_EQ (alloc.allocate (16), blocks[2]);
+    EXPECT_EQ (alloc.allocate (16), end);
+    EXPECT_EQ (alloc.allocate (16), end + 128);
+    EXPECT_EQ (alloc.allocate (16), nullptr);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (AllocatorSizeClasses, BadBounds) {
+    auto const as = [](std::size_t) { return std::pair<std::uint8_t *, std::size_t>{nullptr, 0}; };
+    auto const init = std::make_pair (nullptr, std::size_t{0});
+    EXPECT_THROW (allocator (as, init, allocator::size_classes{{0, 16}}), std::invalid_argument);
+    EXPECT_THROW (allocator (as, init, allocator::size_classes{{32, 16}}), std::invalid_argument);
+    EXPECT_THROW (allocator (as, init, allocator::size_classes{{16, 16}}), std::invalid_argument);
+}
+
+TEST (AllocatorSizeClasses, LargeClassCostsNoMetadata) {
+    std::vector<std::uint8_t> buffer (256);
+    // A 1 GiB class must not need metadata in proportion to its size.
+    allocator alloc{[](std::size_t) { return std::pair<std::uint8_t *, std::size_t>{nullptr, 0}; },
+                    std::make_pair (buffer.data (), buffer.size ()),
+                    allocator::size_classes{{16, 64, std::size_t{1} << 30U}, 4}};
+    EXPECT_LT (alloc.metadata_footprint (), std::size_t{65536});
+    auto const p1 = alloc.allocate (17);
+    EXPECT_EQ (alloc.allocated_space (), 64U);
+    alloc.free (p1);
+    EXPECT_EQ (alloc.num_binned (), 1U);
+    EXPECT_EQ (alloc.allocate (200), nullptr);
+}
+
+TEST_F (BinnedAllocator, RequestRoundedToClass) {
+    auto p1 = alloc_.allocate (10);
+    auto p2 = alloc_.allocate (1);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (p2, p1 + 16);
+    EXPECT_EQ (alloc_.allocated_space (), 32U);
+}
+
+TEST_F (BinnedAllocator, FreedBlockIsReused) {
+    auto p1 = alloc_.allocate (20);
+    auto p2 = alloc_.allocate (20);
+    ASSERT_TRUE (alloc_.check ());
+
+    alloc_.free (p1);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_binned (), 1U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+
+    auto p3 = alloc_.allocate (32);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (p3, p1);
+    EXPECT_EQ (alloc_.num_binned (), 0U);
+
+    alloc_.free (p2);
+    alloc_.free (p3);
+    alloc_.flush_bins ();
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_binned (), 0U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+TEST_F (BinnedAllocator, LargeBlocksAreNotBinned) {
+    auto p1 = alloc_.allocate (100);
+    alloc_.free (p1);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_binned (), 0U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+TEST_F (BinnedAllocator, FullBinIsFlushed) {
+    std::vector<allocator::address> ptrs;
+    for (auto ctr = 0U; ctr < bin_capacity + 1U; ++ctr) {
+        ptrs.push_back (alloc_.allocate (16));
+    }
+    for (auto const p : ptrs) {
+        alloc_.free (p);
+        ASSERT_TRUE (alloc_.check ());
+    }
+    // The first bin_capacity blocks were coalesced back into the free-space map to make room for
+    // the last one.
+    EXPECT_EQ (alloc_.num_binned (), 1U);
+    EXPECT_EQ (alloc_.num_frees (), 2U);
+}
+
+TEST_F (BinnedAllocator, BinsFlushedWhenStorageIsExhausted) {
+    std::vector<allocator::address> ptrs;
+    for (auto ctr = std::size_t{0}; ctr < buffer_size / 64U; ++ctr) {
+        ptrs.push_back (alloc_.allocate (64));
+    }
+    alloc_.free (ptrs[0]);
+    alloc_.free (ptrs[1]);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_binned (), 2U);
+
+    // Neither binned block is large enough but, coalesced, they are.
+    auto p = alloc_.allocate (128);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (p, ptrs[0]);
+    EXPECT_EQ (buffers_.size (), 1U);
+}
+
+TEST_F (BinnedAllocator, SaveWritesBinnedBlocksAsFreeSpace) {
+    auto p1 = alloc_.allocate (16);
+    auto p2 = alloc_.allocate (16);
+    alloc_.free (p1);
+    alloc_.free (p2);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_binned (), 2U);
+
+    std::stringstream str;
+    alloc_.save (str);
+    alloc_.load (str);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.num_binned (), 0U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+namespace {
+
+    bool is_aligned (allocator::address p, std::size_t alignment) {
+        return reinterpret_cast<std::uintptr_t> (p) % alignment == 0U;
+    }
+
+} // end anonymous namespace
+
+TEST_F (Allocator, BadAlignment) {
+    EXPECT_THROW (alloc_.allocate (16, 0), std::invalid_argument);
+    EXPECT_THROW (alloc_.allocate (16, 24), std::invalid_argument);
+    auto p1 = alloc_.allocate (16);
+    EXPECT_THROW (alloc_.realloc (p1, 32, 3), std::invalid_argument);
+}
+
+TEST_F (Allocator, AlignedAllocateKeepsSlack) {
+    auto p1 = alloc_.allocate (1);
+    auto p2 = alloc_.allocate (16, 32);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_TRUE (is_aligned (p2, 32));
+    EXPECT_EQ (buffers_.size (), 1U);
+
+    // The gap between p1 and p2 is free, as is the remainder of the buffer.
+    EXPECT_EQ (alloc_.num_frees (), 2U);
+    EXPECT_EQ (alloc_.allocated_space () + alloc_.free_space (), buffer_size);
+
+    // A small request can use the space skipped to align p2.
+    auto p3 = alloc_.allocate (1);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (p3, p1 + 1);
+
+    alloc_.free (p1);
+    alloc_.free (p2);
+    alloc_.free (p3);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+TEST_F (Allocator, AlignedAllocateSkipsMisalignedHoles) {
+    // Create two 16 byte holes: one starting at an odd address, the other 16-byte aligned.
+    auto p1 = alloc_.allocate (1);
+    auto p2 = alloc_.allocate (16);
+    auto p3 = alloc_.allocate (16, 16);
+    auto p4 = alloc_.allocate (16, 16);
+    auto p5 = alloc_.allocate (16);
+    ASSERT_TRUE (alloc_.check ());
+    ASSERT_FALSE (is_aligned (p2, 2));
+    ASSERT_TRUE (is_aligned (p4, 16));
+
+    alloc_.free (p2);
+    alloc_.free (p4);
+    ASSERT_TRUE (alloc_.check ());
+
+    auto p6 = alloc_.allocate (16, 16);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (p6, p4);
+    EXPECT_EQ (buffers_.size (), 1U);
+
+    alloc_.free (p1);
+    alloc_.free (p3);
+    alloc_.free (p5);
+    alloc_.free (p6);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+TEST_F (Allocator, AlignedAllocateGrowsStorage) {
+    auto p1 = alloc_.allocate (buffer_size - 8, 64);
+    ASSERT_NE (p1, nullptr);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_TRUE (is_aligned (p1, 64));
+}
+
+TEST (AlignedAllocator, ReallocPreservesAlignment) {
+    alignas (64) std::uint8_t buffer[256];
+    allocator alloc{[](std::size_t) { return std::pair<std::uint8_t *, std::size_t>{nullptr, 0}; },
+                    std::make_pair (&buffer[0], sizeof (buffer))};
+
+    auto p1 = alloc.allocate (8, 64);
+    auto p2 = alloc.allocate (8);
+    ASSERT_EQ (p1, &buffer[0]);
+    ASSERT_EQ (p2, &buffer[8]);
+    std::fill_n (p1, 8, std::uint8_t{0xAA});
+
+    // There's no free space after p1 so it has to move.
+    auto p3 = alloc.realloc (p1, 32, 64);
+    ASSERT_TRUE (alloc.check ());
+    EXPECT_EQ (p3, &buffer[64]);
+    EXPECT_TRUE (std::all_of (p3, p3 + 8, [](std::uint8_t v) { return v == 0xAA; }));
+
+    // A request that can't be satisfied leaves the original block alone.
+    EXPECT_EQ (alloc.realloc (p3, 512, 64), nullptr);
+    ASSERT_TRUE (alloc.check ());
+    EXPECT_EQ (alloc.num_allocs (), 2U);
+
+    alloc.free (p2);
+    alloc.free (p3);
+    ASSERT_TRUE (alloc.check ());
+    EXPECT_EQ (alloc.num_frees (), 1U);
+}
+
+TEST_F (Allocator, ReallocToStricterAlignmentMoves) {
+    auto p1 = alloc_.allocate (1);
+    auto p2 = alloc_.allocate (8);
+    ASSERT_FALSE (is_aligned (p2, 2));
+
+    auto p3 = alloc_.realloc (p2, 8, 16);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_TRUE (is_aligned (p3, 16));
+    EXPECT_EQ (alloc_.num_allocs (), 2U);
+
+    alloc_.free (p1);
+    alloc_.free (p3);
+    ASSERT_TRUE (alloc_.check ());
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+namespace {
+
+    /// Runs a random sequence of allocate, realloc and free operations against an allocator
+    /// with a single fixed buffer and records the offset of each block handed out.
+    template <typename Allocator>
+    std::vector<std::ptrdiff_t> random_workload (unsigned num_ops = 4000) {
+        using address = typename Allocator::address;
+        std::vector<std::uint8_t> buffer (64 * 1024);
+        Allocator alloc{[](std::size_t) { return std::pair<address, std::size_t>{nullptr, 0}; },
+                        std::make_pair (address_traits<address>::from_pointer (buffer.data (),
+                                                                               buffer.data ()),
+                                        buffer.size ())};
+        alloc.set_base (buffer.data ());
+
+        std::vector<std::ptrdiff_t> offsets;
+        std::vector<address> live;
+        std::mt19937 random;
+        for (auto ctr = 0U; ctr < num_ops; ++ctr) {
+            auto const op = random () % 4U;
+            if (op == 0U && !live.empty ()) {
+                auto const index = random () % live.size ();
+                alloc.free (live[index]);
+                live.erase (live.begin () + static_cast<std::ptrdiff_t> (index));
+            } else if (op == 1U && !live.empty ()) {
+                auto & p = live[random () % live.size ()];
+                auto const p2 = alloc.realloc (p, random () % 256U);
+                if (p2 != nullptr) {
+                    p = p2;
+                    offsets.push_back (alloc.to_pointer (p) - buffer.data ());
+                }
+            } else {
+                auto const alignment = std::size_t{1} << (random () % 4U);
+                auto const p = alloc.allocate (random () % 256U, alignment);
+                if (p != nullptr) {
+                    live.push_back (p);
+                    offsets.push_back (alloc.to_pointer (p) - buffer.data ());
+                }
+            }
+            EXPECT_TRUE (alloc.check ());
+        }
+        return offsets;
+    }
+
+} // end anonymous namespace
+
+TEST (AllocatorContainers, FlatMatchesMap) {
+    auto const map_offsets = random_workload<basic_allocator<map_containers>> ();
+    auto const flat_offsets = random_workload<basic_allocator<flat_containers>> ();
+    EXPECT_EQ (map_offsets, flat_offsets);
+}
+
+TEST (AllocatorFit, RandomWorkload) {
+    // random_workload() checks the heap after each operation.
+    constexpr auto num_ops = 1000U;
+    auto const best = random_workload<allocator> (num_ops);
+    auto const first = random_workload<fit_allocator<first_fit>> (num_ops);
+    auto const next = random_workload<fit_allocator<next_fit>> (num_ops);
+    EXPECT_NE (first, best);
+    EXPECT_NE (next, first);
+}
+
+TEST (AllocatorAddresses, OffsetsMatchPointers) {
+    constexpr auto num_ops = 1000U;
+    auto const pointer_offsets = random_workload<allocator> (num_ops);
+    EXPECT_EQ (random_workload<offset_allocator> (num_ops), pointer_offsets);
+    EXPECT_EQ (random_workload<compact_allocator<>> (num_ops), pointer_offsets);
+    EXPECT_EQ ((random_workload<compact_allocator<1, flat_containers>> (num_ops)),
+               pointer_offsets);
+}
+
+TEST (AllocatorAddresses, CompactEntriesAreHalfTheSize) {
+    EXPECT_EQ (sizeof (allocator::container::value_type), 2U * sizeof (std::uint64_t));
+    EXPECT_EQ (sizeof (compact_allocator<>::container::value_type), sizeof (std::uint64_t));
+    EXPECT_EQ (sizeof (compact_allocator<16>::size_index::value_type), sizeof (std::uint64_t));
+}
+
+TEST (AllocatorAddresses, GranulesRoundRequests) {
+    auto const offsets = random_workload<compact_allocator<16, flat_containers>> (1000U);
+    EXPECT_FALSE (offsets.empty ());
+    EXPECT_TRUE (std::all_of (std::begin (offsets), std::end (offsets),
+                              [](std::ptrdiff_t o) { return o % 16 == 0; }));
+
+    std::vector<std::uint8_t> buffer (1024);
+    compact_allocator<16> alloc{[](std::size_t) {
+                                    return std::make_pair (compact_offset<16>{nullptr}, 0);
+                                },
+                                std::make_pair (compact_offset<16>{0}, buffer.size ())};
+    auto const p1 = alloc.allocate (1);
+    auto const p2 = alloc.allocate (17);
+    EXPECT_EQ (p1.get (), 0U);
+    EXPECT_EQ (p2.get (), 16U);
+    EXPECT_EQ (alloc.allocated_space (), 48U);
+    EXPECT_EQ (alloc.realloc (p1, 16), p1);
+    EXPECT_TRUE (alloc.check ());
+
+    // Size classes must be whole granules.
+    EXPECT_THROW ((compact_allocator<16>{[](std::size_t) {
+                                             return std::make_pair (compact_offset<16>{nullptr},
+                                                                    0);
+                                         },
+                                         std::make_pair (nullptr, 0),
+                                         compact_allocator<16>::size_classes{{16, 24}}}),
+                  std::invalid_argument);
+}
+
+TEST (AllocatorAddresses, UnrepresentableStorageIsRejected) {
+    using offset = compact_offset<16>;
+    auto const none = [](std::size_t) { return std::make_pair (offset{nullptr}, 0); };
+    // A region which is not whole granules.
+    EXPECT_THROW ((compact_allocator<16>{none, std::make_pair (offset{0}, 1000)}),
+                  std::invalid_argument);
+
+    // A grant which ends beyond the largest offset.
+    auto const largest = std::uint64_t{0xFFFFFFFE} * 16U;
+    compact_allocator<16> alloc{[largest](std::size_t) {
+                                    return std::make_pair (offset{largest - 256U}, 512);
+                                },
+                                std::make_pair (offset{0}, 1024)};
+    EXPECT_NE (alloc.allocate (512), nullptr);
+    EXPECT_THROW (alloc.allocate (1024), std::invalid_argument);
+    EXPECT_EQ (alloc.num_regions (), 1U);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (AllocatorAddresses, UnrepresentableDataIsNotLoaded) {
+    // An offset allocator's storage functions deal in offsets, so an 8 GiB heap needs no memory.
+    offset_allocator wide{[](std::size_t) { return std::make_pair (heap_offset{nullptr}, 0); },
+                          std::make_pair (heap_offset{0}, std::size_t{1} << 33U)};
+    ASSERT_NE (wide.allocate (std::size_t{1} << 32U), nullptr);
+
+    for (auto const format : {save_format::compact, save_format::raw}) {
+        std::stringstream str;
+        wide.save (str, nullptr, format);
+        compact_allocator<> narrow{
+            [](std::size_t) { return std::make_pair (compact_offset<>{nullptr}, 0); },
+            std::make_pair (compact_offset<>{0}, 1024)};
+        EXPECT_THROW (narrow.load (str), bad_metadata);
+        EXPECT_EQ (narrow.num_allocs (), 0U);
+        EXPECT_EQ (narrow.num_regions (), 0U);
+        EXPECT_TRUE (narrow.check ());
+    }
+}
+
+namespace {
+
+    template <typename Iterator>
+    std::size_t sum_sizes (Iterator first, Iterator last) {
+        std::size_t result = 0;
+        for (; first != last; ++first) {
+            result += first->second;
+        }
+        return result;
+    }
+
+    template <typename Allocator>
+    void expect_counters_match (Allocator & alloc) {
+        EXPECT_EQ (alloc.allocated_space (),
+                   sum_sizes (alloc.allocs_begin (), alloc.allocs_end ()));
+        EXPECT_EQ (alloc.free_space (), sum_sizes (alloc.frees_begin (), alloc.freed_end ()));
+        std::size_t largest = 0;
+        for (auto it = alloc.frees_begin (); it != alloc.freed_end (); ++it) {
+            largest = std::max (largest, it->second);
+        }
+        EXPECT_EQ (alloc.largest_free_block (), largest);
+    }
+
+} // end anonymous namespace
+
+TEST (AllocatorCounters, MatchRecountUnderStress) {
+    // The workload of the stress tool: fill a population of blocks, some of them reallocated
+    // immediately, then free a random number of them.
+    constexpr auto num_passes = 8U;
+    constexpr auto num_allocations = 500U;
+    constexpr auto max_allocation_size = std::size_t{256};
+
+    std::list<std::vector<std::uint8_t>> buffers;
+    std::vector<std::size_t> bounds;
+    for (auto size = std::size_t{16}; size <= max_allocation_size; size += 16U) {
+        bounds.push_back (size);
+    }
+    allocator alloc{[&buffers](std::size_t size) {
+                        buffers.emplace_back (std::max (size, std::size_t{8192}));
+                        auto & buffer = buffers.back ();
+                        return std::pair<std::uint8_t *, std::size_t>{buffer.data (),
+                                                                      buffer.size ()};
+                    },
+                    std::make_pair (nullptr, std::size_t{0}),
+                    allocator::size_classes{std::move (bounds)}};
+
+    std::vector<allocator::address> blocks;
+    std::mt19937 random;
+    for (auto pass = 0U; pass < num_passes; ++pass) {
+        while (blocks.size () < num_allocations) {
+            auto ptr = alloc.allocate (random () % max_allocation_size);
+            ASSERT_NE (ptr, nullptr);
+            if (pass % 2U == 1U) {
+                ptr = alloc.realloc (ptr, random () % max_allocation_size);
+                ASSERT_NE (ptr, nullptr);
+            }
+            blocks.push_back (ptr);
+        }
+        expect_counters_match (alloc);
+
+        std::shuffle (std::begin (blocks), std::end (blocks), random);
+        for (auto n = random () % blocks.size (); n > 0; --n) {
+            alloc.free (blocks.back ());
+            blocks.pop_back ();
+        }
+        expect_counters_match (alloc);
+        EXPECT_TRUE (alloc.check ());
+    }
+
+    // The counters must survive a round trip through save() and load().
+    std::stringstream str;
+    alloc.flush_bins ();
+    alloc.save (str);
+    auto const allocated = alloc.allocated_space ();
+    auto const free = alloc.free_space ();
+    alloc.load (str);
+    EXPECT_EQ (alloc.allocated_space (), allocated);
+    EXPECT_EQ (alloc.free_space (), free);
+    expect_counters_match (alloc);
+}
+
+TEST_F (Allocator, AllocateNCarvesContiguousBlocks) {
+    alloc_.free (alloc_.allocate (1));
+    ASSERT_EQ (alloc_.num_frees (), 1U);
+    auto const base = alloc_.frees_begin ()->first;
+
+    std::size_t const sizes[] = {8, 16, 24};
+    allocator::address blocks[3];
+    ASSERT_TRUE (alloc_.allocate_n (sizes, 3, blocks));
+    EXPECT_EQ (blocks[0], base);
+    EXPECT_EQ (blocks[1], base + 8);
+    EXPECT_EQ (blocks[2], base + 24);
+    EXPECT_EQ (alloc_.num_allocs (), 3U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.free_space (), buffer_size - 48U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (Allocator, AllocateNAligned) {
+    std::size_t const sizes[] = {3, 5};
+    allocator::address blocks[2];
+    ASSERT_TRUE (alloc_.allocate_n (sizes, 2, blocks, 16));
+    EXPECT_TRUE (is_aligned (blocks[0], 16));
+    EXPECT_TRUE (is_aligned (blocks[1], 16));
+    EXPECT_EQ (alloc_.allocated_space (), 32U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (Allocator, AllocateNFallsBackWhenFragmented) {
+    auto const b1 = alloc_.allocate (64);
+    alloc_.allocate (64);
+    auto const b3 = alloc_.allocate (64);
+    alloc_.allocate (64);
+    alloc_.free (b1);
+    alloc_.free (b3);
+
+    // Neither hole is large enough for both blocks, but each can hold one of them.
+    std::size_t const sizes[] = {64, 64};
+    allocator::address blocks[2];
+    ASSERT_TRUE (alloc_.allocate_n (sizes, 2, blocks));
+    EXPECT_EQ (blocks[0], b1);
+    EXPECT_EQ (blocks[1], b3);
+    EXPECT_EQ (buffers_.size (), 1U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (Allocator, AllocateNFailureAllocatesNothing) {
+    allocator alloc{[](std::size_t) { return std::pair<std::uint8_t *, std::size_t>{nullptr, 0}; },
+                    std::make_pair (buffers_.emplace (buffers_.end (), 128)->data (),
+                                    std::size_t{128})};
+    std::size_t const sizes[] = {64, 32, 64};
+    allocator::address blocks[3];
+    EXPECT_FALSE (alloc.allocate_n (sizes, 3, blocks));
+    EXPECT_EQ (std::count (std::begin (blocks), std::end (blocks), nullptr), 3);
+    EXPECT_EQ (alloc.num_allocs (), 0U);
+    EXPECT_EQ (alloc.free_space (), 128U);
+}
+
+TEST_F (Allocator, FreeNCoalesces) {
+    allocator::address blocks[4];
+    for (auto & b : blocks) {
+        b = alloc_.allocate (64);
+    }
+    allocator::address const batch[] = {blocks[2], blocks[0], blocks[1]};
+    alloc_.free_n (batch, 3);
+    EXPECT_EQ (alloc_.num_allocs (), 1U);
+    ASSERT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.frees_begin ()->first, blocks[0]);
+    EXPECT_EQ (alloc_.frees_begin ()->second, 192U);
+
+    alloc_.free_n (&blocks[3], 1);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    ASSERT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.frees_begin ()->second, buffer_size);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (Allocator, FreeNRejectsBadAddresses) {
+    auto const p1 = alloc_.allocate (16);
+    auto const p2 = alloc_.allocate (16);
+    allocator::address const twice[] = {p1, p2, p1};
+    EXPECT_THROW (alloc_.free_n (twice, 3), no_allocation);
+    allocator::address const unknown[] = {p1, p2 + 1};
+    EXPECT_THROW (alloc_.free_n (unknown, 2), no_allocation);
+    EXPECT_EQ (alloc_.num_allocs (), 2U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (BinnedAllocator, FreeNFillsBins) {
+    allocator::address const batch[] = {alloc_.allocate (16), alloc_.allocate (100),
+                                        alloc_.allocate (16)};
+    alloc_.free_n (batch, 3);
+    EXPECT_EQ (alloc_.num_allocs (), 0U);
+    EXPECT_EQ (alloc_.num_binned (), 2U);
+    EXPECT_TRUE (alloc_.check ());
+
+    // A batch allocation takes blocks from the bins first.
+    std::size_t const sizes[] = {16, 16};
+    allocator::address blocks[2];
+    ASSERT_TRUE (alloc_.allocate_n (sizes, 2, blocks));
+    EXPECT_EQ (alloc_.num_binned (), 0U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST (AllocatorBatch, FreeNMatchesFree) {
+    // Two allocators are given the same workload. One frees blocks individually and the other in
+    // batches; the resulting free-space maps must be identical.
+    constexpr auto size = std::size_t{64 * 1024};
+    std::vector<std::uint8_t> buffer1 (size);
+    std::vector<std::uint8_t> buffer2 (size);
+    auto const no_storage = [](std::size_t) {
+        return std::pair<std::uint8_t *, std::size_t>{nullptr, 0};
+    };
+    allocator alloc1{no_storage, std::make_pair (buffer1.data (), size)};
+    allocator alloc2{no_storage, std::make_pair (buffer2.data (), size)};
+
+    std::mt19937 random;
+    std::vector<std::ptrdiff_t> live;
+    for (auto pass = 0U; pass < 50U; ++pass) {
+        while (live.size () < 200U) {
+            auto const bytes = random () % 256U;
+            auto const p1 = alloc1.allocate (bytes);
+            auto const p2 = alloc2.allocate (bytes);
+            ASSERT_EQ (p1 - buffer1.data (), p2 - buffer2.data ());
+            live.push_back (p1 - buffer1.data ());
+        }
+        std::shuffle (std::begin (live), std::end (live), random);
+        std::vector<allocator::address> batch;
+        for (auto n = random () % live.size (); n > 0; --n) {
+            alloc1.free (buffer1.data () + live.back ());
+            batch.push_back (buffer2.data () + live.back ());
+            live.pop_back ();
+        }
+        alloc2.free_n (batch.data (), batch.size ());
+        ASSERT_TRUE (alloc2.check ());
+        ASSERT_EQ (alloc1.num_frees (), alloc2.num_frees ());
+        ASSERT_TRUE (std::equal (alloc1.frees_begin (), alloc1.freed_end (), alloc2.frees_begin (),
+                                 [&](allocator::container::value_type const & f1,
+                                     allocator::container::value_type const & f2) {
+                                     return f1.first - buffer1.data () ==
+                                                f2.first - buffer2.data () &&
+                                            f1.second == f2.second;
+                                 }));
+    }
+}
+
+TEST_F (Allocator, ReallocGrowsIntoPrecedingFreeBlock) {
+    auto const b1 = alloc_.allocate (64);
+    auto const b2 = alloc_.allocate (64);
+    alloc_.allocate (128);
+    std::iota (b2, b2 + 64, std::uint8_t{0});
+    alloc_.free (b1);
+
+    // There's no space after b2 but together with the free block before it there's enough.
+    auto const p = alloc_.realloc (b2, 100);
+    EXPECT_EQ (p, b1);
+    EXPECT_EQ (buffers_.size (), 1U);
+    for (auto ctr = 0; ctr < 64; ++ctr) {
+        EXPECT_EQ (p[ctr], ctr);
+    }
+    EXPECT_EQ (alloc_.allocated_space (), 228U);
+    ASSERT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.frees_begin ()->first, b1 + 100);
+    EXPECT_EQ (alloc_.frees_begin ()->second, 28U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (Allocator, ReallocGrowsIntoFreeBlocksOnBothSides) {
+    auto const b1 = alloc_.allocate (64);
+    auto const b2 = alloc_.allocate (64);
+    auto const b3 = alloc_.allocate (64);
+    alloc_.allocate (64);
+    std::fill_n (b2, 64, std::uint8_t{42});
+    alloc_.free (b1);
+    alloc_.free (b3);
+
+    auto const p = alloc_.realloc (b2, 192);
+    EXPECT_EQ (p, b1);
+    EXPECT_EQ (std::count (p, p + 64, std::uint8_t{42}), 64);
+    EXPECT_EQ (alloc_.num_frees (), 0U);
+    EXPECT_EQ (buffers_.size (), 1U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (Allocator, ReallocMovesWhenNeighboursAreTooSmall) {
+    auto const b1 = alloc_.allocate (16);
+    auto const b2 = alloc_.allocate (64);
+    alloc_.allocate (176);
+    alloc_.free (b1);
+
+    auto const p = alloc_.realloc (b2, 128);
+    EXPECT_NE (p, b1);
+    EXPECT_EQ (buffers_.size (), 2U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+namespace {
+
+    /// Hands out successive pieces of a single buffer, like sbrk(), so that each grant is
+    /// contiguous with the last.
+    class contiguous_storage {
+    public:
+        explicit contiguous_storage (std::size_t size)
+                : buffer_ (size) {}
+        std::pair<std::uint8_t *, std::size_t> operator() (std::size_t size) {
+            size = std::max (size, std::size_t{256});
+            if (used_ + size > buffer_.size ()) {
+                return {nullptr, 0};
+            }
+            auto const result = std::make_pair (buffer_.data () + used_, size);
+            used_ += size;
+            return result;
+        }
+        /// Grows the region [start, start + size) if it ends at the most recent grant.
+        std::size_t extend (std::uint8_t * start, std::size_t size, std::size_t additional) {
+            if (start + size != buffer_.data () + used_ || used_ + additional > buffer_.size ()) {
+                return 0;
+            }
+            used_ += additional;
+            return additional;
+        }
+        std::uint8_t * data () noexcept { return buffer_.data (); }
+        std::size_t used () const noexcept { return used_; }
+
+    private:
+        std::vector<std::uint8_t> buffer_;
+        std::size_t used_ = 0;
+    };
+
+} // end anonymous namespace
+
+TEST (AllocatorRegions, ContiguousGrantsAreMerged) {
+    contiguous_storage storage{4096};
+    allocator alloc{std::ref (storage)};
+
+    auto const p1 = alloc.allocate (200);
+    EXPECT_EQ (p1, storage.data ());
+    // Only 56 bytes remain in the first grant. The second is contiguous with it, so the two free
+    // blocks are merged and the allocation spans the boundary.
+    auto const p2 = alloc.allocate (100);
+    EXPECT_EQ (p2, storage.data () + 200);
+    EXPECT_EQ (alloc.num_frees (), 1U);
+    ASSERT_EQ (alloc.num_regions (), 1U);
+    EXPECT_EQ (alloc.regions_begin ()->first, storage.data ());
+    EXPECT_EQ (alloc.regions_begin ()->second, 512U);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST_F (Allocator, SeparateGrantsAreSeparateRegions) {
+    alloc_.allocate (200);
+    alloc_.allocate (100);
+    EXPECT_EQ (buffers_.size (), 2U);
+    EXPECT_EQ (alloc_.num_regions (), 2U);
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST (AllocatorRegions, SaveAndLoad) {
+    contiguous_storage storage{4096};
+    allocator alloc{std::ref (storage)};
+    alloc.allocate (200);
+    alloc.allocate (100);
+    alloc.allocate (300);
+
+    // The raw format doesn't record the regions, so they are rebuilt from the blocks. Data
+    // which follows the snapshot in the stream is left for the caller to read.
+    std::stringstream str;
+    alloc.save (str, storage.data (), save_format::raw);
+    write (str, std::uint64_t{42});
+
+    allocator loaded{std::ref (storage)};
+    loaded.load (str, storage.data ());
+    EXPECT_TRUE (std::equal (alloc.regions_begin (), alloc.regions_end (),
+                             loaded.regions_begin ()));
+    EXPECT_EQ (loaded.num_regions (), alloc.num_regions ());
+    EXPECT_TRUE (loaded.check ());
+    EXPECT_EQ (read<std::uint64_t> (str), 42U);
+}
+
+namespace {
+
+    /// Fills an allocator with a random mixture of allocated and free blocks.
+    void make_random_heap (allocator & alloc, std::size_t num_blocks) {
+        std::mt19937 random;
+        std::vector<allocator::address> blocks;
+        for (auto ctr = std::size_t{0}; ctr < num_blocks; ++ctr) {
+            blocks.push_back (alloc.allocate (random () % 256U + 1U));
+        }
+        for (auto ctr = std::size_t{0}; ctr < num_blocks / 3U; ++ctr) {
+            auto const pos = blocks.begin () + static_cast<std::ptrdiff_t> (random () %
+                                                                             blocks.size ());
+            alloc.free (*pos);
+            blocks.erase (pos);
+        }
+    }
+
+    /// Wraps \p body in the compact format's header and checksum.
+    std::string compact_data (std::vector<std::uint8_t> const & body) {
+        std::vector<std::uint8_t> out{'E', 'X', 'T', 'A', 'L', 'L', 'O', 'C'};
+        encoding::put_u64 (out, 1U); // The version.
+        encoding::put_u64 (out, body.size ());
+        out.insert (std::end (out), std::begin (body), std::end (body));
+        encoding::put_u64 (out, encoding::fnv1a (body.data (), body.size ()));
+        return std::string (std::begin (out), std::end (out));
+    }
+
+    /// True if \p alloc has no blocks, storage, or free space.
+    bool is_empty (allocator const & alloc) {
+        return alloc.num_allocs () == 0U && alloc.num_frees () == 0U &&
+               alloc.num_regions () == 0U && alloc.allocated_space () == 0U &&
+               alloc.free_space () == 0U && alloc.check ();
+    }
+
+} // end anonymous namespace
+
+TEST_F (Allocator, CompactSaveRoundTrips) {
+    make_random_heap (alloc_, 1000);
+    std::stringstream raw;
+    alloc_.save (raw, nullptr, save_format::raw);
+    std::stringstream compact;
+    alloc_.save (compact);
+    // Most blocks are encoded in two or three bytes rather than sixteen. (The compact data also
+    // holds the region list, which the raw format leaves to be rebuilt.)
+    EXPECT_LT (compact.str ().size () * 3U, raw.str ().size ());
+
+    allocator loaded{[](std::size_t) {
+        return std::pair<std::uint8_t *, std::size_t>{nullptr, 0};
+    }};
+    loaded.load (compact);
+    EXPECT_TRUE (loaded.check ());
+    EXPECT_EQ (loaded.num_allocs (), alloc_.num_allocs ());
+    EXPECT_TRUE (std::equal (alloc_.allocs_begin (), alloc_.allocs_end (),
+                             loaded.allocs_begin ()));
+    EXPECT_TRUE (std::equal (alloc_.frees_begin (), alloc_.freed_end (), loaded.frees_begin ()));
+    EXPECT_EQ (loaded.largest_free_block (), alloc_.largest_free_block ());
+    EXPECT_EQ (loaded.allocated_space (), alloc_.allocated_space ());
+    EXPECT_EQ (loaded.free_space (), alloc_.free_space ());
+}
+
+TEST_F (Allocator, CompactLoadDetectsDamage) {
+    make_random_heap (alloc_, 100);
+    std::stringstream str;
+    alloc_.save (str);
+    auto const good = str.str ();
+
+    auto damaged = good;
+    damaged[good.size () / 2U] ^= 0x10;
+    std::stringstream s1{damaged};
+    EXPECT_THROW (alloc_.load (s1), bad_metadata);
+
+    std::stringstream s2{good.substr (0, good.size () - 1U)};
+    EXPECT_THROW (alloc_.load (s2), bad_metadata);
+
+    damaged = good;
+    damaged[8] = 99; // The version.
+    std::stringstream s3{damaged};
+    EXPECT_THROW (alloc_.load (s3), bad_metadata);
+
+    // A body size far larger than the stream is reported as truncation; the whole body is not
+    // allocated up front.
+    damaged = good;
+    damaged[22] = 0x7F;
+    std::stringstream s4{damaged};
+    EXPECT_THROW (alloc_.load (s4), bad_metadata);
+}
+
+TEST_F (Allocator, LoadRejectsEntriesOutOfOrder) {
+    make_random_heap (alloc_, 100);
+    std::vector<std::uint8_t> buffer (256);
+
+    // Two allocations, the second starting 32 bytes before the end of the first. The data passes
+    // its checksum, so it is the order which must be checked.
+    std::vector<std::uint8_t> body;
+    for (auto const v : {2, 0, 16, 63, 16, 0, 0}) {
+        encoding::put_varint (body, static_cast<std::uint64_t> (v));
+    }
+    std::stringstream str{compact_data (body)};
+    EXPECT_THROW (alloc_.load (str, buffer.data ()), bad_metadata);
+    // The allocator is left empty, not with a mixture of old and new metadata.
+    EXPECT_TRUE (is_empty (alloc_));
+    EXPECT_NE (alloc_.allocate (10), nullptr);
+    EXPECT_TRUE (alloc_.check ());
+
+    // A block whose size would take it beyond the end of the address space.
+    body.clear ();
+    encoding::put_varint (body, 1U);
+    encoding::put_varint (body, encoding::zigzag (64));
+    encoding::put_varint (body, ~std::uint64_t{0} - 16U);
+    encoding::put_varint (body, 0U);
+    encoding::put_varint (body, 0U);
+    std::stringstream wraps{compact_data (body)};
+    EXPECT_THROW (alloc_.load (wraps, buffer.data ()), bad_metadata);
+    EXPECT_TRUE (is_empty (alloc_));
+}
+
+TEST_F (Allocator, TruncatedRawDataLeavesTheAllocatorEmpty) {
+    make_random_heap (alloc_, 100);
+    std::stringstream str;
+    alloc_.save (str, nullptr, save_format::raw);
+    // The data ends part way through the free blocks, after the allocations have been read.
+    auto const full = str.str ();
+    std::stringstream truncated{full.substr (0, full.size () - 8U)};
+    EXPECT_THROW (alloc_.load (truncated), bad_metadata);
+    EXPECT_TRUE (is_empty (alloc_));
+}
+
+TEST (AllocatorRegions, ExtendIsPreferredToNewStorage) {
+    contiguous_storage storage{4096};
+    allocator alloc{std::ref (storage)};
+    alloc.set_extend_storage (std::bind (&contiguous_storage::extend, &storage,
+                                         std::placeholders::_1, std::placeholders::_2,
+                                         std::placeholders::_3));
+
+    alloc.allocate (200);
+    EXPECT_EQ (storage.used (), 256U);
+    // The 56 free bytes at the end of the region are short by 44 bytes. The region is extended
+    // by exactly that amount rather than a new 256 byte grant being made.
+    auto const p2 = alloc.allocate (100);
+    EXPECT_EQ (p2, storage.data () + 200);
+    EXPECT_EQ (storage.used (), 300U);
+    EXPECT_EQ (alloc.num_frees (), 0U);
+    ASSERT_EQ (alloc.num_regions (), 1U);
+    EXPECT_EQ (alloc.regions_begin ()->second, 300U);
+    EXPECT_TRUE (alloc.check ());
+}
+
+TEST (AllocatorRegions, ReallocGrowsRegionInPlace) {
+    contiguous_storage storage{4096};
+    allocator alloc{std::ref (storage)};
+    alloc.set_extend_storage (std::bind (&contiguous_storage::extend, &storage,
+                                         std::placeholders::_1, std::placeholders::_2,
+                                         std::placeholders::_3));
+
+    alloc.allocate (200);
+    auto const p2 = alloc.allocate (56);
+    std::fill_n (p2, 56, std::uint8_t{0x5A});
+    // The block is at the end of the region so it grows without moving.
+    EXPECT_EQ (alloc.realloc (p2, 1000), p2);
+    EXPECT_EQ (storage.used (), 1200U);
+    EXPECT_EQ (alloc.num_regions (), 1U);
+    EXPECT_EQ (alloc.allocated_space (), 1200U);
+    EXPECT_TRUE (std::all_of (p2, p2 + 56, [](std::uint8_t v) { return v == 0x5A; }));
+    EXPECT_TRUE (alloc.check ());
+}
+
+namespace {
+
+    class TrimAllocator : public ::testing::Test {
+    public:
+        TrimAllocator ();
+
+        static constexpr std::size_t page_size = 64;
+        static constexpr std::size_t buffer_size = 256;
+
+        std::list<std::vector<std::uint8_t>> buffers_;
+        std::vector<std::tuple<allocator::address, std::size_t, release_kind>> released_;
+        bool release_regions_ = true;
+        allocator alloc_;
+    };
+
+    constexpr std::size_t TrimAllocator::page_size;
+    constexpr std::size_t TrimAllocator::buffer_size;
+
+    TrimAllocator::TrimAllocator ()
+            : alloc_{[this](std::size_t size) {
+                         buffers_.emplace_back (std::max (size, buffer_size));
+                         auto & buffer = buffers_.back ();
+                         return std::pair<uint8_t *, size_t>{buffer.data (), buffer.size ()};
+                     }} {
+        alloc_.set_release_storage (
+            [this](allocator::address addr, std::size_t size, release_kind kind) {
+                if (kind == release_kind::region && !release_regions_) {
+                    return false;
+                }
+                released_.emplace_back (addr, size, kind);
+                return true;
+            });
+    }
+
+} // end anonymous namespace
+
+TEST_F (TrimAllocator, NoFunctionReleasesNothing) {
+    allocator alloc{[](std::size_t) { return std::pair<std::uint8_t *, std::size_t>{nullptr, 0}; }};
+    EXPECT_EQ (alloc.trim (), 0U);
+    EXPECT_THROW (alloc_.trim (0, 3), std::invalid_argument);
+}
+
+TEST_F (TrimAllocator, FreeRegionIsReleased) {
+    auto const p1 = alloc_.allocate (200);
+    auto const p2 = alloc_.allocate (200);
+    ASSERT_EQ (alloc_.num_regions (), 2U);
+    alloc_.free (p2);
+
+    EXPECT_EQ (alloc_.trim (0, page_size), buffer_size);
+    ASSERT_EQ (released_.size (), 1U);
+    EXPECT_EQ (std::get<0> (released_[0]), p2);
+    EXPECT_EQ (std::get<2> (released_[0]), release_kind::region);
+    EXPECT_EQ (alloc_.num_regions (), 1U);
+    EXPECT_EQ (alloc_.free_space (), 56U);
+    EXPECT_TRUE (alloc_.check ());
+    alloc_.free (p1);
+}
+
+TEST_F (TrimAllocator, KeepBytesIsRespected) {
+    alloc_.free (alloc_.allocate (200));
+    EXPECT_EQ (alloc_.trim (buffer_size, page_size), 0U);
+    EXPECT_TRUE (released_.empty ());
+    EXPECT_EQ (alloc_.num_regions (), 1U);
+}
+
+TEST_F (TrimAllocator, FreeInteriorPagesAreReleased) {
+    release_regions_ = false;
+    alloc_.allocate (10);
+    // The region cannot be released, but the whole pages in the free block which follows the
+    // allocation can.
+    auto const released = alloc_.trim (0, page_size);
+    ASSERT_EQ (released_.size (), 1U);
+    auto const addr = std::get<0> (released_[0]);
+    auto const size = std::get<1> (released_[0]);
+    EXPECT_EQ (std::get<2> (released_[0]), release_kind::pages);
+    EXPECT_EQ (released, size);
+    EXPECT_EQ (reinterpret_cast<std::uintptr_t> (addr) % page_size, 0U);
+    EXPECT_EQ (size % page_size, 0U);
+    EXPECT_GE (size, buffer_size - 2U * page_size);
+    // The pages remain free space.
+    EXPECT_EQ (alloc_.free_space (), buffer_size - 10U);
+    EXPECT_TRUE (alloc_.check ());
+
+    // Nothing records that the pages were offered, so the next call offers them again.
+    EXPECT_EQ (alloc_.trim (0, page_size), released);
+    ASSERT_EQ (released_.size (), 2U);
+    EXPECT_EQ (std::get<0> (released_[1]), addr);
+    EXPECT_EQ (std::get<1> (released_[1]), size);
+}
+
+namespace {
+
+    class OffsetAllocator : public ::testing::Test {
+    public:
+        OffsetAllocator ();
+
+        static constexpr std::size_t heap_size = 1024;
+
+        // The heap is grown by handing out the next part of the buffer.
+        std::vector<std::uint8_t> buffer_;
+        std::size_t used_ = 0;
+        offset_allocator alloc_;
+    };
+
+    constexpr std::size_t OffsetAllocator::heap_size;
+
+    OffsetAllocator::OffsetAllocator ()
+            : buffer_ (heap_size)
+            , alloc_{[this](std::size_t size) {
+                         auto const start = heap_offset{used_};
+                         size = std::min (std::max (size, std::size_t{256}), heap_size - used_);
+                         used_ += size;
+                         return std::make_pair (start, size);
+                     }} {
+        alloc_.set_base (buffer_.data ());
+    }
+
+} // end anonymous namespace
+
+TEST_F (OffsetAllocator, AddressesAreOffsets) {
+    auto const p1 = alloc_.allocate (100);
+    auto const p2 = alloc_.allocate (16, 64);
+    EXPECT_EQ (p1, heap_offset{0});
+    EXPECT_EQ (p2.get () % 64U, 0U);
+    EXPECT_EQ (alloc_.to_pointer (p2), buffer_.data () + p2.get ());
+    // The rest of the buffer is granted, and merged with the first grant, but isn't enough.
+    EXPECT_EQ (alloc_.allocate (heap_size), nullptr);
+    EXPECT_EQ (alloc_.num_regions (), 1U);
+    EXPECT_TRUE (alloc_.check ());
+
+    alloc_.free (p1);
+    alloc_.free (p2);
+    EXPECT_THROW (alloc_.free (p2), no_allocation);
+    EXPECT_EQ (alloc_.free_space (), heap_size);
+}
+
+TEST_F (OffsetAllocator, ReallocMovesContents) {
+    auto const p1 = alloc_.allocate (32);
+    alloc_.allocate (32);
+    std::fill_n (alloc_.to_pointer (p1), 32, std::uint8_t{0x3C});
+    // The block is hemmed in so it must move. The contents are copied through the base.
+    auto const p2 = alloc_.realloc (p1, 64);
+    ASSERT_NE (p2, nullptr);
+    EXPECT_NE (p2, p1);
+    auto const ptr = alloc_.to_pointer (p2);
+    EXPECT_TRUE (std::all_of (ptr, ptr + 32, [](std::uint8_t v) { return v == 0x3C; }));
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST_F (OffsetAllocator, SavedMetadataIsPositionIndependent) {
+    for (auto size = std::size_t{1}; size < 40U; ++size) {
+        alloc_.allocate (size, size % 2U == 0U ? 8U : 1U);
+    }
+    alloc_.free (std::next (alloc_.allocs_begin (), 7)->first);
+
+    // The base passed to save() has no effect.
+    std::ostringstream os1;
+    std::ostringstream os2;
+    alloc_.save (os1, buffer_.data ());
+    alloc_.save (os2);
+    EXPECT_EQ (os1.str (), os2.str ());
+
+    for (auto const format : {save_format::raw, save_format::compact}) {
+        std::stringstream s;
+        alloc_.save (s, nullptr, format);
+        offset_allocator loaded{[](std::size_t) { return std::make_pair (heap_offset{}, 0); }};
+        loaded.load (s);
+        EXPECT_TRUE (std::equal (alloc_.allocs_begin (), alloc_.allocs_end (),
+                                 loaded.allocs_begin ()));
+        EXPECT_EQ (loaded.num_allocs (), alloc_.num_allocs ());
+        EXPECT_EQ (loaded.free_space (), alloc_.free_space ());
+        EXPECT_EQ (loaded.num_regions (), alloc_.num_regions ());
+        EXPECT_TRUE (loaded.check ());
+    }
+}
+
+TEST_F (OffsetAllocator, CompactGathersFreeSpace) {
+    std::vector<heap_offset> blocks;
+    for (auto n = 0U; n < 8U; ++n) {
+        blocks.push_back (alloc_.allocate (32));
+        std::fill_n (alloc_.to_pointer (blocks.back ()), 32, static_cast<std::uint8_t> (n));
+    }
+    for (auto n = 0U; n < 8U; n += 2U) {
+        alloc_.free (blocks[n]);
+    }
+    EXPECT_EQ (alloc_.num_frees (), 4U);
+
+    std::stringstream snapshot;
+    alloc_.save (snapshot);
+    std::vector<std::tuple<journal_op, heap_offset, std::size_t>> changes;
+    alloc_.set_journal ([&changes](journal_op op, heap_offset addr, std::size_t size) {
+        changes.emplace_back (op, addr, size);
+    });
+
+    std::vector<std::tuple<heap_offset, heap_offset, std::size_t>> moves;
+    auto const moved =
+        alloc_.compact ([&moves](heap_offset from, heap_offset to, std::size_t size) {
+            moves.emplace_back (from, to, size);
+        });
+    EXPECT_EQ (moved, 4U * 32U);
+    ASSERT_EQ (moves.size (), 4U);
+    for (auto n = 0U; n < 4U; ++n) {
+        EXPECT_EQ (std::get<0> (moves[n]), blocks[n * 2U + 1U]);
+        EXPECT_EQ (std::get<1> (moves[n]), heap_offset{n * 32U});
+        auto const ptr = alloc_.to_pointer (std::get<1> (moves[n]));
+        auto const value = static_cast<std::uint8_t> (n * 2U + 1U);
+        EXPECT_TRUE (std::all_of (ptr, ptr + 32, [value](std::uint8_t v) { return v == value; }));
+    }
+    ASSERT_EQ (alloc_.num_frees (), 1U);
+    EXPECT_EQ (alloc_.frees_begin ()->first, heap_offset{128});
+    EXPECT_EQ (alloc_.compact (nullptr), 0U);
+    EXPECT_TRUE (alloc_.check ());
+
+    // The journal reproduces the compacted heap from the earlier snapshot.
+    offset_allocator replayed{[](std::size_t) { return std::make_pair (heap_offset{}, 0); }};
+    replayed.load (snapshot);
+    for (auto const & c : changes) {
+        replayed.replay (std::get<0> (c), std::get<1> (c), std::get<2> (c));
+    }
+    EXPECT_TRUE (std::equal (alloc_.allocs_begin (), alloc_.allocs_end (),
+                             replayed.allocs_begin ()));
+    EXPECT_EQ (replayed.num_frees (), 1U);
+}
+
+TEST_F (OffsetAllocator, CompactStopsAtBudget) {
+    std::vector<heap_offset> blocks;
+    for (auto n = 0U; n < 6U; ++n) {
+        blocks.push_back (alloc_.allocate (16));
+    }
+    alloc_.free (blocks[0]);
+    alloc_.free (blocks[3]);
+
+    // Each call moves one block, continuing where the last stopped.
+    auto calls = 0U;
+    while (alloc_.compact (nullptr, 1U) > 0U) {
+        ++calls;
+        EXPECT_TRUE (alloc_.check ());
+    }
+    EXPECT_EQ (calls, 4U);
+    EXPECT_EQ (alloc_.num_frees (), 1U);
+}
+
+TEST_F (OffsetAllocator, CompactKeepsAlignment) {
+    alloc_.allocate (8);
+    auto const p2 = alloc_.allocate (8);
+    auto const p3 = alloc_.allocate (16, 64);
+    ASSERT_EQ (p3, heap_offset{64});
+    alloc_.free (p2);
+
+    // The block can't move down and stay 64-byte aligned.
+    EXPECT_EQ (alloc_.compact (nullptr, std::numeric_limits<std::size_t>::max (), 64), 0U);
+    EXPECT_EQ (std::next (alloc_.allocs_begin ())->first, p3);
+    EXPECT_THROW (alloc_.compact (nullptr, 1, 3), std::invalid_argument);
+
+    heap_offset moved_to{nullptr};
+    EXPECT_EQ (alloc_.compact ([&moved_to](heap_offset, heap_offset to,
+                                           std::size_t) { moved_to = to; },
+                               std::numeric_limits<std::size_t>::max (), 16),
+               16U);
+    EXPECT_EQ (moved_to, heap_offset{16});
+    EXPECT_TRUE (alloc_.check ());
+}
+
+TEST (HeapStats, Buckets) {
+    EXPECT_EQ (heap_stats::bucket (1), 0U);
+    EXPECT_EQ (heap_stats::bucket (2), 1U);
+    EXPECT_EQ (heap_stats::bucket (3), 1U);
+    EXPECT_EQ (heap_stats::bucket (4096), 12U);
+    EXPECT_EQ (heap_stats::bucket (std::numeric_limits<std::size_t>::max ()),
+               heap_stats::histogram_size - 1U);
+}
+
+TEST_F (Allocator, StatsDescribeFragmentation) {
+    EXPECT_EQ (alloc_.stats ().fragmentation (), 0.0);
+    alloc_.allocate (16);
+    auto const p2 = alloc_.allocate (32);
+    alloc_.allocate (64);
+    alloc_.free (p2);
+    ASSERT_TRUE (alloc_.check ());
+
+    auto const stats = alloc_.stats ();
+    EXPECT_EQ (stats.num_allocs, 2U);
+    EXPECT_EQ (stats.allocated_space, 80U);
+    EXPECT_EQ (stats.num_free_blocks, 2U);
+    EXPECT_EQ (stats.free_space, buffer_size - 80U);
+    EXPECT_EQ (stats.largest_free_block, buffer_size - 112U);
+    EXPECT_DOUBLE_EQ (stats.fragmentation (), 32.0 / 176.0);
+    EXPECT_EQ (std::accumulate (std::begin (stats.histogram), std::end (stats.histogram),
+                                std::size_t{0}),
+               2U);
+    EXPECT_EQ (stats.histogram[5], 1U);
+    EXPECT_EQ (stats.histogram[7], 1U);
+    ASSERT_EQ (stats.regions.size (), 1U);
+    EXPECT_EQ (stats.regions[0].size, buffer_size);
+    EXPECT_EQ (stats.regions[0].allocated, 80U);
+
+    std::ostringstream os;
+    alloc_.dump (os, true);
+    EXPECT_NE (os.str ().find ("fragmentation"), std::string::npos);
+}
+
+TEST_F (BinnedAllocator, StatsCountBinnedBlocksAsFree) {
+    auto const p1 = alloc_.allocate (16);
+    alloc_.allocate (16);
+    alloc_.free (p1);
+    ASSERT_EQ (alloc_.num_binned (), 1U);
+
+    auto const stats = alloc_.stats ();
+    EXPECT_EQ (stats.num_free_blocks, 2U);
+    EXPECT_EQ (stats.free_space, buffer_size - 16U);
+    EXPECT_EQ (stats.histogram[4], 1U);
+    ASSERT_EQ (stats.regions.size (), 1U);
+    EXPECT_EQ (stats.regions[0].allocated, 16U);
+}